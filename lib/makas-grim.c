@@ -1,4 +1,7 @@
+#define _GNU_SOURCE
 #include "makas-grim.h"
+#include "makas-pixel.h"
+#include "makas-save-private.h"
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -7,11 +10,14 @@
 #include <limits.h>
 #include <math.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/mman.h>
 #include <unistd.h>
 #include <time.h>
+#include <gio/gunixoutputstream.h>
 #include <pixman.h>
 #include <wayland-client.h>
+#include "ext-foreign-toplevel-list-v1-protocol.h"
 #include "ext-image-capture-source-v1-protocol.h"
 #include "ext-image-copy-capture-v1-protocol.h"
 #include "wlr-screencopy-unstable-v1-protocol.h"
@@ -29,6 +35,13 @@
 #endif
 #endif
 
+/* Pixman format whose memory layout is GdkPixbuf's R, G, B, A byte order */
+#if GRIM_LITTLE_ENDIAN
+#define GRIM_PIXBUF_FORMAT PIXMAN_a8b8g8r8
+#else
+#define GRIM_PIXBUF_FORMAT PIXMAN_r8g8b8a8
+#endif
+
 /* --- Structure Definitions --- */
 
 struct grim_box {
@@ -44,14 +57,71 @@ struct grim_state {
 	struct ext_output_image_capture_source_manager_v1 *ext_output_image_capture_source_manager;
 	struct ext_image_copy_capture_manager_v1 *ext_image_copy_capture_manager;
 	struct zwlr_screencopy_manager_v1 *screencopy_manager;
+	struct ext_foreign_toplevel_list_v1 *foreign_toplevel_list;
+	struct ext_foreign_toplevel_image_capture_source_manager_v1 *ext_foreign_toplevel_image_capture_source_manager;
+
+	// Guards the globals, the outputs and the buffer pool. Captures in
+	// flight only take it briefly, their frames live on their own queue.
+	GMutex lock;
+	guint n_batches;
 
 	struct wl_list outputs;
+	struct wl_list toplevels;
+	struct wl_list buffers;
+	// Drops the idle buffers once captures stop for a while
+	guint trim_source;
+};
+
+/* Why a capture failed, recorded by the listeners instead of a global flag */
+enum grim_failure {
+	GRIM_FAILURE_NONE,
+	GRIM_FAILURE_NO_CONNECTION,
+	GRIM_FAILURE_UNSUPPORTED,
+	GRIM_FAILURE_NO_OUTPUT,
+	GRIM_FAILURE_NO_TOPLEVEL,
+	GRIM_FAILURE_NO_FORMAT,
+	GRIM_FAILURE_NO_BUFFER,
+	GRIM_FAILURE_COPY,
+	GRIM_FAILURE_STOPPED,
+	GRIM_FAILURE_RENDER,
+	GRIM_FAILURE_CANCELLED,
+};
+
+/* The captures of one request. Each batch dispatches its own event queue, so
+ * several of them can wait for the compositor at the same time. */
+struct grim_batch {
+	struct grim_state *state;
+	struct wl_event_queue *queue;
+	// Wrappers of the state's managers, creating objects on the queue
+	struct zwlr_screencopy_manager_v1 *screencopy_manager;
+	struct ext_output_image_capture_source_manager_v1 *ext_output_image_capture_source_manager;
+	struct ext_image_copy_capture_manager_v1 *ext_image_copy_capture_manager;
+	struct ext_foreign_toplevel_image_capture_source_manager_v1 *ext_foreign_toplevel_image_capture_source_manager;
 
 	struct wl_list captures;
 	size_t n_done;
+	enum grim_failure failure;
+	// When a continuous capture last reported damage, monotonic time
+	gint64 damage_time;
+};
+
+struct _MakasCaptureContext {
+	GObject parent_instance;
+
+	struct grim_state state;
+	gboolean connected;
+	guint render_threads;
 };
 
+/* A pooled shm buffer. The memfd, its wl_shm_pool and the mapping outlive a
+ * capture; only the wl_buffer is recreated when the layout changes. */
 struct grim_buffer {
+	struct wl_list link;
+	int fd;
+	struct wl_shm_pool *pool;
+	size_t pool_size;
+	gboolean busy;
+
 	struct wl_buffer *wl_buffer;
 	void *data;
 	int32_t width, height, stride;
@@ -64,6 +134,8 @@ struct grim_output {
 	struct wl_output *wl_output;
 	struct zxdg_output_v1 *xdg_output;
 	struct wl_list link;
+	uint32_t global_name;
+	gboolean geometry_ready;
 
 	int32_t fallback_x, fallback_y;
 	uint32_t mode_width, mode_height;
@@ -75,13 +147,29 @@ struct grim_output {
 	char *name;
 };
 
+struct grim_toplevel {
+	struct wl_list link;
+	struct ext_foreign_toplevel_handle_v1 *handle;
+	gboolean ready;
+
+	char *identifier;
+	char *app_id;
+	char *title;
+};
+
 struct grim_capture {
-	struct grim_state *state;
-	struct grim_output *output;
+	struct grim_batch *batch;
+	char *output_name;
+	uint32_t output_global_name;
 	struct wl_list link;
+	gboolean done;
+	enum grim_failure failure;
+	// Window captures are sized by their buffer, not by an output
+	gboolean toplevel;
 
 	enum wl_output_transform transform;
 	struct grim_box logical_geometry;
+	double logical_scale;
 
 	struct grim_buffer *buffer;
 
@@ -93,9 +181,19 @@ struct grim_capture {
 
 	struct zwlr_screencopy_frame_v1 *screencopy_frame;
 	uint32_t screencopy_frame_flags;
-};
 
-static __thread gboolean capture_failed = FALSE;
+	// Continuous captures keep their session open and alternate between two
+	// buffers, the compositor fills one while the other is rendered
+	gboolean continuous;
+	gboolean with_cursor;
+	struct grim_buffer *buffers[2];
+	int back_buffer;
+	// Buffer damage: of the frame in flight, not rendered yet, and not yet
+	// copied into each buffer
+	pixman_region32_t frame_damage;
+	pixman_region32_t damage;
+	pixman_region32_t stale[2];
+};
 
 /* --- Geometry Helper Functions --- */
 
@@ -109,12 +207,33 @@ static gboolean intersect_box(const struct grim_box *box_a, const struct grim_bo
 	return x1 < x2 && y1 < y2;
 }
 
-static void get_capture_layout_extents(struct grim_state *state, struct grim_box *box) {
+static gboolean get_box_intersection(const struct grim_box *box_a,
+		const struct grim_box *box_b, struct grim_box *dest) {
+	if (!intersect_box(box_a, box_b)) {
+		return FALSE;
+	}
+
+	int32_t x1 = box_a->x > box_b->x ? box_a->x : box_b->x;
+	int32_t y1 = box_a->y > box_b->y ? box_a->y : box_b->y;
+	int32_t x2 = box_a->x + box_a->width < box_b->x + box_b->width ?
+		box_a->x + box_a->width : box_b->x + box_b->width;
+	int32_t y2 = box_a->y + box_a->height < box_b->y + box_b->height ?
+		box_a->y + box_a->height : box_b->y + box_b->height;
+	*dest = (struct grim_box) {
+		.x = x1,
+		.y = y1,
+		.width = x2 - x1,
+		.height = y2 - y1
+	};
+	return TRUE;
+}
+
+static void get_capture_layout_extents(struct grim_batch *batch, struct grim_box *box) {
 	int32_t x1 = INT_MAX, y1 = INT_MAX;
 	int32_t x2 = INT_MIN, y2 = INT_MIN;
 
 	struct grim_capture *capture;
-	wl_list_for_each(capture, &state->captures, link) {
+	wl_list_for_each(capture, &batch->captures, link) {
 		if (capture->logical_geometry.x < x1) {
 			x1 = capture->logical_geometry.x;
 		}
@@ -173,6 +292,9 @@ static void guess_output_logical_geometry(struct grim_output *output) {
 
 /* --- Shared Memory Allocation Functions --- */
 
+/* Idle buffers are all freed once the pool went unused this long */
+#define GRIM_BUFFER_IDLE_TIMEOUT_S 10
+
 static void randname(char *buf) {
 	struct timespec ts;
 	clock_gettime(CLOCK_REALTIME, &ts);
@@ -202,7 +324,14 @@ static int anonymous_shm_open(void) {
 }
 
 static int create_shm_file(off_t size) {
-	int fd = anonymous_shm_open();
+	int fd = -1;
+#ifdef MFD_ALLOW_SEALING
+	fd = memfd_create("makas-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#endif
+	// Kernels without memfd still get the shm_open() fallback
+	if (fd < 0) {
+		fd = anonymous_shm_open();
+	}
 	if (fd < 0) {
 		return fd;
 	}
@@ -212,13 +341,44 @@ static int create_shm_file(off_t size) {
 		return -1;
 	}
 
+#ifdef F_SEAL_SHRINK
+	// The compositor must never see the file shrink under its mapping,
+	// growing is still allowed for wl_shm_pool_resize
+	fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL);
+#endif
+
 	return fd;
 }
 
-static struct grim_buffer *create_buffer(struct wl_shm *shm, enum wl_shm_format format,
-		int32_t width, int32_t height, int32_t stride) {
-	size_t size = stride * height;
+static gboolean grow_buffer_pool(struct grim_buffer *buffer, size_t size) {
+	if (ftruncate(buffer->fd, size) < 0) {
+		return FALSE;
+	}
+
+	void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, buffer->fd, 0);
+	if (data == MAP_FAILED) {
+		return FALSE;
+	}
+
+	munmap(buffer->data, buffer->pool_size);
+	buffer->data = data;
+	buffer->pool_size = size;
+	wl_shm_pool_resize(buffer->pool, size);
+	return TRUE;
+}
+
+static void free_buffer(struct grim_buffer *buffer) {
+	wl_list_remove(&buffer->link);
+	if (buffer->wl_buffer != NULL) {
+		wl_buffer_destroy(buffer->wl_buffer);
+	}
+	wl_shm_pool_destroy(buffer->pool);
+	munmap(buffer->data, buffer->pool_size);
+	close(buffer->fd);
+	free(buffer);
+}
 
+static struct grim_buffer *new_buffer(struct grim_state *state, size_t size) {
 	int fd = create_shm_file(size);
 	if (fd == -1) {
 		return NULL;
@@ -230,31 +390,114 @@ static struct grim_buffer *create_buffer(struct wl_shm *shm, enum wl_shm_format
 		return NULL;
 	}
 
-	struct wl_shm_pool *pool = wl_shm_create_pool(shm, fd, size);
-	struct wl_buffer *wl_buffer =
-		wl_shm_pool_create_buffer(pool, 0, width, height, stride, format);
-	wl_shm_pool_destroy(pool);
-
-	close(fd);
-
 	struct grim_buffer *buffer = calloc(1, sizeof(struct grim_buffer));
-	buffer->wl_buffer = wl_buffer;
+	buffer->fd = fd;
+	buffer->pool = wl_shm_create_pool(state->shm, fd, size);
+	buffer->pool_size = size;
 	buffer->data = data;
+	wl_list_insert(&state->buffers, &buffer->link);
+	return buffer;
+}
+
+/* Hands out an idle pooled buffer for the given layout, reusing the
+ * wl_buffer when it matches and resizing a spare pool otherwise. */
+static struct grim_buffer *acquire_buffer(struct grim_state *state, enum wl_shm_format format,
+		int32_t width, int32_t height, int32_t stride) {
+	size_t size = (size_t)stride * height;
+
+	struct grim_buffer *buffer = NULL, *candidate;
+	wl_list_for_each(candidate, &state->buffers, link) {
+		if (candidate->busy) {
+			continue;
+		}
+		if (candidate->wl_buffer != NULL && candidate->format == format &&
+				candidate->width == width && candidate->height == height &&
+				candidate->stride == stride) {
+			candidate->busy = TRUE;
+			return candidate;
+		}
+		// Prefer a pool that is already big enough, then the biggest one
+		if (buffer == NULL ||
+				(candidate->pool_size >= size && (buffer->pool_size < size ||
+					candidate->pool_size < buffer->pool_size)) ||
+				(buffer->pool_size < size && candidate->pool_size > buffer->pool_size)) {
+			buffer = candidate;
+		}
+	}
+
+	if (buffer != NULL && buffer->pool_size < size && !grow_buffer_pool(buffer, size)) {
+		buffer = NULL;
+	}
+	if (buffer == NULL) {
+		buffer = new_buffer(state, size);
+		if (buffer == NULL) {
+			return NULL;
+		}
+	}
+
+	if (buffer->wl_buffer != NULL) {
+		wl_buffer_destroy(buffer->wl_buffer);
+	}
+	buffer->wl_buffer =
+		wl_shm_pool_create_buffer(buffer->pool, 0, width, height, stride, format);
 	buffer->width = width;
 	buffer->height = height;
 	buffer->stride = stride;
 	buffer->size = size;
 	buffer->format = format;
+	buffer->busy = TRUE;
 	return buffer;
 }
 
-static void destroy_buffer(struct grim_buffer *buffer) {
+static gboolean trim_idle_buffers(gpointer data) {
+	struct grim_state *state = data;
+
+	g_mutex_lock(&state->lock);
+	// A capture released a buffer meanwhile and rearmed the timer
+	if (g_source_is_destroyed(g_main_current_source())) {
+		g_mutex_unlock(&state->lock);
+		return G_SOURCE_REMOVE;
+	}
+
+	struct grim_buffer *buffer, *tmp;
+	wl_list_for_each_safe(buffer, tmp, &state->buffers, link) {
+		if (!buffer->busy) {
+			free_buffer(buffer);
+		}
+	}
+	// The next capture, which would flush the destroy requests, may be far off
+	wl_display_flush(state->display);
+
+	state->trim_source = 0;
+	g_mutex_unlock(&state->lock);
+	return G_SOURCE_REMOVE;
+}
+
+/* Returns the buffer to the pool once the capture is done with it. One idle
+ * buffer per output is enough for the next capture, burst and multi-output
+ * captures don't get to keep their extra full-size buffers. */
+static void release_buffer(struct grim_state *state, struct grim_buffer *buffer) {
 	if (buffer == NULL) {
 		return;
 	}
-	munmap(buffer->data, buffer->size);
-	wl_buffer_destroy(buffer->wl_buffer);
-	free(buffer);
+	buffer->busy = FALSE;
+
+	int max_idle = MAX(wl_list_length(&state->outputs), 1);
+	int n_idle = 0;
+	struct grim_buffer *pooled, *tmp;
+	wl_list_for_each_safe(pooled, tmp, &state->buffers, link) {
+		if (!pooled->busy && ++n_idle > max_idle) {
+			free_buffer(pooled);
+		}
+	}
+
+	// The default context lives as long as the process, give the memory
+	// back once it sits idle
+	if (state->trim_source != 0) {
+		g_source_remove(state->trim_source);
+	}
+	state->trim_source = g_timeout_add_seconds(GRIM_BUFFER_IDLE_TIMEOUT_S,
+		trim_idle_buffers, state);
 }
 
 /* --- Pixman Rendering Logic --- */
@@ -388,123 +631,538 @@ static void compute_composite_region(const struct pixman_f_transform *out2com,
 	};
 }
 
-static pixman_image_t *grim_render(struct grim_state *state, struct grim_box *geometry,
-		double scale) {
+static void free_image_data(pixman_image_t *image, void *data) {
+	g_free(data);
+}
+
+static void free_pixbuf_data(guchar *pixels, gpointer data) {
+	g_free(pixels);
+}
+
+/* A capture prepared for compositing: everything but the destination image,
+ * so the same item can be composited into several tiles at once. */
+struct grim_render_item {
+	struct grim_buffer *buffer;
+	pixman_format_code_t format;
+	struct pixman_transform transform;
+	pixman_filter_t filter;
+	pixman_fixed_t *filter_params;
+	int n_filter_params;
+	pixman_op_t op;
+	struct grim_box dest;
+	// Maps buffer coordinates to the canvas, for damage tracking
+	struct pixman_f_transform out2com;
+};
+
+struct grim_render_job {
+	struct grim_render_item *items;
+	size_t n_items;
+	uint32_t *data;
+	int32_t width, height, stride;
+	// Only these canvas rectangles are rendered, NULL for the whole canvas
+	pixman_region32_t *clip;
+
+	GMutex lock;
+	GCond cond;
+	size_t n_pending;
+	gboolean failed;
+};
+
+struct grim_render_tile {
+	struct grim_render_job *job;
+	int32_t y, height;
+};
+
+#define GRIM_MIN_TILE_HEIGHT 64
+
+static gboolean prepare_render_item(struct grim_batch *batch, struct grim_capture *capture,
+		struct grim_box *geometry, double scale, gboolean check_overlap,
+		struct grim_render_item *item) {
+	struct grim_buffer *buffer = capture->buffer;
+
+	pixman_format_code_t pixman_fmt = get_pixman_format(buffer->format);
+	if (!pixman_fmt) {
+		g_warning("unsupported format %d = 0x%08x",
+			buffer->format, buffer->format);
+		return FALSE;
+	}
+
+	int32_t output_x = capture->logical_geometry.x - geometry->x;
+	int32_t output_y = capture->logical_geometry.y - geometry->y;
+	int32_t output_width = capture->logical_geometry.width;
+	int32_t output_height = capture->logical_geometry.height;
+
+	int32_t raw_output_width = buffer->width;
+	int32_t raw_output_height = buffer->height;
+	apply_output_transform(capture->transform, &raw_output_width, &raw_output_height);
+
+	int output_flipped_x = get_output_flipped(capture->transform);
+	int output_flipped_y = capture->screencopy_frame_flags &
+		ZWLR_SCREENCOPY_FRAME_V1_FLAGS_Y_INVERT ? -1 : 1;
+
+	struct pixman_f_transform out2com;
+	pixman_f_transform_init_identity(&out2com);
+	pixman_f_transform_translate(&out2com, NULL,
+		-(double)buffer->width / 2,
+		-(double)buffer->height / 2);
+	pixman_f_transform_scale(&out2com, NULL,
+		(double)output_width / raw_output_width,
+		(double)output_height * output_flipped_y / raw_output_height);
+	pixman_f_transform_rotate(&out2com, NULL,
+		round(cos(get_output_rotation(capture->transform))),
+		round(sin(get_output_rotation(capture->transform))));
+	pixman_f_transform_scale(&out2com, NULL, output_flipped_x, 1);
+	pixman_f_transform_translate(&out2com, NULL,
+		(double)output_width / 2,
+		(double)output_height / 2);
+	pixman_f_transform_translate(&out2com, NULL, output_x, output_y);
+	pixman_f_transform_scale(&out2com, NULL, scale, scale);
+
+	gboolean grid_aligned;
+	compute_composite_region(&out2com, buffer->width,
+		buffer->height, &item->dest, &grid_aligned);
+	item->out2com = out2com;
+
+	pixman_f_transform_translate(&out2com, NULL,
+		-item->dest.x, -item->dest.y);
+
+	struct pixman_f_transform com2out;
+	pixman_f_transform_invert(&com2out, &out2com);
+	pixman_transform_from_pixman_f_transform(&item->transform, &com2out);
+
+	double x_scale = fmax(fabs(out2com.m[0][0]), fabs(out2com.m[0][1]));
+	double y_scale = fmax(fabs(out2com.m[1][0]), fabs(out2com.m[1][1]));
+	if (x_scale >= 0.75 && y_scale >= 0.75) {
+		item->filter = PIXMAN_FILTER_BILINEAR;
+	} else {
+		item->filter = PIXMAN_FILTER_SEPARABLE_CONVOLUTION;
+		item->filter_params = pixman_filter_create_separable_convolution(
+			&item->n_filter_params,
+			pixman_double_to_fixed(fmax(1., 1. / x_scale)),
+			pixman_double_to_fixed(fmax(1., 1. / y_scale)),
+			PIXMAN_KERNEL_IMPULSE, PIXMAN_KERNEL_IMPULSE,
+			PIXMAN_KERNEL_LANCZOS2, PIXMAN_KERNEL_LANCZOS2,
+			2, 2);
+	}
+
+	gboolean overlapping = false;
+	struct grim_capture *other_capture;
+	wl_list_for_each(other_capture, &batch->captures, link) {
+		if (!check_overlap) {
+			break;
+		}
+		if (capture != other_capture && intersect_box(&capture->logical_geometry,
+				&other_capture->logical_geometry)) {
+			overlapping = true;
+		}
+	}
+
+	item->buffer = buffer;
+	item->format = pixman_fmt;
+	item->op = (grid_aligned && !overlapping) ? PIXMAN_OP_SRC : PIXMAN_OP_OVER;
+	return TRUE;
+}
+
+static void composite_item(struct grim_render_item *item, pixman_image_t *output_image,
+		pixman_image_t *tile_image, int32_t tile_y, const struct grim_box *clip) {
+	pixman_image_composite32(item->op, output_image, NULL, tile_image,
+		clip->x - item->dest.x, clip->y - item->dest.y, 0, 0,
+		clip->x, clip->y - tile_y, clip->width, clip->height);
+}
+
+/* Composites every item into rows [tile_y, tile_y + tile_height) of the
+ * canvas. Tiles only share read-only data, so they can run in parallel. */
+static gboolean render_tile(struct grim_render_job *job, int32_t tile_y,
+		int32_t tile_height) {
+	uint32_t *tile_data = (uint32_t *)((uint8_t *)job->data + (size_t)tile_y * job->stride);
+	pixman_image_t *tile_image = pixman_image_create_bits(GRIM_PIXBUF_FORMAT,
+		job->width, tile_height, tile_data, job->stride);
+	if (!tile_image) {
+		g_warning("Failed to create image");
+		return FALSE;
+	}
+
+	struct grim_box tile = {
+		.x = 0,
+		.y = tile_y,
+		.width = job->width,
+		.height = tile_height,
+	};
+
+	for (size_t i = 0; i < job->n_items; i++) {
+		struct grim_render_item *item = &job->items[i];
+		struct grim_box clip;
+		if (!get_box_intersection(&item->dest, &tile, &clip)) {
+			continue;
+		}
+
+		struct grim_buffer *buffer = item->buffer;
+		pixman_image_t *output_image = pixman_image_create_bits(
+			item->format, buffer->width, buffer->height,
+			buffer->data, buffer->stride);
+		if (!output_image) {
+			g_warning("Failed to create image");
+			pixman_image_unref(tile_image);
+			return FALSE;
+		}
+		pixman_image_set_transform(output_image, &item->transform);
+		pixman_image_set_filter(output_image, item->filter,
+			item->filter_params, item->n_filter_params);
+
+		if (job->clip == NULL) {
+			composite_item(item, output_image, tile_image, tile_y, &clip);
+		} else {
+			int n_rects;
+			pixman_box32_t *rects = pixman_region32_rectangles(job->clip, &n_rects);
+			for (int j = 0; j < n_rects; j++) {
+				struct grim_box rect = {
+					.x = rects[j].x1,
+					.y = rects[j].y1,
+					.width = rects[j].x2 - rects[j].x1,
+					.height = rects[j].y2 - rects[j].y1,
+				};
+				struct grim_box damaged;
+				if (get_box_intersection(&rect, &clip, &damaged)) {
+					composite_item(item, output_image, tile_image, tile_y, &damaged);
+				}
+			}
+		}
+
+		pixman_image_unref(output_image);
+	}
+
+	pixman_image_unref(tile_image);
+	return TRUE;
+}
+
+static void render_tile_func(gpointer data, gpointer user_data) {
+	struct grim_render_tile *tile = data;
+	struct grim_render_job *job = tile->job;
+
+	gboolean ok = render_tile(job, tile->y, tile->height);
+
+	g_mutex_lock(&job->lock);
+	if (!ok) {
+		job->failed = TRUE;
+	}
+	if (--job->n_pending == 0) {
+		g_cond_signal(&job->cond);
+	}
+	g_mutex_unlock(&job->lock);
+}
+
+static GThreadPool *get_render_pool(void) {
+	static GThreadPool *render_pool = NULL;
+
+	if (g_once_init_enter(&render_pool)) {
+		// Shared, unbounded pool: each render pushes at most n_threads - 1
+		// tiles, idle threads are reused by the next capture
+		g_once_init_leave(&render_pool,
+			g_thread_pool_new(render_tile_func, NULL, -1, FALSE, NULL));
+	}
+	return render_pool;
+}
+
+/* Splits the canvas in horizontal tiles, renders the first one on the calling
+ * thread and the rest on the worker pool. */
+static gboolean render_job(struct grim_render_job *job, int n_threads) {
+	int n_tiles = MIN(n_threads, job->height / GRIM_MIN_TILE_HEIGHT);
+	if (n_tiles <= 1) {
+		return render_tile(job, 0, job->height);
+	}
+
+	int32_t tile_height = (job->height + n_tiles - 1) / n_tiles;
+	struct grim_render_tile *tiles = g_new0(struct grim_render_tile, n_tiles);
+
+	g_mutex_init(&job->lock);
+	g_cond_init(&job->cond);
+	job->n_pending = 0;
+
+	GThreadPool *pool = get_render_pool();
+	for (int i = 1; i < n_tiles; i++) {
+		tiles[i].job = job;
+		tiles[i].y = i * tile_height;
+		tiles[i].height = MIN(tile_height, job->height - tiles[i].y);
+		if (tiles[i].height <= 0) {
+			break;
+		}
+
+		g_mutex_lock(&job->lock);
+		job->n_pending++;
+		g_mutex_unlock(&job->lock);
+		g_thread_pool_push(pool, &tiles[i], NULL);
+	}
+
+	gboolean ok = render_tile(job, 0, tile_height);
+
+	g_mutex_lock(&job->lock);
+	while (job->n_pending > 0) {
+		g_cond_wait(&job->cond, &job->lock);
+	}
+	ok = ok && !job->failed;
+	g_mutex_unlock(&job->lock);
+
+	g_cond_clear(&job->cond);
+	g_mutex_clear(&job->lock);
+	g_free(tiles);
+	return ok;
+}
+
+/* Returns the capture if it is the only one to render and its shm buffer
+ * already is the final canvas: same size, no rotation or flip, and a format
+ * the swizzle kernels handle. */
+static struct grim_capture *get_identity_capture(struct grim_batch *batch,
+		struct grim_box *geometry, int width, int height,
+		struct grim_capture *only_capture) {
+	struct grim_capture *capture = only_capture;
+	if (capture == NULL) {
+		if (wl_list_length(&batch->captures) != 1) {
+			return NULL;
+		}
+		capture = wl_container_of(batch->captures.next, capture, link);
+	}
+
+	struct grim_buffer *buffer = capture->buffer;
+	if (buffer == NULL) {
+		return NULL;
+	}
+	if (capture->transform != WL_OUTPUT_TRANSFORM_NORMAL ||
+			(capture->screencopy_frame_flags & ZWLR_SCREENCOPY_FRAME_V1_FLAGS_Y_INVERT)) {
+		return NULL;
+	}
+	if (buffer->format != WL_SHM_FORMAT_ARGB8888 &&
+			buffer->format != WL_SHM_FORMAT_XRGB8888) {
+		return NULL;
+	}
+	if (buffer->width != width || buffer->height != height ||
+			capture->logical_geometry.x != geometry->x ||
+			capture->logical_geometry.y != geometry->y) {
+		return NULL;
+	}
+	return capture;
+}
+
+/* Composites the captures into a canvas covering geometry. If only_capture is
+ * set, every other capture is ignored. The canvas is laid out like GdkPixbuf
+ * data so it can be handed over without a conversion pass. */
+static pixman_image_t *grim_render(struct grim_batch *batch, struct grim_box *geometry,
+		double scale, struct grim_capture *only_capture, int n_threads) {
 	int common_width = geometry->width * scale;
 	int common_height = geometry->height * scale;
-	pixman_image_t *common_image = pixman_image_create_bits(PIXMAN_a8r8g8b8,
-		common_width, common_height, NULL, 0);
+	int common_stride = common_width * 4;
+
+	// The identity case overwrites every pixel, no need to clear the canvas
+	struct grim_capture *identity_capture = get_identity_capture(batch, geometry,
+		common_width, common_height, only_capture);
+	uint32_t *common_data = identity_capture != NULL ?
+		g_try_malloc((gsize)common_stride * common_height) :
+		g_try_malloc0((gsize)common_stride * common_height);
+	if (common_data == NULL) {
+		g_warning("failed to allocate image with size: %d x %d",
+			common_width, common_height);
+		return NULL;
+	}
+
+	pixman_image_t *common_image = pixman_image_create_bits(GRIM_PIXBUF_FORMAT,
+		common_width, common_height, common_data, common_stride);
 	if (!common_image) {
 		g_warning("failed to create image with size: %d x %d",
 			common_width, common_height);
+		g_free(common_data);
 		return NULL;
 	}
+	pixman_image_set_destroy_function(common_image, free_image_data, common_data);
+
+	if (identity_capture != NULL) {
+		struct grim_buffer *buffer = identity_capture->buffer;
+		makas_pixel_xrgb_to_rgba(buffer->data, buffer->stride,
+			(guint8 *)common_data, common_stride, common_width, common_height,
+			buffer->format == WL_SHM_FORMAT_XRGB8888);
+		return common_image;
+	}
+
+	struct grim_render_job job = {
+		.items = g_new0(struct grim_render_item, wl_list_length(&batch->captures)),
+		.data = common_data,
+		.width = common_width,
+		.height = common_height,
+		.stride = common_stride,
+	};
 
+	gboolean ok = TRUE;
 	struct grim_capture *capture;
-	wl_list_for_each(capture, &state->captures, link) {
-		struct grim_buffer *buffer = capture->buffer;
-		if (buffer == NULL) {
+	wl_list_for_each(capture, &batch->captures, link) {
+		if (capture->buffer == NULL || (only_capture != NULL && capture != only_capture)) {
 			continue;
 		}
 
-		pixman_format_code_t pixman_fmt = get_pixman_format(buffer->format);
-		if (!pixman_fmt) {
-			g_warning("unsupported format %d = 0x%08x",
-				buffer->format, buffer->format);
-			pixman_image_unref(common_image);
-			return NULL;
+		if (!prepare_render_item(batch, capture, geometry, scale,
+				only_capture == NULL, &job.items[job.n_items])) {
+			ok = FALSE;
+			break;
 		}
+		job.n_items++;
+	}
+
+	if (ok) {
+		ok = render_job(&job, n_threads);
+	}
 
-		int32_t output_x = capture->logical_geometry.x - geometry->x;
-		int32_t output_y = capture->logical_geometry.y - geometry->y;
-		int32_t output_width = capture->logical_geometry.width;
-		int32_t output_height = capture->logical_geometry.height;
+	for (size_t i = 0; i < job.n_items; i++) {
+		free(job.items[i].filter_params);
+	}
+	g_free(job.items);
 
-		int32_t raw_output_width = buffer->width;
-		int32_t raw_output_height = buffer->height;
-		apply_output_transform(capture->transform, &raw_output_width, &raw_output_height);
+	if (!ok) {
+		pixman_image_unref(common_image);
+		return NULL;
+	}
+	return common_image;
+}
 
-		int output_flipped_x = get_output_flipped(capture->transform);
-		int output_flipped_y = capture->screencopy_frame_flags &
-			ZWLR_SCREENCOPY_FRAME_V1_FLAGS_Y_INVERT ? -1 : 1;
+/* Filters sample around each pixel, widen the damage to cover them */
+#define GRIM_DAMAGE_MARGIN 2
+
+/* Maps a damaged box of an output buffer to the canvas. Works on 32-bit
+ * boxes, pixman_f_transform_bounds() would wrap past 32767 on large canvases.
+ * Returns FALSE if a corner can't be transformed. */
+static bool transform_damage_box(const struct pixman_f_transform *transform,
+		const pixman_box32_t *box, pixman_box32_t *dest) {
+	struct pixman_f_vector corners[4] = {
+		{{box->x1, box->y1, 1}},
+		{{box->x2, box->y1, 1}},
+		{{box->x1, box->y2, 1}},
+		{{box->x2, box->y2, 1}},
+	};
 
-		pixman_image_t *output_image = pixman_image_create_bits(
-			pixman_fmt, buffer->width, buffer->height,
-			buffer->data, buffer->stride);
-		if (!output_image) {
-			g_warning("Failed to create image");
-			pixman_image_unref(common_image);
-			return NULL;
+	double x_min = INFINITY, x_max = -INFINITY,
+		y_min = INFINITY, y_max = -INFINITY;
+	for (int i = 0; i < 4; i++) {
+		if (!pixman_f_transform_point(transform, &corners[i])) {
+			return false;
 		}
+		x_min = fmin(x_min, corners[i].v[0]);
+		x_max = fmax(x_max, corners[i].v[0]);
+		y_min = fmin(y_min, corners[i].v[1]);
+		y_max = fmax(y_max, corners[i].v[1]);
+	}
 
-		struct pixman_f_transform out2com;
-		pixman_f_transform_init_identity(&out2com);
-		pixman_f_transform_translate(&out2com, NULL,
-			-(double)buffer->width / 2,
-			-(double)buffer->height / 2);
-		pixman_f_transform_scale(&out2com, NULL,
-			(double)output_width / raw_output_width,
-			(double)output_height * output_flipped_y / raw_output_height);
-		pixman_f_transform_rotate(&out2com, NULL,
-			round(cos(get_output_rotation(capture->transform))),
-			round(sin(get_output_rotation(capture->transform))));
-		pixman_f_transform_scale(&out2com, NULL, output_flipped_x, 1);
-		pixman_f_transform_translate(&out2com, NULL,
-			(double)output_width / 2,
-			(double)output_height / 2);
-		pixman_f_transform_translate(&out2com, NULL, output_x, output_y);
-		pixman_f_transform_scale(&out2com, NULL, scale, scale);
-
-		struct grim_box composite_dest;
-		gboolean grid_aligned;
-		compute_composite_region(&out2com, buffer->width,
-			buffer->height, &composite_dest, &grid_aligned);
-
-		pixman_f_transform_translate(&out2com, NULL,
-			-composite_dest.x, -composite_dest.y);
-
-		struct pixman_f_transform com2out;
-		pixman_f_transform_invert(&com2out, &out2com);
-		struct pixman_transform c2o_fixedpt;
-		pixman_transform_from_pixman_f_transform(&c2o_fixedpt, &com2out);
-		pixman_image_set_transform(output_image, &c2o_fixedpt);
-
-		double x_scale = fmax(fabs(out2com.m[0][0]), fabs(out2com.m[0][1]));
-		double y_scale = fmax(fabs(out2com.m[1][0]), fabs(out2com.m[1][1]));
-		if (x_scale >= 0.75 && y_scale >= 0.75) {
-			pixman_image_set_filter(output_image,
-				PIXMAN_FILTER_BILINEAR, NULL, 0);
-		} else {
-			int n_values = 0;
-			pixman_fixed_t *conv = pixman_filter_create_separable_convolution(
-				&n_values,
-				pixman_double_to_fixed(fmax(1., 1. / x_scale)),
-				pixman_double_to_fixed(fmax(1., 1. / y_scale)),
-				PIXMAN_KERNEL_IMPULSE, PIXMAN_KERNEL_IMPULSE,
-				PIXMAN_KERNEL_LANCZOS2, PIXMAN_KERNEL_LANCZOS2,
-				2, 2);
-			pixman_image_set_filter(output_image,
-				PIXMAN_FILTER_SEPARABLE_CONVOLUTION, conv, n_values);
-			free(conv);
-		}
-
-		gboolean overlapping = false;
-		struct grim_capture *other_capture;
-		wl_list_for_each(other_capture, &state->captures, link) {
-			if (capture != other_capture && intersect_box(&capture->logical_geometry,
-					&other_capture->logical_geometry)) {
-				overlapping = true;
+	// Only the part on the canvas matters, keep the margin in range too
+	*dest = (pixman_box32_t) {
+		.x1 = CLAMP(floor(x_min), -GRIM_DAMAGE_MARGIN, INT32_MAX / 2),
+		.y1 = CLAMP(floor(y_min), -GRIM_DAMAGE_MARGIN, INT32_MAX / 2),
+		.x2 = CLAMP(ceil(x_max), -GRIM_DAMAGE_MARGIN, INT32_MAX / 2),
+		.y2 = CLAMP(ceil(y_max), -GRIM_DAMAGE_MARGIN, INT32_MAX / 2),
+	};
+	return true;
+}
+
+/* Re-renders the parts of a canvas made by grim_render() for the same
+ * geometry and scale that the captures reported as damaged since the last
+ * call. Sets damaged to FALSE if nothing changed. */
+static gboolean grim_render_damage(struct grim_batch *batch, pixman_image_t *canvas,
+		struct grim_box *geometry, double scale, int n_threads, gboolean *damaged) {
+	uint32_t *common_data = pixman_image_get_data(canvas);
+	int common_width = pixman_image_get_width(canvas);
+	int common_height = pixman_image_get_height(canvas);
+	int common_stride = pixman_image_get_stride(canvas);
+
+	pixman_region32_t canvas_damage;
+	pixman_region32_init(&canvas_damage);
+
+	// Buffer and canvas coordinates are the same, swizzle the damage only
+	struct grim_capture *identity_capture = get_identity_capture(batch, geometry,
+		common_width, common_height, NULL);
+	if (identity_capture != NULL) {
+		struct grim_buffer *buffer = identity_capture->buffer;
+		pixman_region32_intersect_rect(&canvas_damage, &identity_capture->damage,
+			0, 0, common_width, common_height);
+		pixman_region32_clear(&identity_capture->damage);
+
+		int n_rects;
+		pixman_box32_t *rects = pixman_region32_rectangles(&canvas_damage, &n_rects);
+		for (int i = 0; i < n_rects; i++) {
+			makas_pixel_xrgb_to_rgba(
+				(guint8 *)buffer->data + (size_t)rects[i].y1 * buffer->stride + rects[i].x1 * 4,
+				buffer->stride,
+				(guint8 *)common_data + (size_t)rects[i].y1 * common_stride + rects[i].x1 * 4,
+				common_stride, rects[i].x2 - rects[i].x1, rects[i].y2 - rects[i].y1,
+				buffer->format == WL_SHM_FORMAT_XRGB8888);
+		}
+
+		*damaged = pixman_region32_not_empty(&canvas_damage);
+		pixman_region32_fini(&canvas_damage);
+		return TRUE;
+	}
+
+	struct grim_render_job job = {
+		.items = g_new0(struct grim_render_item, wl_list_length(&batch->captures)),
+		.data = common_data,
+		.width = common_width,
+		.height = common_height,
+		.stride = common_stride,
+		.clip = &canvas_damage,
+	};
+
+	gboolean ok = TRUE;
+	gboolean blended = FALSE;
+	struct grim_capture *capture;
+	wl_list_for_each(capture, &batch->captures, link) {
+		if (capture->buffer == NULL) {
+			continue;
+		}
+
+		struct grim_render_item *item = &job.items[job.n_items];
+		if (!prepare_render_item(batch, capture, geometry, scale, TRUE, item)) {
+			ok = FALSE;
+			break;
+		}
+		job.n_items++;
+		if (item->op == PIXMAN_OP_OVER) {
+			blended = TRUE;
+		}
+
+		int n_rects;
+		pixman_box32_t *rects = pixman_region32_rectangles(&capture->damage, &n_rects);
+		for (int i = 0; i < n_rects; i++) {
+			pixman_box32_t box = {
+				.x1 = CLAMP(rects[i].x1, 0, capture->buffer->width),
+				.y1 = CLAMP(rects[i].y1, 0, capture->buffer->height),
+				.x2 = CLAMP(rects[i].x2, 0, capture->buffer->width),
+				.y2 = CLAMP(rects[i].y2, 0, capture->buffer->height),
+			};
+			if (!transform_damage_box(&item->out2com, &box, &box)) {
+				continue;
 			}
+			pixman_region32_union_rect(&canvas_damage, &canvas_damage,
+				box.x1 - GRIM_DAMAGE_MARGIN, box.y1 - GRIM_DAMAGE_MARGIN,
+				box.x2 - box.x1 + 2 * GRIM_DAMAGE_MARGIN,
+				box.y2 - box.y1 + 2 * GRIM_DAMAGE_MARGIN);
 		}
-		pixman_op_t op = (grid_aligned && !overlapping) ? PIXMAN_OP_SRC : PIXMAN_OP_OVER;
-		pixman_image_composite32(op, output_image, NULL, common_image,
-			0, 0, 0, 0, composite_dest.x, composite_dest.y,
-			composite_dest.width, composite_dest.height);
+		pixman_region32_clear(&capture->damage);
+	}
 
-		pixman_image_unref(output_image);
+	pixman_region32_intersect_rect(&canvas_damage, &canvas_damage,
+		0, 0, common_width, common_height);
+	*damaged = ok && pixman_region32_not_empty(&canvas_damage);
+
+	if (*damaged) {
+		// Overlapping outputs are blended, start again from a clear canvas
+		if (blended) {
+			int n_rects;
+			pixman_box32_t *rects = pixman_region32_rectangles(&canvas_damage, &n_rects);
+			pixman_color_t transparent = {0};
+			pixman_image_fill_boxes(PIXMAN_OP_CLEAR, canvas, &transparent, n_rects, rects);
+		}
+		ok = render_job(&job, n_threads);
 	}
 
-	return common_image;
+	for (size_t i = 0; i < job.n_items; i++) {
+		free(job.items[i].filter_params);
+	}
+	g_free(job.items);
+	pixman_region32_fini(&canvas_damage);
+	return ok;
 }
 
 /* --- Output Listener Callback Implementations --- */
@@ -531,7 +1189,13 @@ static void output_handle_mode(void *data, struct wl_output *wl_output,
 }
 
 static void output_handle_done(void *data, struct wl_output *wl_output) {
-	// No-op
+	struct grim_output *output = data;
+
+	// Without xdg-output the wl_output events are all we get
+	if (output->xdg_output == NULL) {
+		guess_output_logical_geometry(output);
+		output->geometry_ready = TRUE;
+	}
 }
 
 static void output_handle_scale(void *data, struct wl_output *wl_output,
@@ -584,6 +1248,7 @@ static void xdg_output_handle_done(void *data,
 	int32_t height = output->mode_height;
 	apply_output_transform(output->transform, &width, &height);
 	output->logical_scale = (double)width / output->logical_geometry.width;
+	output->geometry_ready = TRUE;
 }
 
 static void xdg_output_handle_name(void *data,
@@ -610,40 +1275,152 @@ static const struct zxdg_output_v1_listener xdg_output_listener = {
 
 /* --- Screencopy Frame Listener Callback Implementations --- */
 
-static void screencopy_frame_handle_buffer(void *data,
-		struct zwlr_screencopy_frame_v1 *frame, uint32_t format, uint32_t width,
-		uint32_t height, uint32_t stride) {
-	struct grim_capture *capture = data;
-
-	capture->buffer =
-		create_buffer(capture->state->shm, format, width, height, stride);
-	if (capture->buffer == NULL) {
-		g_warning("failed to create buffer");
-		capture_failed = TRUE;
-		return;
+static const char *get_capture_output_name(struct grim_capture *capture) {
+	if (capture->output_name == NULL) {
+		return "unknown";
 	}
-
-	zwlr_screencopy_frame_v1_copy(frame, capture->buffer->wl_buffer);
+	return capture->output_name;
 }
 
-static void screencopy_frame_handle_flags(void *data,
-		struct zwlr_screencopy_frame_v1 *frame, uint32_t flags) {
-	struct grim_capture *capture = data;
-	capture->screencopy_frame_flags = flags;
+/* Marks the capture and its batch as failed, keeping the first reason. */
+static void fail_capture(struct grim_capture *capture, enum grim_failure failure) {
+	capture->failure = failure;
+	if (capture->batch->failure == GRIM_FAILURE_NONE) {
+		capture->batch->failure = failure;
+	}
 }
 
-static void screencopy_frame_handle_ready(void *data,
-		struct zwlr_screencopy_frame_v1 *frame, uint32_t tv_sec_hi,
-		uint32_t tv_sec_lo, uint32_t tv_nsec) {
-	struct grim_capture *capture = data;
-	++capture->state->n_done;
+static void finish_capture(struct grim_capture *capture) {
+	capture->done = TRUE;
+	++capture->batch->n_done;
 }
 
-static void screencopy_frame_handle_failed(void *data,
-		struct zwlr_screencopy_frame_v1 *frame) {
+/* Makes the frame just copied the one to render. The next frame goes into
+ * the other buffer, which missed this frame's damage. */
+static void swap_continuous_buffers(struct grim_capture *capture) {
+	int front = capture->back_buffer;
+	capture->buffer = capture->buffers[front];
+	capture->back_buffer = !front;
+
+	// The first frame is fully damaged, even if screencopy doesn't say so
+	if (!capture->done || pixman_region32_not_empty(&capture->frame_damage)) {
+		capture->batch->damage_time = g_get_monotonic_time();
+	}
+
+	pixman_region32_union(&capture->damage, &capture->damage, &capture->frame_damage);
+	// Screencopy always copies whole frames, only ext-image-copy repairs
+	if (capture->ext_image_copy_capture_session != NULL) {
+		pixman_region32_clear(&capture->stale[front]);
+		pixman_region32_union(&capture->stale[!front], &capture->stale[!front],
+			&capture->frame_damage);
+	}
+	pixman_region32_clear(&capture->frame_damage);
+
+	if (!capture->done) {
+		finish_capture(capture);
+	}
+}
+
+/* Takes a buffer from the pool shared by every batch of the state. */
+static struct grim_buffer *acquire_capture_buffer(struct grim_capture *capture,
+		enum wl_shm_format format, int32_t width, int32_t height, int32_t stride) {
+	struct grim_state *state = capture->batch->state;
+
+	g_mutex_lock(&state->lock);
+	struct grim_buffer *buffer = acquire_buffer(state, format, width, height, stride);
+	g_mutex_unlock(&state->lock);
+
+	return buffer;
+}
+
+/* Continuous screencopy frames alternate between two buffers of the first
+ * frame's size. Once a frame is in, the next ones wait for damage. */
+static void copy_continuous_screencopy_frame(struct grim_capture *capture,
+		struct zwlr_screencopy_frame_v1 *frame, uint32_t format, uint32_t width,
+		uint32_t height, uint32_t stride) {
+	if (capture->buffers[0] == NULL) {
+		for (int i = 0; i < 2; i++) {
+			capture->buffers[i] = acquire_capture_buffer(capture, format, width, height, stride);
+			if (capture->buffers[i] == NULL) {
+				g_warning("failed to create buffer");
+				fail_capture(capture, GRIM_FAILURE_NO_BUFFER);
+				return;
+			}
+		}
+	}
+
+	struct grim_buffer *buffer = capture->buffers[capture->back_buffer];
+	if (buffer->format != format || buffer->width != (int32_t)width ||
+			buffer->height != (int32_t)height || buffer->stride != (int32_t)stride) {
+		g_warning("buffer constraints of output %s changed", get_capture_output_name(capture));
+		fail_capture(capture, GRIM_FAILURE_STOPPED);
+		return;
+	}
+
+	if (capture->done) {
+		zwlr_screencopy_frame_v1_copy_with_damage(frame, buffer->wl_buffer);
+	} else {
+		zwlr_screencopy_frame_v1_copy(frame, buffer->wl_buffer);
+	}
+}
+
+static void screencopy_frame_handle_buffer(void *data,
+		struct zwlr_screencopy_frame_v1 *frame, uint32_t format, uint32_t width,
+		uint32_t height, uint32_t stride) {
+	struct grim_capture *capture = data;
+
+	if (capture->continuous) {
+		copy_continuous_screencopy_frame(capture, frame, format, width, height, stride);
+		return;
+	}
+
+	capture->buffer = acquire_capture_buffer(capture, format, width, height, stride);
+	if (capture->buffer == NULL) {
+		g_warning("failed to create buffer");
+		fail_capture(capture, GRIM_FAILURE_NO_BUFFER);
+		return;
+	}
+
+	zwlr_screencopy_frame_v1_copy(frame, capture->buffer->wl_buffer);
+}
+
+static void screencopy_frame_handle_flags(void *data,
+		struct zwlr_screencopy_frame_v1 *frame, uint32_t flags) {
+	struct grim_capture *capture = data;
+	capture->screencopy_frame_flags = flags;
+}
+
+static void request_continuous_screencopy_frame(struct grim_capture *capture);
+
+static void screencopy_frame_handle_ready(void *data,
+		struct zwlr_screencopy_frame_v1 *frame, uint32_t tv_sec_hi,
+		uint32_t tv_sec_lo, uint32_t tv_nsec) {
+	struct grim_capture *capture = data;
+	if (capture->continuous) {
+		swap_continuous_buffers(capture);
+		zwlr_screencopy_frame_v1_destroy(capture->screencopy_frame);
+		capture->screencopy_frame = NULL;
+		request_continuous_screencopy_frame(capture);
+		return;
+	}
+	finish_capture(capture);
+}
+
+static void screencopy_frame_handle_failed(void *data,
+		struct zwlr_screencopy_frame_v1 *frame) {
+	struct grim_capture *capture = data;
+	g_warning("failed to copy output %s", get_capture_output_name(capture));
+	fail_capture(capture, GRIM_FAILURE_COPY);
+}
+
+static void screencopy_frame_handle_damage(void *data,
+		struct zwlr_screencopy_frame_v1 *frame, uint32_t x, uint32_t y,
+		uint32_t width, uint32_t height) {
 	struct grim_capture *capture = data;
-	g_warning("failed to copy output %s", capture->output->name ? capture->output->name : "unknown");
-	capture_failed = TRUE;
+	if (capture->continuous) {
+		pixman_region32_union_rect(&capture->frame_damage, &capture->frame_damage,
+			x, y, width, height);
+	}
 }
 
 static const struct zwlr_screencopy_frame_v1_listener screencopy_frame_listener = {
@@ -651,8 +1428,40 @@ static const struct zwlr_screencopy_frame_v1_listener screencopy_frame_listener
 	.flags = screencopy_frame_handle_flags,
 	.ready = screencopy_frame_handle_ready,
 	.failed = screencopy_frame_handle_failed,
+	.damage = screencopy_frame_handle_damage,
 };
 
+static struct grim_output *find_output(struct grim_state *state, uint32_t global_name) {
+	struct grim_output *output;
+	wl_list_for_each(output, &state->outputs, link) {
+		if (output->global_name == global_name) {
+			return output;
+		}
+	}
+	return NULL;
+}
+
+/* Screencopy frames are single use, ask for the next one on the same output.
+ * The output may have gone away meanwhile, so look it up under the lock. */
+static void request_continuous_screencopy_frame(struct grim_capture *capture) {
+	struct grim_batch *batch = capture->batch;
+
+	g_mutex_lock(&batch->state->lock);
+	struct grim_output *output = find_output(batch->state, capture->output_global_name);
+	if (output != NULL) {
+		capture->screencopy_frame = zwlr_screencopy_manager_v1_capture_output(
+			batch->screencopy_manager, capture->with_cursor, output->wl_output);
+		zwlr_screencopy_frame_v1_add_listener(capture->screencopy_frame,
+			&screencopy_frame_listener, capture);
+	}
+	g_mutex_unlock(&batch->state->lock);
+
+	if (output == NULL) {
+		g_warning("output %s went away", get_capture_output_name(capture));
+		fail_capture(capture, GRIM_FAILURE_STOPPED);
+	}
+}
+
 /* --- Ext Image Copy Frame/Session Listener Callback Implementations --- */
 
 static void ext_image_copy_capture_frame_handle_transform(void *data,
@@ -663,8 +1472,12 @@ static void ext_image_copy_capture_frame_handle_transform(void *data,
 
 static void ext_image_copy_capture_frame_handle_damage(void *data,
 		struct ext_image_copy_capture_frame_v1 *frame, int32_t x, int32_t y,
-		int32_t wdth, int32_t height) {
-	// No-op
+		int32_t width, int32_t height) {
+	struct grim_capture *capture = data;
+	if (capture->continuous) {
+		pixman_region32_union_rect(&capture->frame_damage, &capture->frame_damage,
+			x, y, width, height);
+	}
 }
 
 static void ext_image_copy_capture_frame_handle_presentation_time(void *data,
@@ -673,17 +1486,34 @@ static void ext_image_copy_capture_frame_handle_presentation_time(void *data,
 	// No-op
 }
 
+static void request_continuous_frame(struct grim_capture *capture);
+
+/* Makes the frame just copied the one to render, and queues the next one
+ * into the other buffer. */
+static void present_continuous_frame(struct grim_capture *capture) {
+	swap_continuous_buffers(capture);
+
+	ext_image_copy_capture_frame_v1_destroy(capture->ext_image_copy_capture_frame);
+	capture->ext_image_copy_capture_frame = NULL;
+	request_continuous_frame(capture);
+}
+
 static void ext_image_copy_capture_frame_handle_ready(void *data,
 		struct ext_image_copy_capture_frame_v1 *frame) {
 	struct grim_capture *capture = data;
-	++capture->state->n_done;
+	if (capture->continuous) {
+		present_continuous_frame(capture);
+		return;
+	}
+	finish_capture(capture);
 }
 
 static void ext_image_copy_capture_frame_handle_failed(void *data,
 		struct ext_image_copy_capture_frame_v1 *frame, uint32_t reason) {
 	struct grim_capture *capture = data;
-	g_warning("failed to copy output %s, reason: %u", capture->output->name ? capture->output->name : "unknown", reason);
-	capture_failed = TRUE;
+	g_warning("failed to copy output %s, reason: %u", get_capture_output_name(capture), reason);
+	fail_capture(capture, reason == EXT_IMAGE_COPY_CAPTURE_FRAME_V1_FAILURE_REASON_STOPPED ?
+		GRIM_FAILURE_STOPPED : GRIM_FAILURE_COPY);
 }
 
 static const struct ext_image_copy_capture_frame_v1_listener ext_image_copy_capture_frame_listener = {
@@ -694,11 +1524,57 @@ static const struct ext_image_copy_capture_frame_v1_listener ext_image_copy_capt
 	.failed = ext_image_copy_capture_frame_handle_failed,
 };
 
+/* Asks for the next frame into the back buffer. Besides the new damage, the
+ * compositor also repairs what the buffer missed while the other one was
+ * filled. */
+static void request_continuous_frame(struct grim_capture *capture) {
+	int back = capture->back_buffer;
+	capture->ext_image_copy_capture_frame = ext_image_copy_capture_session_v1_create_frame(
+		capture->ext_image_copy_capture_session);
+	ext_image_copy_capture_frame_v1_add_listener(capture->ext_image_copy_capture_frame,
+		&ext_image_copy_capture_frame_listener, capture);
+	ext_image_copy_capture_frame_v1_attach_buffer(capture->ext_image_copy_capture_frame,
+		capture->buffers[back]->wl_buffer);
+
+	int n_rects;
+	pixman_box32_t *rects = pixman_region32_rectangles(&capture->stale[back], &n_rects);
+	for (int i = 0; i < n_rects; i++) {
+		ext_image_copy_capture_frame_v1_damage_buffer(capture->ext_image_copy_capture_frame,
+			rects[i].x1, rects[i].y1, rects[i].x2 - rects[i].x1, rects[i].y2 - rects[i].y1);
+	}
+	ext_image_copy_capture_frame_v1_capture(capture->ext_image_copy_capture_frame);
+}
+
+/* Allocates both buffers of a continuous capture and starts the first frame.
+ * Neither buffer holds anything yet, so both are fully stale. */
+static void start_continuous_frames(struct grim_capture *capture, int32_t stride) {
+	for (int i = 0; i < 2; i++) {
+		capture->buffers[i] = acquire_capture_buffer(capture, capture->shm_format,
+			capture->buffer_width, capture->buffer_height, stride);
+		if (capture->buffers[i] == NULL) {
+			g_warning("failed to create buffer");
+			fail_capture(capture, GRIM_FAILURE_NO_BUFFER);
+			return;
+		}
+		pixman_region32_union_rect(&capture->stale[i], &capture->stale[i],
+			0, 0, capture->buffer_width, capture->buffer_height);
+	}
+
+	request_continuous_frame(capture);
+}
+
 static void ext_image_copy_capture_session_handle_buffer_size(void *data,
 		struct ext_image_copy_capture_session_v1 *session, uint32_t width, uint32_t height) {
 	struct grim_capture *capture = data;
 	capture->buffer_width = width;
 	capture->buffer_height = height;
+
+	if (capture->toplevel) {
+		capture->logical_geometry = (struct grim_box) {
+			.width = width,
+			.height = height,
+		};
+	}
 }
 
 static void ext_image_copy_capture_session_handle_shm_format(void *data,
@@ -725,22 +1601,39 @@ static void ext_image_copy_capture_session_handle_done(void *data,
 		struct ext_image_copy_capture_session_v1 *session) {
 	struct grim_capture *capture = data;
 
+	// The buffers of a running session can't follow a resize
+	if (capture->continuous && capture->buffers[0] != NULL) {
+		struct grim_buffer *buffer = capture->buffers[0];
+		if (!capture->has_shm_format || capture->shm_format != buffer->format ||
+				capture->buffer_width != (uint32_t)buffer->width ||
+				capture->buffer_height != (uint32_t)buffer->height) {
+			g_warning("buffer constraints of output %s changed", get_capture_output_name(capture));
+			fail_capture(capture, GRIM_FAILURE_STOPPED);
+		}
+		return;
+	}
+
 	if (capture->ext_image_copy_capture_frame != NULL) {
 		return;
 	}
 
 	if (!capture->has_shm_format) {
 		g_warning("no supported format found");
-		capture_failed = TRUE;
+		fail_capture(capture, GRIM_FAILURE_NO_FORMAT);
 		return;
 	}
 
 	int32_t stride = get_format_min_stride(capture->shm_format, capture->buffer_width);
-	capture->buffer =
-		create_buffer(capture->state->shm, capture->shm_format, capture->buffer_width, capture->buffer_height, stride);
+	if (capture->continuous) {
+		start_continuous_frames(capture, stride);
+		return;
+	}
+
+	capture->buffer = acquire_capture_buffer(capture, capture->shm_format,
+		capture->buffer_width, capture->buffer_height, stride);
 	if (capture->buffer == NULL) {
 		g_warning("failed to create buffer");
-		capture_failed = TRUE;
+		fail_capture(capture, GRIM_FAILURE_NO_BUFFER);
 		return;
 	}
 
@@ -756,7 +1649,13 @@ static void ext_image_copy_capture_session_handle_done(void *data,
 
 static void ext_image_copy_capture_session_handle_stopped(void *data,
 		struct ext_image_copy_capture_session_v1 *session) {
-	// No-op
+	struct grim_capture *capture = data;
+
+	// The output went away before its frame was ready, or during a burst
+	if (!capture->done || capture->continuous) {
+		g_warning("capture session of output %s stopped", get_capture_output_name(capture));
+		fail_capture(capture, GRIM_FAILURE_STOPPED);
+	}
 }
 
 static const struct ext_image_copy_capture_session_v1_listener ext_image_copy_capture_session_listener = {
@@ -768,39 +1667,105 @@ static const struct ext_image_copy_capture_session_v1_listener ext_image_copy_ca
 	.stopped = ext_image_copy_capture_session_handle_stopped,
 };
 
-/* --- Global Registry Handlers --- */
+/* --- Foreign Toplevel Listener Callback Implementations --- */
 
-static void screencopy_handle_global(void *data, struct wl_registry *registry,
-		uint32_t name, const char *interface, uint32_t version) {
+static void destroy_toplevel(struct grim_toplevel *toplevel) {
+	wl_list_remove(&toplevel->link);
+	ext_foreign_toplevel_handle_v1_destroy(toplevel->handle);
+	free(toplevel->identifier);
+	free(toplevel->app_id);
+	free(toplevel->title);
+	free(toplevel);
+}
+
+static void foreign_toplevel_handle_closed(void *data,
+		struct ext_foreign_toplevel_handle_v1 *handle) {
+	struct grim_toplevel *toplevel = data;
+	destroy_toplevel(toplevel);
+}
+
+static void foreign_toplevel_handle_done(void *data,
+		struct ext_foreign_toplevel_handle_v1 *handle) {
+	struct grim_toplevel *toplevel = data;
+	toplevel->ready = TRUE;
+}
+
+static void foreign_toplevel_handle_title(void *data,
+		struct ext_foreign_toplevel_handle_v1 *handle, const char *title) {
+	struct grim_toplevel *toplevel = data;
+	free(toplevel->title);
+	toplevel->title = strdup(title);
+}
+
+static void foreign_toplevel_handle_app_id(void *data,
+		struct ext_foreign_toplevel_handle_v1 *handle, const char *app_id) {
+	struct grim_toplevel *toplevel = data;
+	free(toplevel->app_id);
+	toplevel->app_id = strdup(app_id);
+}
+
+static void foreign_toplevel_handle_identifier(void *data,
+		struct ext_foreign_toplevel_handle_v1 *handle, const char *identifier) {
+	struct grim_toplevel *toplevel = data;
+	free(toplevel->identifier);
+	toplevel->identifier = strdup(identifier);
+}
+
+static const struct ext_foreign_toplevel_handle_v1_listener foreign_toplevel_listener = {
+	.closed = foreign_toplevel_handle_closed,
+	.done = foreign_toplevel_handle_done,
+	.title = foreign_toplevel_handle_title,
+	.app_id = foreign_toplevel_handle_app_id,
+	.identifier = foreign_toplevel_handle_identifier,
+};
+
+static void foreign_toplevel_list_handle_toplevel(void *data,
+		struct ext_foreign_toplevel_list_v1 *list,
+		struct ext_foreign_toplevel_handle_v1 *handle) {
 	struct grim_state *state = data;
 
-	if (strcmp(interface, wl_shm_interface.name) == 0) {
-		state->shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
-	} else if (strcmp(interface, zxdg_output_manager_v1_interface.name) == 0) {
-		uint32_t bind_version = (version > 2) ? 2 : version;
-		state->xdg_output_manager = wl_registry_bind(registry, name,
-			&zxdg_output_manager_v1_interface, bind_version);
-	} else if (strcmp(interface, wl_output_interface.name) == 0) {
-		uint32_t bind_version = (version >= 4) ? 4 : 3;
-		struct grim_output *output = calloc(1, sizeof(struct grim_output));
-		output->state = state;
-		output->scale = 1;
-		output->wl_output =  wl_registry_bind(registry, name,
-			&wl_output_interface, bind_version);
-		wl_output_add_listener(output->wl_output, &output_listener, output);
-		wl_list_insert(&state->outputs, &output->link);
-	} else if (strcmp(interface, zwlr_screencopy_manager_v1_interface.name) == 0) {
-		state->screencopy_manager = wl_registry_bind(registry, name,
-			&zwlr_screencopy_manager_v1_interface, 1);
-	}
+	struct grim_toplevel *toplevel = calloc(1, sizeof(struct grim_toplevel));
+	toplevel->handle = handle;
+	ext_foreign_toplevel_handle_v1_add_listener(handle,
+		&foreign_toplevel_listener, toplevel);
+	wl_list_insert(state->toplevels.prev, &toplevel->link);
 }
 
-static const struct wl_registry_listener screencopy_registry_listener = {
-	.global = screencopy_handle_global,
-	.global_remove = NULL,
+static void foreign_toplevel_list_handle_finished(void *data,
+		struct ext_foreign_toplevel_list_v1 *list) {
+	// No-op
+}
+
+static const struct ext_foreign_toplevel_list_v1_listener foreign_toplevel_list_listener = {
+	.toplevel = foreign_toplevel_list_handle_toplevel,
+	.finished = foreign_toplevel_list_handle_finished,
 };
 
-static void ext_image_copy_handle_global(void *data, struct wl_registry *registry,
+/* --- Global Registry Handlers --- */
+
+static void create_output_xdg_output(struct grim_state *state, struct grim_output *output) {
+	if (state->xdg_output_manager == NULL || output->xdg_output != NULL) {
+		return;
+	}
+
+	output->geometry_ready = FALSE;
+	output->xdg_output = zxdg_output_manager_v1_get_xdg_output(
+		state->xdg_output_manager, output->wl_output);
+	zxdg_output_v1_add_listener(output->xdg_output,
+		&xdg_output_listener, output);
+}
+
+static void destroy_output(struct grim_output *output) {
+	wl_list_remove(&output->link);
+	free(output->name);
+	if (output->xdg_output != NULL) {
+		zxdg_output_v1_destroy(output->xdg_output);
+	}
+	wl_output_release(output->wl_output);
+	free(output);
+}
+
+static void registry_handle_global(void *data, struct wl_registry *registry,
 		uint32_t name, const char *interface, uint32_t version) {
 	struct grim_state *state = data;
 
@@ -815,56 +1780,169 @@ static void ext_image_copy_handle_global(void *data, struct wl_registry *registr
 		struct grim_output *output = calloc(1, sizeof(struct grim_output));
 		output->state = state;
 		output->scale = 1;
+		output->global_name = name;
 		output->wl_output =  wl_registry_bind(registry, name,
 			&wl_output_interface, bind_version);
 		wl_output_add_listener(output->wl_output, &output_listener, output);
 		wl_list_insert(&state->outputs, &output->link);
+		// Hotplugged outputs can get their xdg_output right away, the
+		// initial ones are handled once the manager is known
+		create_output_xdg_output(state, output);
+	} else if (strcmp(interface, zwlr_screencopy_manager_v1_interface.name) == 0) {
+		// Version 2 adds copy_with_damage
+		uint32_t bind_version = (version > 2) ? 2 : version;
+		state->screencopy_manager = wl_registry_bind(registry, name,
+			&zwlr_screencopy_manager_v1_interface, bind_version);
 	} else if (strcmp(interface, ext_output_image_capture_source_manager_v1_interface.name) == 0) {
 		state->ext_output_image_capture_source_manager = wl_registry_bind(registry, name,
 			&ext_output_image_capture_source_manager_v1_interface, 1);
 	} else if (strcmp(interface, ext_image_copy_capture_manager_v1_interface.name) == 0) {
 		state->ext_image_copy_capture_manager = wl_registry_bind(registry, name,
 			&ext_image_copy_capture_manager_v1_interface, 1);
+	} else if (strcmp(interface, ext_foreign_toplevel_image_capture_source_manager_v1_interface.name) == 0) {
+		state->ext_foreign_toplevel_image_capture_source_manager = wl_registry_bind(registry, name,
+			&ext_foreign_toplevel_image_capture_source_manager_v1_interface, 1);
+	} else if (strcmp(interface, ext_foreign_toplevel_list_v1_interface.name) == 0) {
+		state->foreign_toplevel_list = wl_registry_bind(registry, name,
+			&ext_foreign_toplevel_list_v1_interface, 1);
+		ext_foreign_toplevel_list_v1_add_listener(state->foreign_toplevel_list,
+			&foreign_toplevel_list_listener, state);
+	}
+}
+
+static void registry_handle_global_remove(void *data, struct wl_registry *registry,
+		uint32_t name) {
+	struct grim_state *state = data;
+
+	struct grim_output *output, *output_tmp;
+	wl_list_for_each_safe(output, output_tmp, &state->outputs, link) {
+		if (output->global_name != name) {
+			continue;
+		}
+
+		destroy_output(output);
+		return;
 	}
 }
 
-static const struct wl_registry_listener ext_image_copy_registry_listener = {
-	.global = ext_image_copy_handle_global,
-	.global_remove = NULL,
+static const struct wl_registry_listener registry_listener = {
+	.global = registry_handle_global,
+	.global_remove = registry_handle_global_remove,
 };
 
 /* --- Capture Creation Helper Functions --- */
 
-static void create_screencopy_capture(struct grim_state *state, struct grim_output *output, gboolean with_cursor) {
+enum grim_protocol {
+	GRIM_PROTOCOL_EXT_IMAGE_COPY,
+	GRIM_PROTOCOL_SCREENCOPY,
+	// ext-image-copy-capture, or screencopy when cropping a region
+	GRIM_PROTOCOL_PREFERRED,
+};
+
+static void *create_queue_wrapper(void *proxy, struct wl_event_queue *queue) {
+	if (proxy == NULL) {
+		return NULL;
+	}
+	void *wrapper = wl_proxy_create_wrapper(proxy);
+	wl_proxy_set_queue(wrapper, queue);
+	return wrapper;
+}
+
+/* Gives the batch its event queue. Must be called with the state locked. */
+static void init_batch(struct grim_batch *batch, struct grim_state *state) {
+	batch->state = state;
+	batch->queue = wl_display_create_queue(state->display);
+	batch->screencopy_manager = create_queue_wrapper(state->screencopy_manager,
+		batch->queue);
+	batch->ext_output_image_capture_source_manager = create_queue_wrapper(
+		state->ext_output_image_capture_source_manager, batch->queue);
+	batch->ext_image_copy_capture_manager = create_queue_wrapper(
+		state->ext_image_copy_capture_manager, batch->queue);
+	batch->ext_foreign_toplevel_image_capture_source_manager = create_queue_wrapper(
+		state->ext_foreign_toplevel_image_capture_source_manager, batch->queue);
+	++state->n_batches;
+}
+
+static struct grim_capture *create_capture(struct grim_batch *batch, struct grim_output *output) {
 	struct grim_capture *capture = calloc(1, sizeof(*capture));
-	capture->state = state;
-	capture->output = output;
+	capture->batch = batch;
+	capture->output_name = output->name != NULL ? strdup(output->name) : NULL;
+	capture->output_global_name = output->global_name;
 	capture->transform = output->transform;
 	capture->logical_geometry = output->logical_geometry;
-	wl_list_insert(&state->captures, &capture->link);
+	capture->logical_scale = output->logical_scale;
+	wl_list_insert(&batch->captures, &capture->link);
+	return capture;
+}
 
-	capture->screencopy_frame = zwlr_screencopy_manager_v1_capture_output(
-		state->screencopy_manager, with_cursor, output->wl_output);
+static void create_screencopy_capture(struct grim_batch *batch, struct grim_output *output,
+		const struct grim_box *region, gboolean with_cursor) {
+	if (region == NULL) {
+		struct grim_capture *capture = create_capture(batch, output);
+		capture->screencopy_frame = zwlr_screencopy_manager_v1_capture_output(
+			batch->screencopy_manager, with_cursor, output->wl_output);
+		zwlr_screencopy_frame_v1_add_listener(capture->screencopy_frame,
+			&screencopy_frame_listener, capture);
+		return;
+	}
+
+	struct grim_box output_region;
+	if (!get_box_intersection(region, &output->logical_geometry, &output_region)) {
+		return;
+	}
+
+	// The compositor crops for us, so the buffer only holds the region
+	struct grim_capture *capture = create_capture(batch, output);
+	capture->logical_geometry = output_region;
+	capture->screencopy_frame = zwlr_screencopy_manager_v1_capture_output_region(
+		batch->screencopy_manager, with_cursor, output->wl_output,
+		output_region.x - output->logical_geometry.x,
+		output_region.y - output->logical_geometry.y,
+		output_region.width, output_region.height);
 	zwlr_screencopy_frame_v1_add_listener(capture->screencopy_frame,
 		&screencopy_frame_listener, capture);
 }
 
-static void create_ext_image_copy_capture(struct grim_state *state, struct grim_output *output, gboolean with_cursor) {
-	struct grim_capture *capture = calloc(1, sizeof(*capture));
-	capture->state = state;
-	capture->output = output;
-	capture->transform = output->transform;
-	capture->logical_geometry = output->logical_geometry;
-	wl_list_insert(&state->captures, &capture->link);
+static void create_ext_image_copy_capture(struct grim_batch *batch, struct grim_output *output,
+		const struct grim_box *region, gboolean with_cursor) {
+	// ext-image-copy-capture has no cropping, skip the outputs we don't need
+	if (region != NULL && !intersect_box(region, &output->logical_geometry)) {
+		return;
+	}
+
+	struct grim_capture *capture = create_capture(batch, output);
 
 	uint32_t options = 0;
 	if (with_cursor) {
 		options |= EXT_IMAGE_COPY_CAPTURE_MANAGER_V1_OPTIONS_PAINT_CURSORS;
 	}
 	struct ext_image_capture_source_v1 *source = ext_output_image_capture_source_manager_v1_create_source(
-		state->ext_output_image_capture_source_manager, output->wl_output);
+		batch->ext_output_image_capture_source_manager, output->wl_output);
+	capture->ext_image_copy_capture_session = ext_image_copy_capture_manager_v1_create_session(
+		batch->ext_image_copy_capture_manager, source, options);
+	ext_image_copy_capture_session_v1_add_listener(capture->ext_image_copy_capture_session,
+		&ext_image_copy_capture_session_listener, capture);
+	ext_image_capture_source_v1_destroy(source);
+}
+
+static void create_toplevel_capture(struct grim_batch *batch, struct grim_toplevel *toplevel,
+		gboolean with_cursor) {
+	struct grim_capture *capture = calloc(1, sizeof(*capture));
+	capture->batch = batch;
+	capture->toplevel = TRUE;
+	capture->transform = WL_OUTPUT_TRANSFORM_NORMAL;
+	capture->logical_scale = 1.0;
+	wl_list_insert(&batch->captures, &capture->link);
+
+	uint32_t options = 0;
+	if (with_cursor) {
+		options |= EXT_IMAGE_COPY_CAPTURE_MANAGER_V1_OPTIONS_PAINT_CURSORS;
+	}
+	// Only the window's own buffer is copied, not the outputs it sits on
+	struct ext_image_capture_source_v1 *source = ext_foreign_toplevel_image_capture_source_manager_v1_create_source(
+		batch->ext_foreign_toplevel_image_capture_source_manager, toplevel->handle);
 	capture->ext_image_copy_capture_session = ext_image_copy_capture_manager_v1_create_session(
-		state->ext_image_copy_capture_manager, source, options);
+		batch->ext_image_copy_capture_manager, source, options);
 	ext_image_copy_capture_session_v1_add_listener(capture->ext_image_copy_capture_session,
 		&ext_image_copy_capture_session_listener, capture);
 	ext_image_capture_source_v1_destroy(source);
@@ -872,9 +1950,14 @@ static void create_ext_image_copy_capture(struct grim_state *state, struct grim_
 
 /* --- Cleanup Helper --- */
 
-static void cleanup_grim_state(struct grim_state *state) {
+static void cleanup_captures(struct grim_batch *batch) {
+	struct grim_state *state = batch->state;
+
+	if (state != NULL) {
+		g_mutex_lock(&state->lock);
+	}
 	struct grim_capture *capture, *capture_tmp;
-	wl_list_for_each_safe(capture, capture_tmp, &state->captures, link) {
+	wl_list_for_each_safe(capture, capture_tmp, &batch->captures, link) {
 		wl_list_remove(&capture->link);
 		if (capture->ext_image_copy_capture_frame != NULL) {
 			ext_image_copy_capture_frame_v1_destroy(capture->ext_image_copy_capture_frame);
@@ -885,20 +1968,83 @@ static void cleanup_grim_state(struct grim_state *state) {
 		if (capture->screencopy_frame != NULL) {
 			zwlr_screencopy_frame_v1_destroy(capture->screencopy_frame);
 		}
-		if (capture->buffer != NULL) {
-			destroy_buffer(capture->buffer);
+		if (capture->continuous) {
+			// capture->buffer is one of the two
+			for (int i = 0; i < 2; i++) {
+				if (capture->buffers[i] != NULL) {
+					release_buffer(state, capture->buffers[i]);
+				}
+				pixman_region32_fini(&capture->stale[i]);
+			}
+			pixman_region32_fini(&capture->frame_damage);
+			pixman_region32_fini(&capture->damage);
+		} else if (capture->buffer != NULL) {
+			release_buffer(state, capture->buffer);
 		}
+		free(capture->output_name);
 		free(capture);
 	}
+	if (state != NULL) {
+		g_mutex_unlock(&state->lock);
+	}
+	batch->n_done = 0;
+}
+
+static void cleanup_batch(struct grim_batch *batch) {
+	cleanup_captures(batch);
+	if (batch->state == NULL) {
+		return;
+	}
+
+	if (batch->screencopy_manager != NULL) {
+		wl_proxy_wrapper_destroy(batch->screencopy_manager);
+	}
+	if (batch->ext_output_image_capture_source_manager != NULL) {
+		wl_proxy_wrapper_destroy(batch->ext_output_image_capture_source_manager);
+	}
+	if (batch->ext_image_copy_capture_manager != NULL) {
+		wl_proxy_wrapper_destroy(batch->ext_image_copy_capture_manager);
+	}
+	if (batch->ext_foreign_toplevel_image_capture_source_manager != NULL) {
+		wl_proxy_wrapper_destroy(batch->ext_foreign_toplevel_image_capture_source_manager);
+	}
+	wl_event_queue_destroy(batch->queue);
+
+	g_mutex_lock(&batch->state->lock);
+	--batch->state->n_batches;
+	g_mutex_unlock(&batch->state->lock);
+
+	batch->state = NULL;
+	batch->queue = NULL;
+	batch->screencopy_manager = NULL;
+	batch->ext_output_image_capture_source_manager = NULL;
+	batch->ext_image_copy_capture_manager = NULL;
+	batch->ext_foreign_toplevel_image_capture_source_manager = NULL;
+}
+
+/* Drops the connection. Must be called with the state locked and without
+ * batches in flight. */
+static void cleanup_grim_state(struct grim_state *state) {
+	if (state->trim_source != 0) {
+		g_source_remove(state->trim_source);
+	}
+	struct grim_buffer *buffer, *buffer_tmp;
+	wl_list_for_each_safe(buffer, buffer_tmp, &state->buffers, link) {
+		free_buffer(buffer);
+	}
 	struct grim_output *output, *output_tmp;
 	wl_list_for_each_safe(output, output_tmp, &state->outputs, link) {
-		wl_list_remove(&output->link);
-		free(output->name);
-		if (output->xdg_output != NULL) {
-			zxdg_output_v1_destroy(output->xdg_output);
-		}
-		wl_output_release(output->wl_output);
-		free(output);
+		destroy_output(output);
+	}
+	struct grim_toplevel *toplevel, *toplevel_tmp;
+	wl_list_for_each_safe(toplevel, toplevel_tmp, &state->toplevels, link) {
+		destroy_toplevel(toplevel);
+	}
+	if (state->foreign_toplevel_list != NULL) {
+		ext_foreign_toplevel_list_v1_destroy(state->foreign_toplevel_list);
+	}
+	if (state->ext_foreign_toplevel_image_capture_source_manager != NULL) {
+		ext_foreign_toplevel_image_capture_source_manager_v1_destroy(state->ext_foreign_toplevel_image_capture_source_manager);
 	}
 	if (state->ext_output_image_capture_source_manager != NULL) {
 		ext_output_image_capture_source_manager_v1_destroy(state->ext_output_image_capture_source_manager);
@@ -921,270 +2067,1515 @@ static void cleanup_grim_state(struct grim_state *state) {
 	if (state->display != NULL) {
 		wl_display_disconnect(state->display);
 	}
+
+	// The lock stays usable, only the connection is reset
+	state->display = NULL;
+	state->registry = NULL;
+	state->shm = NULL;
+	state->xdg_output_manager = NULL;
+	state->ext_output_image_capture_source_manager = NULL;
+	state->ext_image_copy_capture_manager = NULL;
+	state->screencopy_manager = NULL;
+	state->foreign_toplevel_list = NULL;
+	state->ext_foreign_toplevel_image_capture_source_manager = NULL;
+	wl_list_init(&state->outputs);
+	wl_list_init(&state->toplevels);
+	wl_list_init(&state->buffers);
 }
 
-/* --- Public Methods --- */
+/* --- Capture Context --- */
 
-GdkPixbuf *makas_capture_screencopy(gboolean with_cursor) {
-	capture_failed = FALSE;
+G_DEFINE_TYPE(MakasCaptureContext, makas_capture_context, G_TYPE_OBJECT)
 
-	struct grim_state state = {0};
-	wl_list_init(&state.outputs);
-	wl_list_init(&state.captures);
+enum {
+	PROP_0,
+	PROP_RENDER_THREADS,
+	N_PROPS
+};
 
-	state.display = wl_display_connect(NULL);
-	if (state.display == NULL) {
-		g_warning("failed to connect to Wayland display");
-		return NULL;
-	}
+static GParamSpec *properties[N_PROPS];
 
-	state.registry = wl_display_get_registry(state.display);
-	wl_registry_add_listener(state.registry, &screencopy_registry_listener, &state);
-	if (wl_display_roundtrip(state.display) < 0) {
-		g_warning("wl_display_roundtrip() failed");
-		cleanup_grim_state(&state);
-		return NULL;
-	}
+static void makas_capture_context_get_property(GObject *object, guint prop_id,
+		GValue *value, GParamSpec *pspec) {
+	MakasCaptureContext *self = MAKAS_CAPTURE_CONTEXT(object);
 
-	if (state.shm == NULL) {
-		g_warning("compositor doesn't support wl_shm");
-		cleanup_grim_state(&state);
-		return NULL;
+	switch (prop_id) {
+	case PROP_RENDER_THREADS:
+		g_value_set_uint(value, self->render_threads);
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 	}
+}
 
-	if (state.screencopy_manager == NULL) {
-		g_warning("compositor doesn't support zwlr_screencopy_manager_v1");
-		cleanup_grim_state(&state);
-		return NULL;
-	}
+static void makas_capture_context_set_property(GObject *object, guint prop_id,
+		const GValue *value, GParamSpec *pspec) {
+	MakasCaptureContext *self = MAKAS_CAPTURE_CONTEXT(object);
 
-	if (wl_list_empty(&state.outputs)) {
-		g_warning("no wl_output found");
-		cleanup_grim_state(&state);
-		return NULL;
+	switch (prop_id) {
+	case PROP_RENDER_THREADS:
+		makas_capture_context_set_render_threads(self, g_value_get_uint(value));
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 	}
+}
 
-	if (state.xdg_output_manager != NULL) {
-		struct grim_output *output;
-		wl_list_for_each(output, &state.outputs, link) {
-			output->xdg_output = zxdg_output_manager_v1_get_xdg_output(
-				state.xdg_output_manager, output->wl_output);
-			zxdg_output_v1_add_listener(output->xdg_output,
-				&xdg_output_listener, output);
-		}
-	} else {
-		struct grim_output *output;
-		wl_list_for_each(output, &state.outputs, link) {
-			guess_output_logical_geometry(output);
-		}
-	}
+static void makas_capture_context_dispose(GObject *object) {
+	MakasCaptureContext *self = MAKAS_CAPTURE_CONTEXT(object);
 
-	if (state.xdg_output_manager != NULL) {
-		if (wl_display_roundtrip(state.display) < 0) {
-			g_warning("wl_display_roundtrip() failed");
-			cleanup_grim_state(&state);
-			return NULL;
-		}
-	}
+	g_mutex_lock(&self->state.lock);
+	cleanup_grim_state(&self->state);
+	self->connected = FALSE;
+	g_mutex_unlock(&self->state.lock);
 
-	struct grim_output *output;
-	wl_list_for_each(output, &state.outputs, link) {
-		create_screencopy_capture(&state, output, with_cursor);
-	}
+	G_OBJECT_CLASS(makas_capture_context_parent_class)->dispose(object);
+}
 
-	if (wl_list_empty(&state.captures)) {
-		g_warning("failed to create any screencopy captures");
-		cleanup_grim_state(&state);
-		return NULL;
+static void makas_capture_context_finalize(GObject *object) {
+	MakasCaptureContext *self = MAKAS_CAPTURE_CONTEXT(object);
+
+	g_mutex_clear(&self->state.lock);
+
+	G_OBJECT_CLASS(makas_capture_context_parent_class)->finalize(object);
+}
+
+static void makas_capture_context_class_init(MakasCaptureContextClass *klass) {
+	GObjectClass *object_class = G_OBJECT_CLASS(klass);
+	object_class->dispose = makas_capture_context_dispose;
+	object_class->finalize = makas_capture_context_finalize;
+	object_class->get_property = makas_capture_context_get_property;
+	object_class->set_property = makas_capture_context_set_property;
+
+	/**
+	 * MakasCaptureContext:render-threads:
+	 *
+	 * Number of threads compositing the captured outputs, 0 uses one
+	 * thread per CPU.
+	 */
+	properties[PROP_RENDER_THREADS] = g_param_spec_uint("render-threads", NULL, NULL,
+		0, 64, 0, G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+
+	g_object_class_install_properties(object_class, N_PROPS, properties);
+}
+
+static void makas_capture_context_init(MakasCaptureContext *self) {
+	g_mutex_init(&self->state.lock);
+	wl_list_init(&self->state.outputs);
+	wl_list_init(&self->state.toplevels);
+	wl_list_init(&self->state.buffers);
+}
+
+static int get_render_threads(MakasCaptureContext *self) {
+	if (self->render_threads > 0) {
+		return self->render_threads;
 	}
+	return g_get_num_processors();
+}
 
-	size_t n_pending = wl_list_length(&state.captures);
-	while (!capture_failed && state.n_done < n_pending && wl_display_dispatch(state.display) != -1) {
-		// Event loop
+static gboolean connect_context(MakasCaptureContext *self) {
+	struct grim_state *state = &self->state;
+
+	state->display = wl_display_connect(NULL);
+	if (state->display == NULL) {
+		g_warning("failed to connect to Wayland display");
+		return FALSE;
 	}
 
-	if (capture_failed || state.n_done < n_pending) {
-		g_warning("failed to capture all outputs via screencopy");
-		cleanup_grim_state(&state);
-		return NULL;
+	state->registry = wl_display_get_registry(state->display);
+	wl_registry_add_listener(state->registry, &registry_listener, state);
+	if (wl_display_roundtrip(state->display) < 0) {
+		g_warning("wl_display_roundtrip() failed");
+		cleanup_grim_state(state);
+		return FALSE;
 	}
 
-	struct grim_box geometry = {0};
-	get_capture_layout_extents(&state, &geometry);
+	if (state->shm == NULL) {
+		g_warning("compositor doesn't support wl_shm");
+		cleanup_grim_state(state);
+		return FALSE;
+	}
 
-	double scale = 1.0;
-	struct grim_output *out;
-	wl_list_for_each(out, &state.outputs, link) {
-		if (out->logical_scale > scale) {
-			scale = out->logical_scale;
+	// The xdg_outputs and the toplevel list both answer in a second round
+	if (state->xdg_output_manager != NULL || state->foreign_toplevel_list != NULL) {
+		struct grim_output *output;
+		wl_list_for_each(output, &state->outputs, link) {
+			create_output_xdg_output(state, output);
+		}
+
+		if (wl_display_roundtrip(state->display) < 0) {
+			g_warning("wl_display_roundtrip() failed");
+			cleanup_grim_state(state);
+			return FALSE;
+		}
+	}
+
+	self->connected = TRUE;
+	return TRUE;
+}
+
+/* Reads and dispatches the events of queue (NULL for the default queue),
+ * waiting at most timeout milliseconds (-1 to block) for the compositor.
+ * cancel_fd, when not -1, also ends the wait. Other threads may read the
+ * same display concurrently, libwayland routes each event to its queue. */
+static gboolean dispatch_events(struct wl_display *display, struct wl_event_queue *queue,
+		int timeout, int cancel_fd) {
+	while ((queue != NULL ? wl_display_prepare_read_queue(display, queue) :
+			wl_display_prepare_read(display)) != 0) {
+		if ((queue != NULL ? wl_display_dispatch_queue_pending(display, queue) :
+				wl_display_dispatch_pending(display)) < 0) {
+			return FALSE;
+		}
+	}
+
+	short events = POLLIN;
+	if (wl_display_flush(display) < 0) {
+		if (errno != EAGAIN) {
+			wl_display_cancel_read(display);
+			return FALSE;
+		}
+		// The socket is full, wake up again once the rest can be sent
+		events |= POLLOUT;
+	}
+
+	struct pollfd pfds[2] = {
+		{ .fd = wl_display_get_fd(display), .events = events },
+		{ .fd = cancel_fd, .events = POLLIN },
+	};
+	int ret;
+	do {
+		ret = poll(pfds, cancel_fd != -1 ? 2 : 1, timeout);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret > 0 && (pfds[0].revents & (POLLIN | POLLERR | POLLHUP))) {
+		if (wl_display_read_events(display) < 0) {
+			return FALSE;
+		}
+	} else {
+		wl_display_cancel_read(display);
+		if (ret < 0) {
+			return FALSE;
+		}
+	}
+
+	return (queue != NULL ? wl_display_dispatch_queue_pending(display, queue) :
+		wl_display_dispatch_pending(display)) >= 0;
+}
+
+/* Dispatches whatever the compositor sent since the last capture (output
+ * hotplug, mode changes...) without blocking. */
+static gboolean dispatch_pending_events(struct wl_display *display) {
+	return dispatch_events(display, NULL, 0, -1);
+}
+
+/* Makes sure the connection and the output list are usable. Must be called
+ * with the state locked. */
+static gboolean prepare_context(MakasCaptureContext *self) {
+	struct grim_state *state = &self->state;
+
+	if (self->connected && (wl_display_get_error(state->display) != 0 ||
+			!dispatch_pending_events(state->display))) {
+		// Batches in flight still use the connection, they fail on their own
+		if (state->n_batches > 0) {
+			g_warning("lost connection to Wayland display");
+			return FALSE;
 		}
+		g_warning("lost connection to Wayland display, reconnecting");
+		cleanup_grim_state(state);
+		self->connected = FALSE;
 	}
 
-	pixman_image_t *image = grim_render(&state, &geometry, scale);
+	if (!self->connected) {
+		return connect_context(self);
+	}
+
+	gboolean outputs_ready = TRUE;
+	struct grim_output *output;
+	wl_list_for_each(output, &state->outputs, link) {
+		if (!output->geometry_ready) {
+			outputs_ready = FALSE;
+		}
+	}
+
+	// A freshly hotplugged output is still waiting for its geometry
+	if (!outputs_ready && wl_display_roundtrip(state->display) < 0) {
+		g_warning("wl_display_roundtrip() failed");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Wraps the canvas data in a GdkPixbuf, consuming the image. */
+static GdkPixbuf *image_to_pixbuf(pixman_image_t *image) {
 	if (image == NULL) {
-		cleanup_grim_state(&state);
 		return NULL;
 	}
 
+	guchar *data = (guchar *)pixman_image_get_data(image);
 	int width = pixman_image_get_width(image);
 	int height = pixman_image_get_height(image);
+	int stride = pixman_image_get_stride(image);
 
-	GdkPixbuf *pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, width, height);
+	// The pixbuf takes over the pixels
+	pixman_image_set_destroy_function(image, NULL, NULL);
+	pixman_image_unref(image);
+
+	return gdk_pixbuf_new_from_data(data, GDK_COLORSPACE_RGB, TRUE, 8,
+		width, height, stride, free_pixbuf_data, NULL);
+}
+
+/* Renders a single capture at the native scale of its output and tags the
+ * result with the output name and logical position. */
+static GdkPixbuf *render_capture_to_pixbuf(struct grim_batch *batch,
+		struct grim_capture *capture, int n_threads) {
+	double scale = capture->logical_scale > 0 ? capture->logical_scale : 1.0;
+	GdkPixbuf *pixbuf = image_to_pixbuf(grim_render(batch,
+		&capture->logical_geometry, scale, capture, n_threads));
 	if (pixbuf == NULL) {
-		pixman_image_unref(image);
-		cleanup_grim_state(&state);
+		batch->failure = GRIM_FAILURE_RENDER;
+		return NULL;
+	}
+
+	char x[16], y[16];
+	g_snprintf(x, sizeof(x), "%d", capture->logical_geometry.x);
+	g_snprintf(y, sizeof(y), "%d", capture->logical_geometry.y);
+	gdk_pixbuf_set_option(pixbuf, "x", x);
+	gdk_pixbuf_set_option(pixbuf, "y", y);
+	if (capture->output_name != NULL) {
+		gdk_pixbuf_set_option(pixbuf, "output-name", capture->output_name);
+	}
+	return pixbuf;
+}
+
+/* Copies the canvas into a new GdkPixbuf, the image stays usable. */
+static GdkPixbuf *copy_image_to_pixbuf(pixman_image_t *image) {
+	int width = pixman_image_get_width(image);
+	int height = pixman_image_get_height(image);
+	int stride = pixman_image_get_stride(image);
+
+	guchar *data = g_try_malloc((gsize)stride * height);
+	if (data == NULL) {
+		g_warning("failed to allocate image with size: %d x %d", width, height);
 		return NULL;
 	}
+	memcpy(data, pixman_image_get_data(image), (gsize)stride * height);
 
-	uint32_t *src_pixels = (uint32_t *)pixman_image_get_data(image);
-	int src_stride = pixman_image_get_stride(image) / 4;
-	guchar *dest_pixels = gdk_pixbuf_get_pixels(pixbuf);
-	int dest_stride = gdk_pixbuf_get_rowstride(pixbuf);
+	return gdk_pixbuf_new_from_data(data, GDK_COLORSPACE_RGB, TRUE, 8,
+		width, height, stride, free_pixbuf_data, NULL);
+}
 
-	for (int y = 0; y < height; y++) {
-		for (int x = 0; x < width; x++) {
-			uint32_t pixel = src_pixels[y * src_stride + x];
-			guchar *p = dest_pixels + y * dest_stride + x * 4;
-			p[0] = (pixel >> 16) & 0xFF; // R
-			p[1] = (pixel >> 8) & 0xFF;  // G
-			p[2] = pixel & 0xFF;         // B
-			p[3] = (pixel >> 24) & 0xFF; // A
+/* The whole layout is rendered at the scale of the densest output */
+static double get_capture_layout_scale(struct grim_batch *batch) {
+	double scale = 1.0;
+	struct grim_capture *capture;
+	wl_list_for_each(capture, &batch->captures, link) {
+		if (capture->logical_scale > scale) {
+			scale = capture->logical_scale;
 		}
 	}
+	return scale;
+}
 
-	pixman_image_unref(image);
-	cleanup_grim_state(&state);
+static GdkPixbuf *render_captures_to_pixbuf(struct grim_batch *batch,
+		const struct grim_box *region, int n_threads) {
+	struct grim_box geometry = {0};
+	get_capture_layout_extents(batch, &geometry);
+	if (region != NULL && !get_box_intersection(region, &geometry, &geometry)) {
+		g_warning("region is outside of all outputs");
+		batch->failure = GRIM_FAILURE_NO_OUTPUT;
+		return NULL;
+	}
+
+	double scale = get_capture_layout_scale(batch);
+	GdkPixbuf *pixbuf = image_to_pixbuf(grim_render(batch, &geometry, scale, NULL, n_threads));
+	if (pixbuf == NULL) {
+		batch->failure = GRIM_FAILURE_RENDER;
+	}
 	return pixbuf;
 }
 
-GdkPixbuf *makas_capture_ext_image_copy(gboolean with_cursor) {
-	capture_failed = FALSE;
+/* ext-image-copy-capture is the standard protocol, screencopy the fallback */
+static enum grim_protocol get_preferred_protocol(struct grim_state *state) {
+	if (state->ext_output_image_capture_source_manager != NULL &&
+			state->ext_image_copy_capture_manager != NULL) {
+		return GRIM_PROTOCOL_EXT_IMAGE_COPY;
+	}
+	return GRIM_PROTOCOL_SCREENCOPY;
+}
 
-	struct grim_state state = {0};
-	wl_list_init(&state.outputs);
-	wl_list_init(&state.captures);
+static const char *get_protocol_name(enum grim_protocol protocol) {
+	return protocol == GRIM_PROTOCOL_SCREENCOPY ? "screencopy" : "ext-image-copy";
+}
 
-	state.display = wl_display_connect(NULL);
-	if (state.display == NULL) {
-		g_warning("failed to connect to Wayland display");
-		return NULL;
+static gboolean has_protocol(struct grim_state *state, enum grim_protocol protocol) {
+	if (protocol == GRIM_PROTOCOL_SCREENCOPY) {
+		return state->screencopy_manager != NULL;
 	}
+	return state->ext_output_image_capture_source_manager != NULL &&
+		state->ext_image_copy_capture_manager != NULL;
+}
 
-	state.registry = wl_display_get_registry(state.display);
-	wl_registry_add_listener(state.registry, &ext_image_copy_registry_listener, &state);
-	if (wl_display_roundtrip(state.display) < 0) {
-		g_warning("wl_display_roundtrip() failed");
-		cleanup_grim_state(&state);
-		return NULL;
+/* Lists the protocols to try, in order. GRIM_PROTOCOL_PREFERRED expands to
+ * every protocol the compositor supports. */
+static size_t get_capture_protocols(struct grim_state *state, enum grim_protocol protocol,
+		const struct grim_box *region, enum grim_protocol protocols[2]) {
+	if (protocol != GRIM_PROTOCOL_PREFERRED) {
+		protocols[0] = protocol;
+		return 1;
 	}
 
-	if (state.shm == NULL) {
-		g_warning("compositor doesn't support wl_shm");
-		cleanup_grim_state(&state);
-		return NULL;
+	// Screencopy can crop on the compositor side, prefer it for regions
+	enum grim_protocol first = get_preferred_protocol(state);
+	if (region != NULL && has_protocol(state, GRIM_PROTOCOL_SCREENCOPY)) {
+		first = GRIM_PROTOCOL_SCREENCOPY;
 	}
+	enum grim_protocol second = first == GRIM_PROTOCOL_SCREENCOPY ?
+		GRIM_PROTOCOL_EXT_IMAGE_COPY : GRIM_PROTOCOL_SCREENCOPY;
 
-	if (state.ext_output_image_capture_source_manager == NULL || state.ext_image_copy_capture_manager == NULL) {
-		g_warning("compositor doesn't support ext-image-copy-capture");
-		cleanup_grim_state(&state);
-		return NULL;
+	size_t n_protocols = 0;
+	if (has_protocol(state, first)) {
+		protocols[n_protocols++] = first;
+	}
+	if (has_protocol(state, second)) {
+		protocols[n_protocols++] = second;
+	}
+	return n_protocols;
+}
+
+/* Failures the other protocol may not run into */
+static gboolean can_fall_back(enum grim_failure failure) {
+	return failure == GRIM_FAILURE_COPY || failure == GRIM_FAILURE_NO_FORMAT;
+}
+
+/* Creates the captures of the batch. Must be called with the state locked. */
+static gboolean start_captures(struct grim_state *state, struct grim_batch *batch,
+		enum grim_protocol protocol, const struct grim_box *region,
+		const char *output_name, gboolean with_cursor) {
+	if (!has_protocol(state, protocol)) {
+		if (protocol == GRIM_PROTOCOL_SCREENCOPY) {
+			g_warning("compositor doesn't support zwlr_screencopy_manager_v1");
+		} else {
+			g_warning("compositor doesn't support ext-image-copy-capture");
+		}
+		batch->failure = GRIM_FAILURE_UNSUPPORTED;
+		return FALSE;
 	}
 
-	if (wl_list_empty(&state.outputs)) {
+	if (wl_list_empty(&state->outputs)) {
 		g_warning("no wl_output found");
-		cleanup_grim_state(&state);
-		return NULL;
+		batch->failure = GRIM_FAILURE_NO_OUTPUT;
+		return FALSE;
 	}
 
-	if (state.xdg_output_manager != NULL) {
-		struct grim_output *output;
-		wl_list_for_each(output, &state.outputs, link) {
-			output->xdg_output = zxdg_output_manager_v1_get_xdg_output(
-				state.xdg_output_manager, output->wl_output);
-			zxdg_output_v1_add_listener(output->xdg_output,
-				&xdg_output_listener, output);
+	// A fallback attempt reuses the queue of the first one
+	if (batch->queue == NULL) {
+		init_batch(batch, state);
+	}
+
+	struct grim_output *output;
+	wl_list_for_each(output, &state->outputs, link) {
+		if (output_name != NULL && g_strcmp0(output->name, output_name) != 0) {
+			continue;
 		}
-	} else {
-		struct grim_output *output;
-		wl_list_for_each(output, &state.outputs, link) {
-			guess_output_logical_geometry(output);
+		if (protocol == GRIM_PROTOCOL_SCREENCOPY) {
+			create_screencopy_capture(batch, output, region, with_cursor);
+		} else {
+			create_ext_image_copy_capture(batch, output, region, with_cursor);
 		}
 	}
 
-	if (state.xdg_output_manager != NULL) {
-		if (wl_display_roundtrip(state.display) < 0) {
-			g_warning("wl_display_roundtrip() failed");
-			cleanup_grim_state(&state);
-			return NULL;
+	if (wl_list_empty(&batch->captures)) {
+		if (output_name != NULL) {
+			g_warning("no output named %s", output_name);
+		} else {
+			g_warning("failed to create any %s captures", get_protocol_name(protocol));
 		}
+		batch->failure = GRIM_FAILURE_NO_OUTPUT;
+		return FALSE;
 	}
 
-	struct grim_output *output;
-	wl_list_for_each(output, &state.outputs, link) {
-		create_ext_image_copy_capture(&state, output, with_cursor);
+	return TRUE;
+}
+
+/* Dispatches the batch queue until every capture is done or one failed. */
+static gboolean wait_captures(struct grim_batch *batch, GCancellable *cancellable) {
+	int cancel_fd = g_cancellable_get_fd(cancellable);
+	size_t n_pending = wl_list_length(&batch->captures);
+	while (batch->failure == GRIM_FAILURE_NONE && batch->n_done < n_pending) {
+		if (g_cancellable_is_cancelled(cancellable)) {
+			batch->failure = GRIM_FAILURE_CANCELLED;
+		} else if (!dispatch_events(batch->state->display, batch->queue, -1, cancel_fd)) {
+			batch->failure = GRIM_FAILURE_NO_CONNECTION;
+		}
 	}
+	g_cancellable_release_fd(cancellable);
+
+	return batch->failure == GRIM_FAILURE_NONE;
+}
+
+/* Copies the outputs matching region/output_name (NULL for all of them) and
+ * leaves the finished captures in the batch for rendering. With
+ * GRIM_PROTOCOL_PREFERRED, a failed attempt is retried with the other
+ * protocol on the same connection. Only the setup holds the state lock,
+ * waiting for the frames happens on the batch queue. */
+static gboolean run_captures(MakasCaptureContext *self, struct grim_batch *batch,
+		enum grim_protocol protocol, const struct grim_box *region,
+		const char *output_name, gboolean with_cursor, GCancellable *cancellable) {
+	struct grim_state *state = &self->state;
+	enum grim_protocol protocols[2];
+	size_t n_protocols = 0;
+
+	for (size_t i = 0; ; i++) {
+		g_mutex_lock(&state->lock);
+		gboolean started = prepare_context(self);
+		if (!started) {
+			batch->failure = GRIM_FAILURE_NO_CONNECTION;
+		} else {
+			if (i == 0) {
+				n_protocols = get_capture_protocols(state, protocol, region, protocols);
+			}
+			if (n_protocols == 0) {
+				g_warning("compositor doesn't support any capture protocol");
+				batch->failure = GRIM_FAILURE_UNSUPPORTED;
+				started = FALSE;
+			} else {
+				started = start_captures(state, batch, protocols[i], region,
+					output_name, with_cursor);
+			}
+		}
+		g_mutex_unlock(&state->lock);
+
+		if (started && wait_captures(batch, cancellable)) {
+			return TRUE;
+		}
+		cleanup_captures(batch);
+
+		if (i + 1 >= n_protocols || !can_fall_back(batch->failure)) {
+			if (batch->failure != GRIM_FAILURE_CANCELLED) {
+				g_warning("failed to capture all outputs");
+			}
+			return FALSE;
+		}
 
-	if (wl_list_empty(&state.captures)) {
-		g_warning("failed to create any ext-image-copy captures");
-		cleanup_grim_state(&state);
+		g_warning("%s capture failed, falling back to %s",
+			get_protocol_name(protocols[i]), get_protocol_name(protocols[i + 1]));
+		batch->failure = GRIM_FAILURE_NONE;
+	}
+}
+
+static GdkPixbuf *capture_outputs(MakasCaptureContext *self, struct grim_batch *batch,
+		enum grim_protocol protocol, const struct grim_box *region, gboolean with_cursor,
+		GCancellable *cancellable) {
+	if (!run_captures(self, batch, protocol, region, NULL, with_cursor, cancellable)) {
+		return NULL;
+	}
+
+	return render_captures_to_pixbuf(batch, region, get_render_threads(self));
+}
+
+static GdkPixbuf *capture_output(MakasCaptureContext *self, struct grim_batch *batch,
+		const char *output_name, gboolean with_cursor, GCancellable *cancellable) {
+	if (!run_captures(self, batch, GRIM_PROTOCOL_PREFERRED, NULL, output_name,
+			with_cursor, cancellable)) {
+		return NULL;
+	}
+
+	struct grim_capture *capture =
+		wl_container_of(batch->captures.next, capture, link);
+	return render_capture_to_pixbuf(batch, capture, get_render_threads(self));
+}
+
+static GPtrArray *capture_each_output(MakasCaptureContext *self, struct grim_batch *batch,
+		gboolean with_cursor, GCancellable *cancellable) {
+	if (!run_captures(self, batch, GRIM_PROTOCOL_PREFERRED, NULL, NULL, with_cursor,
+			cancellable)) {
 		return NULL;
 	}
 
-	size_t n_pending = wl_list_length(&state.captures);
-	while (!capture_failed && state.n_done < n_pending && wl_display_dispatch(state.display) != -1) {
-		// Event loop
+	GPtrArray *pixbufs = g_ptr_array_new_with_free_func(g_object_unref);
+	struct grim_capture *capture;
+	// Captures are prepended, walk backwards to keep the output order
+	wl_list_for_each_reverse(capture, &batch->captures, link) {
+		GdkPixbuf *pixbuf = render_capture_to_pixbuf(batch, capture,
+			get_render_threads(self));
+		if (pixbuf == NULL) {
+			g_ptr_array_unref(pixbufs);
+			return NULL;
+		}
+		g_ptr_array_add(pixbufs, pixbuf);
+	}
+
+	return pixbufs;
+}
+
+/* Marks a freshly created capture as continuous, before any of its events
+ * are dispatched. */
+static void init_continuous_capture(struct grim_capture *capture, gboolean with_cursor) {
+	capture->continuous = TRUE;
+	capture->with_cursor = with_cursor;
+	pixman_region32_init(&capture->frame_damage);
+	pixman_region32_init(&capture->damage);
+	pixman_region32_init(&capture->stale[0]);
+	pixman_region32_init(&capture->stale[1]);
+}
+
+/* ext-image-copy-capture, or screencopy from version 2 on, whose frames can
+ * wait for damage. Returns FALSE if neither is available. */
+static gboolean get_continuous_protocol(struct grim_state *state,
+		enum grim_protocol *protocol) {
+	if (has_protocol(state, GRIM_PROTOCOL_EXT_IMAGE_COPY)) {
+		*protocol = GRIM_PROTOCOL_EXT_IMAGE_COPY;
+		return TRUE;
+	}
+	if (has_protocol(state, GRIM_PROTOCOL_SCREENCOPY) &&
+			zwlr_screencopy_manager_v1_get_version(state->screencopy_manager) >= 2) {
+		*protocol = GRIM_PROTOCOL_SCREENCOPY;
+		return TRUE;
+	}
+	return FALSE;
+}
+
+/* Starts a continuous capture of every output. Must be called with the state
+ * locked. */
+static gboolean start_continuous_captures(MakasCaptureContext *self,
+		struct grim_batch *batch, gboolean with_cursor) {
+	struct grim_state *state = &self->state;
+
+	if (!prepare_context(self)) {
+		batch->failure = GRIM_FAILURE_NO_CONNECTION;
+		return FALSE;
+	}
+
+	enum grim_protocol protocol;
+	if (!get_continuous_protocol(state, &protocol)) {
+		g_warning("compositor doesn't support continuous capture");
+		batch->failure = GRIM_FAILURE_UNSUPPORTED;
+		return FALSE;
+	}
+
+	if (!start_captures(state, batch, protocol, NULL, NULL, with_cursor)) {
+		return FALSE;
+	}
+
+	struct grim_capture *capture;
+	wl_list_for_each(capture, &batch->captures, link) {
+		init_continuous_capture(capture, with_cursor);
+	}
+	return TRUE;
+}
+
+/* Keeps dispatching the batch queue until the monotonic time end_time, so
+ * continuous captures go on collecting frames in the meantime. */
+static gboolean wait_captures_until(struct grim_batch *batch, gint64 end_time,
+		GCancellable *cancellable) {
+	int cancel_fd = g_cancellable_get_fd(cancellable);
+	while (batch->failure == GRIM_FAILURE_NONE) {
+		gint64 now = g_get_monotonic_time();
+		if (now >= end_time) {
+			break;
+		}
+
+		int timeout = (end_time - now + 999) / 1000;
+		if (g_cancellable_is_cancelled(cancellable)) {
+			batch->failure = GRIM_FAILURE_CANCELLED;
+		} else if (!dispatch_events(batch->state->display, batch->queue, timeout, cancel_fd)) {
+			batch->failure = GRIM_FAILURE_NO_CONNECTION;
+		}
 	}
+	g_cancellable_release_fd(cancellable);
+
+	return batch->failure == GRIM_FAILURE_NONE;
+}
 
-	if (capture_failed || state.n_done < n_pending) {
-		g_warning("failed to capture all outputs via ext-image-copy");
-		cleanup_grim_state(&state);
+/* Takes n_frames shots of the whole screen, interval milliseconds apart, on
+ * capture sessions kept open for the whole burst. Later frames only carry the
+ * damaged rectangles, which are re-rendered into a persistent canvas; a shot
+ * without damage reuses the previous pixbuf. */
+static GPtrArray *capture_burst(MakasCaptureContext *self, struct grim_batch *batch,
+		guint n_frames, guint interval, gboolean with_cursor, GCancellable *cancellable) {
+	g_mutex_lock(&self->state.lock);
+	gboolean started = start_continuous_captures(self, batch, with_cursor);
+	g_mutex_unlock(&self->state.lock);
+
+	// The first shot needs a full frame of every output
+	if (!started || !wait_captures(batch, cancellable)) {
+		if (batch->failure != GRIM_FAILURE_CANCELLED) {
+			g_warning("failed to start the capture sessions");
+		}
 		return NULL;
 	}
 
 	struct grim_box geometry = {0};
-	get_capture_layout_extents(&state, &geometry);
+	get_capture_layout_extents(batch, &geometry);
+	double scale = get_capture_layout_scale(batch);
+	int n_threads = get_render_threads(self);
+
+	pixman_image_t *canvas = NULL;
+	GdkPixbuf *last_pixbuf = NULL;
+	GPtrArray *pixbufs = g_ptr_array_new_with_free_func(g_object_unref);
+	gint64 shot_time = g_get_monotonic_time();
+	for (guint i = 0; i < n_frames; i++) {
+		if (i > 0 && !wait_captures_until(batch, shot_time, cancellable)) {
+			break;
+		}
 
-	double scale = 1.0;
-	struct grim_output *out;
-	wl_list_for_each(out, &state.outputs, link) {
-		if (out->logical_scale > scale) {
-			scale = out->logical_scale;
+		gboolean damaged = TRUE;
+		gboolean ok;
+		if (canvas == NULL) {
+			canvas = grim_render(batch, &geometry, scale, NULL, n_threads);
+			ok = canvas != NULL;
+
+			// The full render already covers the damage of the first frames
+			struct grim_capture *capture;
+			wl_list_for_each(capture, &batch->captures, link) {
+				pixman_region32_clear(&capture->damage);
+			}
+		} else {
+			ok = grim_render_damage(batch, canvas, &geometry, scale, n_threads, &damaged);
+		}
+
+		GdkPixbuf *pixbuf = NULL;
+		if (ok) {
+			pixbuf = damaged ? copy_image_to_pixbuf(canvas) : g_object_ref(last_pixbuf);
+		}
+		if (pixbuf == NULL) {
+			batch->failure = GRIM_FAILURE_RENDER;
+			break;
 		}
+		g_ptr_array_add(pixbufs, pixbuf);
+		last_pixbuf = pixbuf;
+
+		shot_time += (gint64)interval * 1000;
 	}
 
-	pixman_image_t *image = grim_render(&state, &geometry, scale);
-	if (image == NULL) {
-		cleanup_grim_state(&state);
+	if (canvas != NULL) {
+		pixman_image_unref(canvas);
+	}
+	if (batch->failure != GRIM_FAILURE_NONE) {
+		g_ptr_array_unref(pixbufs);
 		return NULL;
 	}
+	return pixbufs;
+}
 
-	int width = pixman_image_get_width(image);
-	int height = pixman_image_get_height(image);
+/* Takes a shot of the whole screen once it went quiet milliseconds without
+ * damage, or at the latest after timeout milliseconds. Continuous frames only
+ * come in when something changed, so the screen has settled once none
+ * arrived for the quiet period. */
+static GdkPixbuf *capture_stable(MakasCaptureContext *self, struct grim_batch *batch,
+		guint quiet, guint timeout, gboolean with_cursor, GCancellable *cancellable) {
+	gint64 deadline = g_get_monotonic_time() + (gint64)timeout * 1000;
+
+	g_mutex_lock(&self->state.lock);
+	gboolean started = start_continuous_captures(self, batch, with_cursor);
+	g_mutex_unlock(&self->state.lock);
+
+	// Without damage there is nothing to wait for
+	if (!started && batch->failure == GRIM_FAILURE_UNSUPPORTED) {
+		g_warning("can't tell when the screen settles, capturing right away");
+		batch->failure = GRIM_FAILURE_NONE;
+		return capture_outputs(self, batch, GRIM_PROTOCOL_PREFERRED, NULL, with_cursor,
+			cancellable);
+	}
 
-	GdkPixbuf *pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, width, height);
-	if (pixbuf == NULL) {
-		pixman_image_unref(image);
-		cleanup_grim_state(&state);
+	if (!started || !wait_captures(batch, cancellable)) {
+		if (batch->failure != GRIM_FAILURE_CANCELLED) {
+			g_warning("failed to start the capture sessions");
+		}
 		return NULL;
 	}
 
-	uint32_t *src_pixels_ptr = (uint32_t *)pixman_image_get_data(image);
-	int src_stride = pixman_image_get_stride(image) / 4;
-	guchar *dest_pixels = gdk_pixbuf_get_pixels(pixbuf);
-	int dest_stride = gdk_pixbuf_get_rowstride(pixbuf);
+	for (;;) {
+		gint64 end_time = MIN(batch->damage_time + (gint64)quiet * 1000, deadline);
+		if (g_get_monotonic_time() >= end_time) {
+			break;
+		}
+		if (!wait_captures_until(batch, end_time, cancellable)) {
+			return NULL;
+		}
+	}
 
-	for (int y = 0; y < height; y++) {
-		for (int x = 0; x < width; x++) {
-			uint32_t pixel = src_pixels_ptr[y * src_stride + x];
-			guchar *p = dest_pixels + y * dest_stride + x * 4;
-			p[0] = (pixel >> 16) & 0xFF; // R
-			p[1] = (pixel >> 8) & 0xFF;  // G
-			p[2] = pixel & 0xFF;         // B
-			p[3] = (pixel >> 24) & 0xFF; // A
+	return render_captures_to_pixbuf(batch, NULL, get_render_threads(self));
+}
+
+static struct grim_toplevel *find_toplevel(struct grim_state *state, const char *identifier) {
+	struct grim_toplevel *toplevel;
+	wl_list_for_each(toplevel, &state->toplevels, link) {
+		if (toplevel->ready && g_strcmp0(toplevel->identifier, identifier) == 0) {
+			return toplevel;
 		}
 	}
+	return NULL;
+}
 
-	pixman_image_unref(image);
-	cleanup_grim_state(&state);
-	return pixbuf;
+static gboolean start_toplevel_capture(MakasCaptureContext *self, struct grim_batch *batch,
+		const char *identifier, gboolean with_cursor) {
+	struct grim_state *state = &self->state;
+
+	if (!prepare_context(self)) {
+		batch->failure = GRIM_FAILURE_NO_CONNECTION;
+		return FALSE;
+	}
+
+	if (state->ext_foreign_toplevel_image_capture_source_manager == NULL ||
+			state->ext_image_copy_capture_manager == NULL) {
+		g_warning("compositor doesn't support ext-foreign-toplevel image capture");
+		batch->failure = GRIM_FAILURE_UNSUPPORTED;
+		return FALSE;
+	}
+
+	struct grim_toplevel *toplevel = find_toplevel(state, identifier);
+	if (toplevel == NULL) {
+		g_warning("no toplevel with identifier %s", identifier);
+		batch->failure = GRIM_FAILURE_NO_TOPLEVEL;
+		return FALSE;
+	}
+
+	init_batch(batch, state);
+	create_toplevel_capture(batch, toplevel, with_cursor);
+	return TRUE;
+}
+
+static GdkPixbuf *capture_toplevel(MakasCaptureContext *self, struct grim_batch *batch,
+		const char *identifier, gboolean with_cursor, GCancellable *cancellable) {
+	g_mutex_lock(&self->state.lock);
+	gboolean started = start_toplevel_capture(self, batch, identifier, with_cursor);
+	g_mutex_unlock(&self->state.lock);
+
+	if (!started || !wait_captures(batch, cancellable)) {
+		if (batch->failure != GRIM_FAILURE_CANCELLED) {
+			g_warning("failed to capture toplevel %s", identifier);
+		}
+		return NULL;
+	}
+
+	struct grim_capture *capture =
+		wl_container_of(batch->captures.next, capture, link);
+	return render_capture_to_pixbuf(batch, capture, get_render_threads(self));
+}
+
+/* --- Capture Requests --- */
+
+enum grim_request_kind {
+	GRIM_REQUEST_SCREEN,
+	GRIM_REQUEST_REGION,
+	GRIM_REQUEST_OUTPUT,
+	GRIM_REQUEST_OUTPUTS,
+	GRIM_REQUEST_TOPLEVEL,
+	GRIM_REQUEST_BURST,
+	GRIM_REQUEST_STABLE,
+};
+
+/* Arguments of a capture, shared by the blocking and the async entry points */
+struct grim_request {
+	enum grim_request_kind kind;
+	enum grim_protocol protocol;
+	struct grim_box region;
+	char *output_name;
+	char *toplevel_identifier;
+	gboolean with_cursor;
+	guint n_frames;
+	guint interval;
+	guint quiet;
+	guint timeout;
+	// Only used by the capture_to_fd and capture_to_file requests
+	gint fd;
+	char *filename;
+	char *format;
+	gint level;
+};
+
+static void free_request(struct grim_request *request) {
+	g_free(request->output_name);
+	g_free(request->toplevel_identifier);
+	g_free(request->filename);
+	g_free(request->format);
+	g_free(request);
+}
+
+/* Runs a request in its own batch, so requests on the same context can run
+ * from several threads at once. Returns a GdkPixbuf, or a GPtrArray of them
+ * for GRIM_REQUEST_OUTPUTS and GRIM_REQUEST_BURST. */
+static gpointer run_request(MakasCaptureContext *self, const struct grim_request *request,
+		GCancellable *cancellable, enum grim_failure *failure) {
+	struct grim_batch batch = {0};
+	wl_list_init(&batch.captures);
+
+	gpointer result = NULL;
+	switch (request->kind) {
+	case GRIM_REQUEST_SCREEN:
+		result = capture_outputs(self, &batch, request->protocol, NULL,
+			request->with_cursor, cancellable);
+		break;
+	case GRIM_REQUEST_REGION:
+		result = capture_outputs(self, &batch, GRIM_PROTOCOL_PREFERRED, &request->region,
+			request->with_cursor, cancellable);
+		break;
+	case GRIM_REQUEST_OUTPUT:
+		result = capture_output(self, &batch, request->output_name, request->with_cursor,
+			cancellable);
+		break;
+	case GRIM_REQUEST_OUTPUTS:
+		result = capture_each_output(self, &batch, request->with_cursor, cancellable);
+		break;
+	case GRIM_REQUEST_TOPLEVEL:
+		result = capture_toplevel(self, &batch, request->toplevel_identifier,
+			request->with_cursor, cancellable);
+		break;
+	case GRIM_REQUEST_BURST:
+		result = capture_burst(self, &batch, request->n_frames, request->interval,
+			request->with_cursor, cancellable);
+		break;
+	case GRIM_REQUEST_STABLE:
+		result = capture_stable(self, &batch, request->quiet, request->timeout,
+			request->with_cursor, cancellable);
+		break;
+	}
+	cleanup_batch(&batch);
+
+	if (failure != NULL) {
+		*failure = batch.failure;
+	}
+	return result;
+}
+
+static GError *new_failure_error(enum grim_failure failure) {
+	switch (failure) {
+	case GRIM_FAILURE_CANCELLED:
+		return g_error_new_literal(G_IO_ERROR, G_IO_ERROR_CANCELLED,
+			"Capture was cancelled");
+	case GRIM_FAILURE_NO_CONNECTION:
+		return g_error_new_literal(G_IO_ERROR, G_IO_ERROR_NOT_CONNECTED,
+			"No usable Wayland connection");
+	case GRIM_FAILURE_UNSUPPORTED:
+		return g_error_new_literal(G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+			"Compositor doesn't support the capture protocol");
+	case GRIM_FAILURE_NO_OUTPUT:
+		return g_error_new_literal(G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+			"No output to capture");
+	case GRIM_FAILURE_NO_TOPLEVEL:
+		return g_error_new_literal(G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+			"Window is gone");
+	case GRIM_FAILURE_NO_FORMAT:
+		return g_error_new_literal(G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+			"Compositor offered no supported pixel format");
+	case GRIM_FAILURE_NO_BUFFER:
+		return g_error_new_literal(G_IO_ERROR, G_IO_ERROR_FAILED,
+			"Failed to allocate a shared memory buffer");
+	case GRIM_FAILURE_STOPPED:
+		return g_error_new_literal(G_IO_ERROR, G_IO_ERROR_CLOSED,
+			"Output went away during the capture");
+	case GRIM_FAILURE_COPY:
+	case GRIM_FAILURE_RENDER:
+	case GRIM_FAILURE_NONE:
+		return g_error_new_literal(G_IO_ERROR, G_IO_ERROR_FAILED,
+			"Wayland capture failed");
+	}
+	g_assert_not_reached();
+}
+
+static void return_failure(GTask *task, enum grim_failure failure) {
+	if (failure == GRIM_FAILURE_CANCELLED && g_task_return_error_if_cancelled(task)) {
+		return;
+	}
+	g_task_return_error(task, new_failure_error(failure));
+}
+
+/* Composites the whole layout and returns the canvas itself. It is laid out
+ * like a GdkPixbuf already, so the encoders read its rows as they are. */
+static pixman_image_t *capture_canvas(MakasCaptureContext *self, gboolean with_cursor,
+		GCancellable *cancellable, GError **error) {
+	struct grim_batch batch = {0};
+	wl_list_init(&batch.captures);
+
+	pixman_image_t *canvas = NULL;
+	if (run_captures(self, &batch, GRIM_PROTOCOL_PREFERRED, NULL, NULL, with_cursor,
+			cancellable)) {
+		struct grim_box geometry = {0};
+		get_capture_layout_extents(&batch, &geometry);
+		canvas = grim_render(&batch, &geometry, get_capture_layout_scale(&batch), NULL,
+			get_render_threads(self));
+		if (canvas == NULL) {
+			batch.failure = GRIM_FAILURE_RENDER;
+		}
+	}
+	cleanup_batch(&batch);
+
+	if (canvas == NULL) {
+		g_propagate_error(error, new_failure_error(batch.failure));
+	}
+	return canvas;
+}
+
+static void capture_to_file_thread(GTask *task, gpointer source_object,
+		gpointer task_data, GCancellable *cancellable) {
+	const struct grim_request *request = task_data;
+	GError *error = NULL;
+
+	if (!makas_capture_context_capture_to_file(MAKAS_CAPTURE_CONTEXT(source_object),
+			request->filename, request->format, request->level, request->with_cursor,
+			cancellable, &error)) {
+		g_task_return_error(task, error);
+		return;
+	}
+	g_task_return_boolean(task, TRUE);
+}
+
+static void capture_to_fd_thread(GTask *task, gpointer source_object,
+		gpointer task_data, GCancellable *cancellable) {
+	const struct grim_request *request = task_data;
+	GError *error = NULL;
+
+	if (!makas_capture_context_capture_to_fd(MAKAS_CAPTURE_CONTEXT(source_object),
+			request->fd, request->format, request->level, request->with_cursor,
+			cancellable, &error)) {
+		g_task_return_error(task, error);
+		return;
+	}
+	g_task_return_boolean(task, TRUE);
+}
+
+static void run_request_thread(GTask *task, gpointer source_object,
+		gpointer task_data, GCancellable *cancellable) {
+	const struct grim_request *request = task_data;
+	enum grim_failure failure = GRIM_FAILURE_NONE;
+	gpointer result = run_request(MAKAS_CAPTURE_CONTEXT(source_object), request,
+		cancellable, &failure);
+
+	if (result == NULL) {
+		return_failure(task, failure);
+		return;
+	}
+
+	if (request->kind == GRIM_REQUEST_OUTPUTS || request->kind == GRIM_REQUEST_BURST) {
+		g_task_return_pointer(task, result, (GDestroyNotify)g_ptr_array_unref);
+	} else {
+		g_task_return_pointer(task, result, g_object_unref);
+	}
+}
+
+/* Takes ownership of request and runs it on a worker thread. */
+static void run_request_async(MakasCaptureContext *self, struct grim_request *request,
+		GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data,
+		gpointer source_tag) {
+	GTask *task = g_task_new(self, cancellable, callback, user_data);
+	g_task_set_source_tag(task, source_tag);
+	g_task_set_task_data(task, request, (GDestroyNotify)free_request);
+	g_task_run_in_thread(task, run_request_thread);
+	g_object_unref(task);
+}
+
+static gpointer request_finish(MakasCaptureContext *self, GAsyncResult *result,
+		gpointer source_tag, GError **error) {
+	g_return_val_if_fail(g_task_is_valid(result, self), NULL);
+	g_return_val_if_fail(g_task_get_source_tag(G_TASK(result)) == source_tag, NULL);
+
+	return g_task_propagate_pointer(G_TASK(result), error);
+}
+
+static struct grim_request *new_screen_request(enum grim_protocol protocol,
+		gboolean with_cursor) {
+	struct grim_request *request = g_new0(struct grim_request, 1);
+	request->kind = GRIM_REQUEST_SCREEN;
+	request->protocol = protocol;
+	request->with_cursor = with_cursor;
+	return request;
+}
+
+/* --- Public Methods --- */
+
+MakasCaptureContext *makas_capture_context_new(void) {
+	return g_object_new(MAKAS_TYPE_CAPTURE_CONTEXT, NULL);
+}
+
+MakasCaptureContext *makas_capture_context_get_default(void) {
+	static MakasCaptureContext *default_context = NULL;
+
+	if (g_once_init_enter(&default_context)) {
+		g_once_init_leave(&default_context, makas_capture_context_new());
+	}
+	return default_context;
+}
+
+guint makas_capture_context_get_render_threads(MakasCaptureContext *self) {
+	g_return_val_if_fail(MAKAS_IS_CAPTURE_CONTEXT(self), 0);
+
+	return self->render_threads;
+}
+
+void makas_capture_context_set_render_threads(MakasCaptureContext *self,
+		guint render_threads) {
+	g_return_if_fail(MAKAS_IS_CAPTURE_CONTEXT(self));
+
+	render_threads = MIN(render_threads, 64);
+	if (self->render_threads == render_threads) {
+		return;
+	}
+
+	self->render_threads = render_threads;
+	g_object_notify_by_pspec(G_OBJECT(self), properties[PROP_RENDER_THREADS]);
+}
+
+GdkPixbuf *makas_capture_context_capture_screen(MakasCaptureContext *self,
+		gboolean with_cursor) {
+	g_return_val_if_fail(MAKAS_IS_CAPTURE_CONTEXT(self), NULL);
+
+	struct grim_request request = {
+		.kind = GRIM_REQUEST_SCREEN,
+		.protocol = GRIM_PROTOCOL_PREFERRED,
+		.with_cursor = with_cursor,
+	};
+	return run_request(self, &request, NULL, NULL);
+}
+
+void makas_capture_context_capture_screen_async(MakasCaptureContext *self,
+		gboolean with_cursor, GCancellable *cancellable, GAsyncReadyCallback callback,
+		gpointer user_data) {
+	g_return_if_fail(MAKAS_IS_CAPTURE_CONTEXT(self));
+
+	run_request_async(self, new_screen_request(GRIM_PROTOCOL_PREFERRED, with_cursor),
+		cancellable, callback, user_data, makas_capture_context_capture_screen_async);
+}
+
+GdkPixbuf *makas_capture_context_capture_screen_finish(MakasCaptureContext *self,
+		GAsyncResult *result, GError **error) {
+	return request_finish(self, result, makas_capture_context_capture_screen_async, error);
+}
+
+GdkPixbuf *makas_capture_context_capture_screencopy(MakasCaptureContext *self,
+		gboolean with_cursor) {
+	g_return_val_if_fail(MAKAS_IS_CAPTURE_CONTEXT(self), NULL);
+
+	struct grim_request request = {
+		.kind = GRIM_REQUEST_SCREEN,
+		.protocol = GRIM_PROTOCOL_SCREENCOPY,
+		.with_cursor = with_cursor,
+	};
+	return run_request(self, &request, NULL, NULL);
+}
+
+void makas_capture_context_capture_screencopy_async(MakasCaptureContext *self,
+		gboolean with_cursor, GCancellable *cancellable, GAsyncReadyCallback callback,
+		gpointer user_data) {
+	g_return_if_fail(MAKAS_IS_CAPTURE_CONTEXT(self));
+
+	run_request_async(self, new_screen_request(GRIM_PROTOCOL_SCREENCOPY, with_cursor),
+		cancellable, callback, user_data, makas_capture_context_capture_screencopy_async);
+}
+
+GdkPixbuf *makas_capture_context_capture_screencopy_finish(MakasCaptureContext *self,
+		GAsyncResult *result, GError **error) {
+	return request_finish(self, result, makas_capture_context_capture_screencopy_async,
+		error);
+}
+
+GdkPixbuf *makas_capture_context_capture_ext_image_copy(MakasCaptureContext *self,
+		gboolean with_cursor) {
+	g_return_val_if_fail(MAKAS_IS_CAPTURE_CONTEXT(self), NULL);
+
+	struct grim_request request = {
+		.kind = GRIM_REQUEST_SCREEN,
+		.protocol = GRIM_PROTOCOL_EXT_IMAGE_COPY,
+		.with_cursor = with_cursor,
+	};
+	return run_request(self, &request, NULL, NULL);
+}
+
+void makas_capture_context_capture_ext_image_copy_async(MakasCaptureContext *self,
+		gboolean with_cursor, GCancellable *cancellable, GAsyncReadyCallback callback,
+		gpointer user_data) {
+	g_return_if_fail(MAKAS_IS_CAPTURE_CONTEXT(self));
+
+	run_request_async(self, new_screen_request(GRIM_PROTOCOL_EXT_IMAGE_COPY, with_cursor),
+		cancellable, callback, user_data, makas_capture_context_capture_ext_image_copy_async);
+}
+
+GdkPixbuf *makas_capture_context_capture_ext_image_copy_finish(MakasCaptureContext *self,
+		GAsyncResult *result, GError **error) {
+	return request_finish(self, result, makas_capture_context_capture_ext_image_copy_async,
+		error);
+}
+
+GdkPixbuf *makas_capture_context_capture_region(MakasCaptureContext *self,
+		gint x, gint y, gint width, gint height, gboolean with_cursor) {
+	g_return_val_if_fail(MAKAS_IS_CAPTURE_CONTEXT(self), NULL);
+	g_return_val_if_fail(width > 0 && height > 0, NULL);
+
+	struct grim_request request = {
+		.kind = GRIM_REQUEST_REGION,
+		.region = { .x = x, .y = y, .width = width, .height = height },
+		.with_cursor = with_cursor,
+	};
+	return run_request(self, &request, NULL, NULL);
+}
+
+void makas_capture_context_capture_region_async(MakasCaptureContext *self,
+		gint x, gint y, gint width, gint height, gboolean with_cursor,
+		GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data) {
+	g_return_if_fail(MAKAS_IS_CAPTURE_CONTEXT(self));
+	g_return_if_fail(width > 0 && height > 0);
+
+	struct grim_request *request = g_new0(struct grim_request, 1);
+	request->kind = GRIM_REQUEST_REGION;
+	request->region = (struct grim_box) {
+		.x = x,
+		.y = y,
+		.width = width,
+		.height = height,
+	};
+	request->with_cursor = with_cursor;
+	run_request_async(self, request, cancellable, callback, user_data,
+		makas_capture_context_capture_region_async);
+}
+
+GdkPixbuf *makas_capture_context_capture_region_finish(MakasCaptureContext *self,
+		GAsyncResult *result, GError **error) {
+	return request_finish(self, result, makas_capture_context_capture_region_async, error);
+}
+
+GdkPixbuf *makas_capture_context_capture_output(MakasCaptureContext *self,
+		const gchar *output_name, gboolean with_cursor) {
+	g_return_val_if_fail(MAKAS_IS_CAPTURE_CONTEXT(self), NULL);
+	g_return_val_if_fail(output_name != NULL, NULL);
+
+	struct grim_request request = {
+		.kind = GRIM_REQUEST_OUTPUT,
+		.output_name = (char *)output_name,
+		.with_cursor = with_cursor,
+	};
+	return run_request(self, &request, NULL, NULL);
+}
+
+void makas_capture_context_capture_output_async(MakasCaptureContext *self,
+		const gchar *output_name, gboolean with_cursor, GCancellable *cancellable,
+		GAsyncReadyCallback callback, gpointer user_data) {
+	g_return_if_fail(MAKAS_IS_CAPTURE_CONTEXT(self));
+	g_return_if_fail(output_name != NULL);
+
+	struct grim_request *request = g_new0(struct grim_request, 1);
+	request->kind = GRIM_REQUEST_OUTPUT;
+	request->output_name = g_strdup(output_name);
+	request->with_cursor = with_cursor;
+	run_request_async(self, request, cancellable, callback, user_data,
+		makas_capture_context_capture_output_async);
+}
+
+GdkPixbuf *makas_capture_context_capture_output_finish(MakasCaptureContext *self,
+		GAsyncResult *result, GError **error) {
+	return request_finish(self, result, makas_capture_context_capture_output_async, error);
+}
+
+GPtrArray *makas_capture_context_capture_outputs(MakasCaptureContext *self,
+		gboolean with_cursor) {
+	g_return_val_if_fail(MAKAS_IS_CAPTURE_CONTEXT(self), NULL);
+
+	struct grim_request request = {
+		.kind = GRIM_REQUEST_OUTPUTS,
+		.with_cursor = with_cursor,
+	};
+	return run_request(self, &request, NULL, NULL);
+}
+
+void makas_capture_context_capture_outputs_async(MakasCaptureContext *self,
+		gboolean with_cursor, GCancellable *cancellable, GAsyncReadyCallback callback,
+		gpointer user_data) {
+	g_return_if_fail(MAKAS_IS_CAPTURE_CONTEXT(self));
+
+	struct grim_request *request = g_new0(struct grim_request, 1);
+	request->kind = GRIM_REQUEST_OUTPUTS;
+	request->with_cursor = with_cursor;
+	run_request_async(self, request, cancellable, callback, user_data,
+		makas_capture_context_capture_outputs_async);
+}
+
+GPtrArray *makas_capture_context_capture_outputs_finish(MakasCaptureContext *self,
+		GAsyncResult *result, GError **error) {
+	return request_finish(self, result, makas_capture_context_capture_outputs_async, error);
+}
+
+GVariant *makas_capture_context_list_toplevels(MakasCaptureContext *self) {
+	g_return_val_if_fail(MAKAS_IS_CAPTURE_CONTEXT(self), NULL);
+
+	GVariantBuilder builder;
+	g_variant_builder_init(&builder, G_VARIANT_TYPE("a(sss)"));
+
+	g_mutex_lock(&self->state.lock);
+	if (prepare_context(self)) {
+		struct grim_toplevel *toplevel;
+		wl_list_for_each(toplevel, &self->state.toplevels, link) {
+			if (!toplevel->ready || toplevel->identifier == NULL) {
+				continue;
+			}
+			g_variant_builder_add(&builder, "(sss)", toplevel->identifier,
+				toplevel->app_id != NULL ? toplevel->app_id : "",
+				toplevel->title != NULL ? toplevel->title : "");
+		}
+	}
+	g_mutex_unlock(&self->state.lock);
+
+	return g_variant_ref_sink(g_variant_builder_end(&builder));
+}
+
+GdkPixbuf *makas_capture_context_capture_toplevel(MakasCaptureContext *self,
+		const gchar *identifier, gboolean with_cursor) {
+	g_return_val_if_fail(MAKAS_IS_CAPTURE_CONTEXT(self), NULL);
+	g_return_val_if_fail(identifier != NULL, NULL);
+
+	struct grim_request request = {
+		.kind = GRIM_REQUEST_TOPLEVEL,
+		.toplevel_identifier = (char *)identifier,
+		.with_cursor = with_cursor,
+	};
+	return run_request(self, &request, NULL, NULL);
+}
+
+void makas_capture_context_capture_toplevel_async(MakasCaptureContext *self,
+		const gchar *identifier, gboolean with_cursor, GCancellable *cancellable,
+		GAsyncReadyCallback callback, gpointer user_data) {
+	g_return_if_fail(MAKAS_IS_CAPTURE_CONTEXT(self));
+	g_return_if_fail(identifier != NULL);
+
+	struct grim_request *request = g_new0(struct grim_request, 1);
+	request->kind = GRIM_REQUEST_TOPLEVEL;
+	request->toplevel_identifier = g_strdup(identifier);
+	request->with_cursor = with_cursor;
+	run_request_async(self, request, cancellable, callback, user_data,
+		makas_capture_context_capture_toplevel_async);
+}
+
+GdkPixbuf *makas_capture_context_capture_toplevel_finish(MakasCaptureContext *self,
+		GAsyncResult *result, GError **error) {
+	return request_finish(self, result, makas_capture_context_capture_toplevel_async, error);
+}
+
+GPtrArray *makas_capture_context_capture_burst(MakasCaptureContext *self,
+		guint n_frames, guint interval, gboolean with_cursor) {
+	g_return_val_if_fail(MAKAS_IS_CAPTURE_CONTEXT(self), NULL);
+	g_return_val_if_fail(n_frames > 0, NULL);
+
+	struct grim_request request = {
+		.kind = GRIM_REQUEST_BURST,
+		.with_cursor = with_cursor,
+		.n_frames = n_frames,
+		.interval = interval,
+	};
+	return run_request(self, &request, NULL, NULL);
+}
+
+void makas_capture_context_capture_burst_async(MakasCaptureContext *self,
+		guint n_frames, guint interval, gboolean with_cursor, GCancellable *cancellable,
+		GAsyncReadyCallback callback, gpointer user_data) {
+	g_return_if_fail(MAKAS_IS_CAPTURE_CONTEXT(self));
+	g_return_if_fail(n_frames > 0);
+
+	struct grim_request *request = g_new0(struct grim_request, 1);
+	request->kind = GRIM_REQUEST_BURST;
+	request->with_cursor = with_cursor;
+	request->n_frames = n_frames;
+	request->interval = interval;
+	run_request_async(self, request, cancellable, callback, user_data,
+		makas_capture_context_capture_burst_async);
+}
+
+GPtrArray *makas_capture_context_capture_burst_finish(MakasCaptureContext *self,
+		GAsyncResult *result, GError **error) {
+	return request_finish(self, result, makas_capture_context_capture_burst_async, error);
+}
+
+GdkPixbuf *makas_capture_context_capture_stable(MakasCaptureContext *self,
+		guint quiet, guint timeout, gboolean with_cursor) {
+	g_return_val_if_fail(MAKAS_IS_CAPTURE_CONTEXT(self), NULL);
+
+	struct grim_request request = {
+		.kind = GRIM_REQUEST_STABLE,
+		.with_cursor = with_cursor,
+		.quiet = quiet,
+		.timeout = timeout,
+	};
+	return run_request(self, &request, NULL, NULL);
+}
+
+void makas_capture_context_capture_stable_async(MakasCaptureContext *self,
+		guint quiet, guint timeout, gboolean with_cursor, GCancellable *cancellable,
+		GAsyncReadyCallback callback, gpointer user_data) {
+	g_return_if_fail(MAKAS_IS_CAPTURE_CONTEXT(self));
+
+	struct grim_request *request = g_new0(struct grim_request, 1);
+	request->kind = GRIM_REQUEST_STABLE;
+	request->with_cursor = with_cursor;
+	request->quiet = quiet;
+	request->timeout = timeout;
+	run_request_async(self, request, cancellable, callback, user_data,
+		makas_capture_context_capture_stable_async);
+}
+
+GdkPixbuf *makas_capture_context_capture_stable_finish(MakasCaptureContext *self,
+		GAsyncResult *result, GError **error) {
+	return request_finish(self, result, makas_capture_context_capture_stable_async, error);
+}
+
+gboolean makas_capture_context_capture_to_fd(MakasCaptureContext *self, gint fd,
+		const gchar *format, gint level, gboolean with_cursor, GCancellable *cancellable,
+		GError **error) {
+	g_return_val_if_fail(MAKAS_IS_CAPTURE_CONTEXT(self), FALSE);
+	g_return_val_if_fail(fd >= 0, FALSE);
+	g_return_val_if_fail(format != NULL, FALSE);
+
+	pixman_image_t *canvas = capture_canvas(self, with_cursor, cancellable, error);
+	if (canvas == NULL) {
+		return FALSE;
+	}
+
+	// The caller keeps the descriptor
+	g_autoptr(GOutputStream) out = g_unix_output_stream_new(fd, FALSE);
+	gboolean ok = makas_save_write_stream(out, (const guint8 *)pixman_image_get_data(canvas),
+		pixman_image_get_stride(canvas), pixman_image_get_width(canvas),
+		pixman_image_get_height(canvas), 4, format, level, cancellable, error);
+	pixman_image_unref(canvas);
+	return ok;
+}
+
+void makas_capture_context_capture_to_fd_async(MakasCaptureContext *self, gint fd,
+		const gchar *format, gint level, gboolean with_cursor, GCancellable *cancellable,
+		GAsyncReadyCallback callback, gpointer user_data) {
+	g_return_if_fail(MAKAS_IS_CAPTURE_CONTEXT(self));
+	g_return_if_fail(fd >= 0);
+	g_return_if_fail(format != NULL);
+
+	struct grim_request *request = g_new0(struct grim_request, 1);
+	request->kind = GRIM_REQUEST_SCREEN;
+	request->protocol = GRIM_PROTOCOL_PREFERRED;
+	request->with_cursor = with_cursor;
+	request->fd = fd;
+	request->format = g_strdup(format);
+	request->level = level;
+
+	GTask *task = g_task_new(self, cancellable, callback, user_data);
+	g_task_set_source_tag(task, makas_capture_context_capture_to_fd_async);
+	g_task_set_task_data(task, request, (GDestroyNotify)free_request);
+	g_task_run_in_thread(task, capture_to_fd_thread);
+	g_object_unref(task);
+}
+
+gboolean makas_capture_context_capture_to_fd_finish(MakasCaptureContext *self,
+		GAsyncResult *result, GError **error) {
+	g_return_val_if_fail(g_task_is_valid(result, self), FALSE);
+	g_return_val_if_fail(g_task_get_source_tag(G_TASK(result)) ==
+		makas_capture_context_capture_to_fd_async, FALSE);
+
+	return g_task_propagate_boolean(G_TASK(result), error);
+}
+
+gboolean makas_capture_context_capture_to_file(MakasCaptureContext *self,
+		const gchar *filename, const gchar *format, gint level, gboolean with_cursor,
+		GCancellable *cancellable, GError **error) {
+	g_return_val_if_fail(MAKAS_IS_CAPTURE_CONTEXT(self), FALSE);
+	g_return_val_if_fail(filename != NULL, FALSE);
+	g_return_val_if_fail(format != NULL, FALSE);
+
+	pixman_image_t *canvas = capture_canvas(self, with_cursor, cancellable, error);
+	if (canvas == NULL) {
+		return FALSE;
+	}
+
+	gboolean ok = makas_save_write_file(filename,
+		(const guint8 *)pixman_image_get_data(canvas), pixman_image_get_stride(canvas),
+		pixman_image_get_width(canvas), pixman_image_get_height(canvas), 4, format, level,
+		cancellable, error);
+	pixman_image_unref(canvas);
+	return ok;
+}
+
+void makas_capture_context_capture_to_file_async(MakasCaptureContext *self,
+		const gchar *filename, const gchar *format, gint level, gboolean with_cursor,
+		GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data) {
+	g_return_if_fail(MAKAS_IS_CAPTURE_CONTEXT(self));
+	g_return_if_fail(filename != NULL);
+	g_return_if_fail(format != NULL);
+
+	struct grim_request *request = g_new0(struct grim_request, 1);
+	request->kind = GRIM_REQUEST_SCREEN;
+	request->protocol = GRIM_PROTOCOL_PREFERRED;
+	request->with_cursor = with_cursor;
+	request->filename = g_strdup(filename);
+	request->format = g_strdup(format);
+	request->level = level;
+
+	GTask *task = g_task_new(self, cancellable, callback, user_data);
+	g_task_set_source_tag(task, makas_capture_context_capture_to_file_async);
+	g_task_set_task_data(task, request, (GDestroyNotify)free_request);
+	g_task_run_in_thread(task, capture_to_file_thread);
+	g_object_unref(task);
+}
+
+gboolean makas_capture_context_capture_to_file_finish(MakasCaptureContext *self,
+		GAsyncResult *result, GError **error) {
+	g_return_val_if_fail(g_task_is_valid(result, self), FALSE);
+	g_return_val_if_fail(g_task_get_source_tag(G_TASK(result)) ==
+		makas_capture_context_capture_to_file_async, FALSE);
+
+	return g_task_propagate_boolean(G_TASK(result), error);
+}
+
+GdkPixbuf *makas_capture_screen(gboolean with_cursor) {
+	return makas_capture_context_capture_screen(
+		makas_capture_context_get_default(), with_cursor);
+}
+
+GdkPixbuf *makas_capture_screencopy(gboolean with_cursor) {
+	return makas_capture_context_capture_screencopy(
+		makas_capture_context_get_default(), with_cursor);
+}
+
+GdkPixbuf *makas_capture_ext_image_copy(gboolean with_cursor) {
+	return makas_capture_context_capture_ext_image_copy(
+		makas_capture_context_get_default(), with_cursor);
+}
+
+GdkPixbuf *makas_capture_region(gint x, gint y, gint width, gint height,
+		gboolean with_cursor) {
+	return makas_capture_context_capture_region(
+		makas_capture_context_get_default(), x, y, width, height, with_cursor);
+}
+
+GdkPixbuf *makas_capture_output(const gchar *output_name, gboolean with_cursor) {
+	return makas_capture_context_capture_output(
+		makas_capture_context_get_default(), output_name, with_cursor);
+}
+
+GPtrArray *makas_capture_outputs(gboolean with_cursor) {
+	return makas_capture_context_capture_outputs(
+		makas_capture_context_get_default(), with_cursor);
+}
+
+GVariant *makas_capture_list_toplevels(void) {
+	return makas_capture_context_list_toplevels(makas_capture_context_get_default());
+}
+
+GdkPixbuf *makas_capture_toplevel(const gchar *identifier, gboolean with_cursor) {
+	return makas_capture_context_capture_toplevel(
+		makas_capture_context_get_default(), identifier, with_cursor);
+}
+
+GPtrArray *makas_capture_burst(guint n_frames, guint interval, gboolean with_cursor) {
+	return makas_capture_context_capture_burst(
+		makas_capture_context_get_default(), n_frames, interval, with_cursor);
+}
+
+GdkPixbuf *makas_capture_stable(guint quiet, guint timeout, gboolean with_cursor) {
+	return makas_capture_context_capture_stable(
+		makas_capture_context_get_default(), quiet, timeout, with_cursor);
+}
+
+gboolean makas_capture_to_fd(gint fd, const gchar *format, gint level, gboolean with_cursor,
+		GError **error) {
+	return makas_capture_context_capture_to_fd(makas_capture_context_get_default(), fd,
+		format, level, with_cursor, NULL, error);
+}
+
+gboolean makas_capture_to_file(const gchar *filename, const gchar *format, gint level,
+		gboolean with_cursor, GError **error) {
+	return makas_capture_context_capture_to_file(makas_capture_context_get_default(),
+		filename, format, level, with_cursor, NULL, error);
 }
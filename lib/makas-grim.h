@@ -2,15 +2,505 @@
 #define MAKAS_GRIM_H
 
 #include <gdk-pixbuf/gdk-pixbuf.h>
+#include <gio/gio.h>
 #include <glib-object.h>
 
 G_BEGIN_DECLS
 
+#define MAKAS_TYPE_CAPTURE_CONTEXT (makas_capture_context_get_type())
+G_DECLARE_FINAL_TYPE(MakasCaptureContext, makas_capture_context, MAKAS, CAPTURE_CONTEXT, GObject)
+
+/**
+ * makas_capture_context_new:
+ *
+ * Creates a capture context. The Wayland connection is opened on the first
+ * capture and kept alive, together with the bound globals and the output
+ * list, until the context is disposed.
+ *
+ * Returns: (transfer full): A new #MakasCaptureContext.
+ */
+MakasCaptureContext *makas_capture_context_new(void);
+
+/**
+ * makas_capture_context_get_default:
+ *
+ * Returns the context used by the context-less capture functions.
+ *
+ * Returns: (transfer none): The shared #MakasCaptureContext.
+ */
+MakasCaptureContext *makas_capture_context_get_default(void);
+
+/**
+ * makas_capture_context_get_render_threads:
+ * @self: A #MakasCaptureContext.
+ *
+ * Returns: The number of compositing threads, 0 meaning one per CPU.
+ */
+guint makas_capture_context_get_render_threads(MakasCaptureContext *self);
+
+/**
+ * makas_capture_context_set_render_threads:
+ * @self: A #MakasCaptureContext.
+ * @render_threads: Number of threads, 0 for one per CPU.
+ *
+ * Sets how many threads composite the captured outputs into the final
+ * image. The canvas is split in horizontal tiles rendered in parallel.
+ */
+void makas_capture_context_set_render_threads(MakasCaptureContext *self, guint render_threads);
+
+/**
+ * makas_capture_context_capture_screen:
+ * @self: A #MakasCaptureContext.
+ * @with_cursor: Whether to include the cursor in the screenshot.
+ *
+ * Captures the screen with the best protocol the compositor offers,
+ * ext_image_copy_capture_v1 first. If a copy fails, it is retried with
+ * zwlr_screencopy_v1 on the same connection.
+ *
+ * Returns: (transfer full) (nullable): A GdkPixbuf with the screenshot, or NULL on failure.
+ */
+GdkPixbuf *makas_capture_context_capture_screen(MakasCaptureContext *self, gboolean with_cursor);
+
+/**
+ * makas_capture_context_capture_screen_async:
+ * @self: A #MakasCaptureContext.
+ * @with_cursor: Whether to include the cursor in the screenshot.
+ * @cancellable: (nullable): A #GCancellable.
+ * @callback: (scope async): Called when the screenshot is ready.
+ * @user_data: (closure): Data for @callback.
+ *
+ * Asynchronous version of makas_capture_context_capture_screen().
+ */
+void makas_capture_context_capture_screen_async(MakasCaptureContext *self, gboolean with_cursor, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+
+/**
+ * makas_capture_context_capture_screen_finish:
+ * @self: A #MakasCaptureContext.
+ * @result: The #GAsyncResult passed to the callback.
+ * @error: Return location for a #GError.
+ *
+ * Returns: (transfer full): A GdkPixbuf with the screenshot.
+ */
+GdkPixbuf *makas_capture_context_capture_screen_finish(MakasCaptureContext *self, GAsyncResult *result, GError **error);
+
+/**
+ * makas_capture_context_capture_screencopy:
+ * @self: A #MakasCaptureContext.
+ * @with_cursor: Whether to include the cursor in the screenshot.
+ *
+ * Captures the screen using the zwlr_screencopy_v1 protocol, reusing the
+ * connection of @self.
+ *
+ * Returns: (transfer full) (nullable): A GdkPixbuf with the screenshot, or NULL on failure.
+ */
+GdkPixbuf *makas_capture_context_capture_screencopy(MakasCaptureContext *self, gboolean with_cursor);
+
+/**
+ * makas_capture_context_capture_screencopy_async:
+ * @self: A #MakasCaptureContext.
+ * @with_cursor: Whether to include the cursor in the screenshot.
+ * @cancellable: (nullable): A #GCancellable.
+ * @callback: (scope async): Called when the screenshot is ready.
+ * @user_data: (closure): Data for @callback.
+ *
+ * Asynchronous version of makas_capture_context_capture_screencopy(). The
+ * Wayland round trips and the compositing run on a worker thread.
+ */
+void makas_capture_context_capture_screencopy_async(MakasCaptureContext *self, gboolean with_cursor, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+
+/**
+ * makas_capture_context_capture_screencopy_finish:
+ * @self: A #MakasCaptureContext.
+ * @result: The #GAsyncResult passed to the callback.
+ * @error: Return location for a #GError.
+ *
+ * Returns: (transfer full): A GdkPixbuf with the screenshot.
+ */
+GdkPixbuf *makas_capture_context_capture_screencopy_finish(MakasCaptureContext *self, GAsyncResult *result, GError **error);
+
+/**
+ * makas_capture_context_capture_ext_image_copy:
+ * @self: A #MakasCaptureContext.
+ * @with_cursor: Whether to include the cursor in the screenshot.
+ *
+ * Captures the screen using the ext_image_copy_capture_v1 protocol, reusing
+ * the connection of @self.
+ *
+ * Returns: (transfer full) (nullable): A GdkPixbuf with the screenshot, or NULL on failure.
+ */
+GdkPixbuf *makas_capture_context_capture_ext_image_copy(MakasCaptureContext *self, gboolean with_cursor);
+
+/**
+ * makas_capture_context_capture_ext_image_copy_async:
+ * @self: A #MakasCaptureContext.
+ * @with_cursor: Whether to include the cursor in the screenshot.
+ * @cancellable: (nullable): A #GCancellable.
+ * @callback: (scope async): Called when the screenshot is ready.
+ * @user_data: (closure): Data for @callback.
+ *
+ * Asynchronous version of makas_capture_context_capture_ext_image_copy().
+ */
+void makas_capture_context_capture_ext_image_copy_async(MakasCaptureContext *self, gboolean with_cursor, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+
+/**
+ * makas_capture_context_capture_ext_image_copy_finish:
+ * @self: A #MakasCaptureContext.
+ * @result: The #GAsyncResult passed to the callback.
+ * @error: Return location for a #GError.
+ *
+ * Returns: (transfer full): A GdkPixbuf with the screenshot.
+ */
+GdkPixbuf *makas_capture_context_capture_ext_image_copy_finish(MakasCaptureContext *self, GAsyncResult *result, GError **error);
+
+/**
+ * makas_capture_context_capture_region:
+ * @self: A #MakasCaptureContext.
+ * @x: X coordinate of the region in the logical output layout.
+ * @y: Y coordinate of the region in the logical output layout.
+ * @width: Width of the region in logical pixels.
+ * @height: Height of the region in logical pixels.
+ * @with_cursor: Whether to include the cursor in the screenshot.
+ *
+ * Captures only the given region. zwlr_screencopy_v1 is preferred since the
+ * compositor crops the frame, otherwise only the outputs intersecting the
+ * region are copied with ext_image_copy_capture_v1. Either one falls back to
+ * the other if the copy fails.
+ *
+ * Returns: (transfer full) (nullable): A GdkPixbuf with the region, or NULL on failure.
+ */
+GdkPixbuf *makas_capture_context_capture_region(MakasCaptureContext *self, gint x, gint y, gint width, gint height, gboolean with_cursor);
+
+/**
+ * makas_capture_context_capture_region_async:
+ * @self: A #MakasCaptureContext.
+ * @x: X coordinate of the region in the logical output layout.
+ * @y: Y coordinate of the region in the logical output layout.
+ * @width: Width of the region in logical pixels.
+ * @height: Height of the region in logical pixels.
+ * @with_cursor: Whether to include the cursor in the screenshot.
+ * @cancellable: (nullable): A #GCancellable.
+ * @callback: (scope async): Called when the screenshot is ready.
+ * @user_data: (closure): Data for @callback.
+ *
+ * Asynchronous version of makas_capture_context_capture_region().
+ */
+void makas_capture_context_capture_region_async(MakasCaptureContext *self, gint x, gint y, gint width, gint height, gboolean with_cursor, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+
+/**
+ * makas_capture_context_capture_region_finish:
+ * @self: A #MakasCaptureContext.
+ * @result: The #GAsyncResult passed to the callback.
+ * @error: Return location for a #GError.
+ *
+ * Returns: (transfer full): A GdkPixbuf with the region.
+ */
+GdkPixbuf *makas_capture_context_capture_region_finish(MakasCaptureContext *self, GAsyncResult *result, GError **error);
+
+/**
+ * makas_capture_context_capture_output:
+ * @self: A #MakasCaptureContext.
+ * @output_name: Name of the output, e.g. "DP-1".
+ * @with_cursor: Whether to include the cursor in the screenshot.
+ *
+ * Captures a single output at its own scale. The "output-name", "x" and "y"
+ * pixbuf options hold the output name and its logical position.
+ *
+ * Returns: (transfer full) (nullable): A GdkPixbuf with the output, or NULL on failure.
+ */
+GdkPixbuf *makas_capture_context_capture_output(MakasCaptureContext *self, const gchar *output_name, gboolean with_cursor);
+
+/**
+ * makas_capture_context_capture_output_async:
+ * @self: A #MakasCaptureContext.
+ * @output_name: Name of the output, e.g. "DP-1".
+ * @with_cursor: Whether to include the cursor in the screenshot.
+ * @cancellable: (nullable): A #GCancellable.
+ * @callback: (scope async): Called when the screenshot is ready.
+ * @user_data: (closure): Data for @callback.
+ *
+ * Asynchronous version of makas_capture_context_capture_output().
+ */
+void makas_capture_context_capture_output_async(MakasCaptureContext *self, const gchar *output_name, gboolean with_cursor, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+
+/**
+ * makas_capture_context_capture_output_finish:
+ * @self: A #MakasCaptureContext.
+ * @result: The #GAsyncResult passed to the callback.
+ * @error: Return location for a #GError.
+ *
+ * Returns: (transfer full): A GdkPixbuf with the output.
+ */
+GdkPixbuf *makas_capture_context_capture_output_finish(MakasCaptureContext *self, GAsyncResult *result, GError **error);
+
+/**
+ * makas_capture_context_capture_outputs:
+ * @self: A #MakasCaptureContext.
+ * @with_cursor: Whether to include the cursor in the screenshots.
+ *
+ * Captures every output into its own pixbuf at that output's scale, instead
+ * of compositing them into one canvas. Each pixbuf carries the same options
+ * as makas_capture_context_capture_output().
+ *
+ * Returns: (transfer full) (element-type GdkPixbuf) (nullable): The pixbufs, or NULL on failure.
+ */
+GPtrArray *makas_capture_context_capture_outputs(MakasCaptureContext *self, gboolean with_cursor);
+
+/**
+ * makas_capture_context_capture_outputs_async:
+ * @self: A #MakasCaptureContext.
+ * @with_cursor: Whether to include the cursor in the screenshots.
+ * @cancellable: (nullable): A #GCancellable.
+ * @callback: (scope async): Called when the screenshots are ready.
+ * @user_data: (closure): Data for @callback.
+ *
+ * Asynchronous version of makas_capture_context_capture_outputs().
+ */
+void makas_capture_context_capture_outputs_async(MakasCaptureContext *self, gboolean with_cursor, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+
+/**
+ * makas_capture_context_capture_outputs_finish:
+ * @self: A #MakasCaptureContext.
+ * @result: The #GAsyncResult passed to the callback.
+ * @error: Return location for a #GError.
+ *
+ * Returns: (transfer full) (element-type GdkPixbuf): The pixbufs.
+ */
+GPtrArray *makas_capture_context_capture_outputs_finish(MakasCaptureContext *self, GAsyncResult *result, GError **error);
+
+/**
+ * makas_capture_context_list_toplevels:
+ * @self: A #MakasCaptureContext.
+ *
+ * Lists the windows announced through ext_foreign_toplevel_list_v1. The list
+ * is kept up to date on the connection of @self, so this doesn't wait for
+ * the compositor.
+ *
+ * Returns: (transfer full): A GVariant of type a(sss) holding the identifier,
+ * app id and title of each window.
+ */
+GVariant *makas_capture_context_list_toplevels(MakasCaptureContext *self);
+
+/**
+ * makas_capture_context_capture_toplevel:
+ * @self: A #MakasCaptureContext.
+ * @identifier: Identifier of the window, from makas_capture_context_list_toplevels().
+ * @with_cursor: Whether to include the cursor in the screenshot.
+ *
+ * Captures a single window through an ext_foreign_toplevel image capture
+ * source. Only the window's own buffer is copied.
+ *
+ * Returns: (transfer full) (nullable): A GdkPixbuf with the window, or NULL on failure.
+ */
+GdkPixbuf *makas_capture_context_capture_toplevel(MakasCaptureContext *self, const gchar *identifier, gboolean with_cursor);
+
+/**
+ * makas_capture_context_capture_toplevel_async:
+ * @self: A #MakasCaptureContext.
+ * @identifier: Identifier of the window.
+ * @with_cursor: Whether to include the cursor in the screenshot.
+ * @cancellable: (nullable): A #GCancellable.
+ * @callback: (scope async): Called when the screenshot is ready.
+ * @user_data: (closure): Data for @callback.
+ *
+ * Asynchronous version of makas_capture_context_capture_toplevel().
+ */
+void makas_capture_context_capture_toplevel_async(MakasCaptureContext *self, const gchar *identifier, gboolean with_cursor, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+
+/**
+ * makas_capture_context_capture_toplevel_finish:
+ * @self: A #MakasCaptureContext.
+ * @result: The #GAsyncResult passed to the callback.
+ * @error: Return location for a #GError.
+ *
+ * Returns: (transfer full): A GdkPixbuf with the window.
+ */
+GdkPixbuf *makas_capture_context_capture_toplevel_finish(MakasCaptureContext *self, GAsyncResult *result, GError **error);
+
+/**
+ * makas_capture_context_capture_burst:
+ * @self: A #MakasCaptureContext.
+ * @n_frames: Number of screenshots to take.
+ * @interval: Milliseconds between two screenshots.
+ * @with_cursor: Whether to include the cursor in the screenshots.
+ *
+ * Takes @n_frames screenshots of the whole screen, @interval milliseconds
+ * apart. The ext-image-copy-capture (or screencopy) sessions stay open for the
+ * whole burst and only the damaged parts of each frame are re-rendered. A
+ * screenshot during which nothing changed is the same pixbuf as the previous
+ * one.
+ *
+ * Returns: (transfer full) (element-type GdkPixbuf) (nullable): The pixbufs, or NULL on failure.
+ */
+GPtrArray *makas_capture_context_capture_burst(MakasCaptureContext *self, guint n_frames, guint interval, gboolean with_cursor);
+
+/**
+ * makas_capture_context_capture_burst_async:
+ * @self: A #MakasCaptureContext.
+ * @n_frames: Number of screenshots to take.
+ * @interval: Milliseconds between two screenshots.
+ * @with_cursor: Whether to include the cursor in the screenshots.
+ * @cancellable: (nullable): A #GCancellable.
+ * @callback: (scope async): Called when the last screenshot is taken.
+ * @user_data: (closure): Data for @callback.
+ *
+ * Asynchronous version of makas_capture_context_capture_burst().
+ */
+void makas_capture_context_capture_burst_async(MakasCaptureContext *self, guint n_frames, guint interval, gboolean with_cursor, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+
+/**
+ * makas_capture_context_capture_burst_finish:
+ * @self: A #MakasCaptureContext.
+ * @result: The #GAsyncResult passed to the callback.
+ * @error: Return location for a #GError.
+ *
+ * Returns: (transfer full) (element-type GdkPixbuf): The pixbufs.
+ */
+GPtrArray *makas_capture_context_capture_burst_finish(MakasCaptureContext *self, GAsyncResult *result, GError **error);
+
+/**
+ * makas_capture_context_capture_stable:
+ * @self: A #MakasCaptureContext.
+ * @quiet: Milliseconds the screen must go without changes.
+ * @timeout: Milliseconds after which the screen is captured anyway.
+ * @with_cursor: Whether to include the cursor in the screenshot.
+ *
+ * Captures the screen once it settled, e.g. after a window finished its
+ * closing animation. Uses the damage reported by ext-image-copy-capture or
+ * screencopy; on compositors supporting neither, captures right away. Cursor
+ * movement counts as a change when @with_cursor is set.
+ *
+ * Returns: (transfer full) (nullable): A GdkPixbuf with the screenshot, or NULL on failure.
+ */
+GdkPixbuf *makas_capture_context_capture_stable(MakasCaptureContext *self, guint quiet, guint timeout, gboolean with_cursor);
+
+/**
+ * makas_capture_context_capture_stable_async:
+ * @self: A #MakasCaptureContext.
+ * @quiet: Milliseconds the screen must go without changes.
+ * @timeout: Milliseconds after which the screen is captured anyway.
+ * @with_cursor: Whether to include the cursor in the screenshot.
+ * @cancellable: (nullable): A #GCancellable.
+ * @callback: (scope async): Called when the screenshot is ready.
+ * @user_data: (closure): Data for @callback.
+ *
+ * Asynchronous version of makas_capture_context_capture_stable().
+ */
+void makas_capture_context_capture_stable_async(MakasCaptureContext *self, guint quiet, guint timeout, gboolean with_cursor, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+
+/**
+ * makas_capture_context_capture_stable_finish:
+ * @self: A #MakasCaptureContext.
+ * @result: The #GAsyncResult passed to the callback.
+ * @error: Return location for a #GError.
+ *
+ * Returns: (transfer full): A GdkPixbuf with the screenshot.
+ */
+GdkPixbuf *makas_capture_context_capture_stable_finish(MakasCaptureContext *self, GAsyncResult *result, GError **error);
+
+/**
+ * makas_capture_context_capture_to_fd:
+ * @self: A #MakasCaptureContext.
+ * @fd: A file descriptor open for writing, left open.
+ * @format: "png", "qoi", "pam" or "ppm", see makas_save_image_async().
+ * @level: zlib compression level for PNG, -1 for the default.
+ * @with_cursor: Whether to include the cursor in the screenshot.
+ * @cancellable: (nullable): A #GCancellable.
+ * @error: Return location for a #GError.
+ *
+ * Captures the screen and encodes the composited canvas straight into @fd,
+ * without a GdkPixbuf in between. Blocks, see
+ * makas_capture_context_capture_to_fd_async() for UI threads.
+ *
+ * Returns: TRUE if the whole image was written.
+ */
+gboolean makas_capture_context_capture_to_fd(MakasCaptureContext *self, gint fd, const gchar *format, gint level, gboolean with_cursor, GCancellable *cancellable, GError **error);
+
+/**
+ * makas_capture_context_capture_to_fd_async:
+ * @self: A #MakasCaptureContext.
+ * @fd: A file descriptor open for writing, must stay open until @callback.
+ * @format: "png", "qoi", "pam" or "ppm", see makas_save_image_async().
+ * @level: zlib compression level for PNG, -1 for the default.
+ * @with_cursor: Whether to include the cursor in the screenshot.
+ * @cancellable: (nullable): A #GCancellable.
+ * @callback: (scope async): Called once the image is written.
+ * @user_data: (closure): Data for @callback.
+ *
+ * Asynchronous version of makas_capture_context_capture_to_fd(). Capture and
+ * encoding both run on a worker thread, @fd is left open.
+ */
+void makas_capture_context_capture_to_fd_async(MakasCaptureContext *self, gint fd, const gchar *format, gint level, gboolean with_cursor, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+
+/**
+ * makas_capture_context_capture_to_fd_finish:
+ * @self: A #MakasCaptureContext.
+ * @result: The #GAsyncResult passed to the callback.
+ * @error: Return location for a #GError.
+ *
+ * Returns: TRUE if the whole image was written.
+ */
+gboolean makas_capture_context_capture_to_fd_finish(MakasCaptureContext *self, GAsyncResult *result, GError **error);
+
+/**
+ * makas_capture_context_capture_to_file:
+ * @self: A #MakasCaptureContext.
+ * @filename: Path of the file to write.
+ * @format: "png", "qoi", "pam" or "ppm", see makas_save_image_async().
+ * @level: zlib compression level for PNG, -1 for the default.
+ * @with_cursor: Whether to include the cursor in the screenshot.
+ * @cancellable: (nullable): A #GCancellable.
+ * @error: Return location for a #GError.
+ *
+ * Like makas_capture_context_capture_to_fd(), but replaces @filename once the
+ * image is complete.
+ *
+ * Returns: TRUE if the file was written.
+ */
+gboolean makas_capture_context_capture_to_file(MakasCaptureContext *self, const gchar *filename, const gchar *format, gint level, gboolean with_cursor, GCancellable *cancellable, GError **error);
+
+/**
+ * makas_capture_context_capture_to_file_async:
+ * @self: A #MakasCaptureContext.
+ * @filename: Path of the file to write.
+ * @format: "png", "qoi", "pam" or "ppm", see makas_save_image_async().
+ * @level: zlib compression level for PNG, -1 for the default.
+ * @with_cursor: Whether to include the cursor in the screenshot.
+ * @cancellable: (nullable): A #GCancellable.
+ * @callback: (scope async): Called once the file is written.
+ * @user_data: (closure): Data for @callback.
+ *
+ * Asynchronous version of makas_capture_context_capture_to_file(). Capture and
+ * encoding both run on a worker thread.
+ */
+void makas_capture_context_capture_to_file_async(MakasCaptureContext *self, const gchar *filename, const gchar *format, gint level, gboolean with_cursor, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+
+/**
+ * makas_capture_context_capture_to_file_finish:
+ * @self: A #MakasCaptureContext.
+ * @result: The #GAsyncResult passed to the callback.
+ * @error: Return location for a #GError.
+ *
+ * Returns: TRUE if the file was written.
+ */
+gboolean makas_capture_context_capture_to_file_finish(MakasCaptureContext *self, GAsyncResult *result, GError **error);
+
+/**
+ * makas_capture_screen:
+ * @with_cursor: Whether to include the cursor in the screenshot.
+ *
+ * Captures the screen with the best available protocol and the default
+ * capture context.
+ *
+ * Returns: (transfer full) (nullable): A GdkPixbuf with the screenshot, or NULL on failure.
+ */
+GdkPixbuf *makas_capture_screen(gboolean with_cursor);
+
 /**
  * makas_capture_screencopy:
  * @with_cursor: Whether to include the cursor in the screenshot.
  *
- * Captures the screen using the zwlr_screencopy_v1 protocol.
+ * Captures the screen using the zwlr_screencopy_v1 protocol and the default
+ * capture context.
  *
  * Returns: (transfer full) (nullable): A GdkPixbuf with the screenshot, or NULL on failure.
  */
@@ -20,12 +510,124 @@ GdkPixbuf *makas_capture_screencopy(gboolean with_cursor);
  * makas_capture_ext_image_copy:
  * @with_cursor: Whether to include the cursor in the screenshot.
  *
- * Captures the screen using the ext_image_copy_capture_v1 protocol.
+ * Captures the screen using the ext_image_copy_capture_v1 protocol and the
+ * default capture context.
  *
  * Returns: (transfer full) (nullable): A GdkPixbuf with the screenshot, or NULL on failure.
  */
 GdkPixbuf *makas_capture_ext_image_copy(gboolean with_cursor);
 
+/**
+ * makas_capture_region:
+ * @x: X coordinate of the region in the logical output layout.
+ * @y: Y coordinate of the region in the logical output layout.
+ * @width: Width of the region in logical pixels.
+ * @height: Height of the region in logical pixels.
+ * @with_cursor: Whether to include the cursor in the screenshot.
+ *
+ * Captures a region of the screen with the default capture context.
+ *
+ * Returns: (transfer full) (nullable): A GdkPixbuf with the region, or NULL on failure.
+ */
+GdkPixbuf *makas_capture_region(gint x, gint y, gint width, gint height, gboolean with_cursor);
+
+/**
+ * makas_capture_output:
+ * @output_name: Name of the output, e.g. "DP-1".
+ * @with_cursor: Whether to include the cursor in the screenshot.
+ *
+ * Captures a single output with the default capture context.
+ *
+ * Returns: (transfer full) (nullable): A GdkPixbuf with the output, or NULL on failure.
+ */
+GdkPixbuf *makas_capture_output(const gchar *output_name, gboolean with_cursor);
+
+/**
+ * makas_capture_outputs:
+ * @with_cursor: Whether to include the cursor in the screenshots.
+ *
+ * Captures every output separately with the default capture context.
+ *
+ * Returns: (transfer full) (element-type GdkPixbuf) (nullable): The pixbufs, or NULL on failure.
+ */
+GPtrArray *makas_capture_outputs(gboolean with_cursor);
+
+/**
+ * makas_capture_list_toplevels:
+ *
+ * Lists the windows with the default capture context.
+ *
+ * Returns: (transfer full): A GVariant of type a(sss), see makas_capture_context_list_toplevels().
+ */
+GVariant *makas_capture_list_toplevels(void);
+
+/**
+ * makas_capture_toplevel:
+ * @identifier: Identifier of the window.
+ * @with_cursor: Whether to include the cursor in the screenshot.
+ *
+ * Captures a single window with the default capture context.
+ *
+ * Returns: (transfer full) (nullable): A GdkPixbuf with the window, or NULL on failure.
+ */
+GdkPixbuf *makas_capture_toplevel(const gchar *identifier, gboolean with_cursor);
+
+/**
+ * makas_capture_burst:
+ * @n_frames: Number of screenshots to take.
+ * @interval: Milliseconds between two screenshots.
+ * @with_cursor: Whether to include the cursor in the screenshots.
+ *
+ * Takes a burst of screenshots with the default capture context, see
+ * makas_capture_context_capture_burst().
+ *
+ * Returns: (transfer full) (element-type GdkPixbuf) (nullable): The pixbufs, or NULL on failure.
+ */
+GPtrArray *makas_capture_burst(guint n_frames, guint interval, gboolean with_cursor);
+
+/**
+ * makas_capture_stable:
+ * @quiet: Milliseconds the screen must go without changes.
+ * @timeout: Milliseconds after which the screen is captured anyway.
+ * @with_cursor: Whether to include the cursor in the screenshot.
+ *
+ * Captures the screen once it settled with the default capture context, see
+ * makas_capture_context_capture_stable().
+ *
+ * Returns: (transfer full) (nullable): A GdkPixbuf with the screenshot, or NULL on failure.
+ */
+GdkPixbuf *makas_capture_stable(guint quiet, guint timeout, gboolean with_cursor);
+
+/**
+ * makas_capture_to_fd:
+ * @fd: A file descriptor open for writing, left open.
+ * @format: "png", "qoi", "pam" or "ppm".
+ * @level: zlib compression level for PNG, -1 for the default.
+ * @with_cursor: Whether to include the cursor in the screenshot.
+ * @error: Return location for a #GError.
+ *
+ * Captures the screen into @fd with the default capture context, see
+ * makas_capture_context_capture_to_fd().
+ *
+ * Returns: TRUE if the whole image was written.
+ */
+gboolean makas_capture_to_fd(gint fd, const gchar *format, gint level, gboolean with_cursor, GError **error);
+
+/**
+ * makas_capture_to_file:
+ * @filename: Path of the file to write.
+ * @format: "png", "qoi", "pam" or "ppm".
+ * @level: zlib compression level for PNG, -1 for the default.
+ * @with_cursor: Whether to include the cursor in the screenshot.
+ * @error: Return location for a #GError.
+ *
+ * Captures the screen into @filename with the default capture context, see
+ * makas_capture_context_capture_to_file().
+ *
+ * Returns: TRUE if the file was written.
+ */
+gboolean makas_capture_to_file(const gchar *filename, const gchar *format, gint level, gboolean with_cursor, GError **error);
+
 G_END_DECLS
 
 #endif /* MAKAS_GRIM_H */
@@ -0,0 +1,95 @@
+#include "makas-load.h"
+
+// Bytes handed to the loader at a time
+#define LOAD_CHUNK (256 * 1024)
+
+typedef struct {
+  gchar *filename;
+  gboolean remove;
+} LoadData;
+
+static void load_data_free(LoadData *data) {
+  g_free(data->filename);
+  g_free(data);
+}
+
+static GdkPixbuf *load_stream(GInputStream *in, GCancellable *cancellable,
+                              GError **error) {
+  g_autoptr(GdkPixbufLoader) loader = gdk_pixbuf_loader_new();
+  g_autofree guint8 *buffer = g_malloc(LOAD_CHUNK);
+
+  for (;;) {
+    gssize n = g_input_stream_read(in, buffer, LOAD_CHUNK, cancellable, error);
+    if (n < 0) {
+      // The loader complains when closed before the image is complete
+      gdk_pixbuf_loader_close(loader, NULL);
+      return NULL;
+    }
+    if (n == 0) {
+      break;
+    }
+    if (!gdk_pixbuf_loader_write(loader, buffer, n, error)) {
+      gdk_pixbuf_loader_close(loader, NULL);
+      return NULL;
+    }
+  }
+
+  if (!gdk_pixbuf_loader_close(loader, error)) {
+    return NULL;
+  }
+
+  GdkPixbuf *pixbuf = gdk_pixbuf_loader_get_pixbuf(loader);
+  if (!pixbuf) {
+    g_set_error_literal(error, GDK_PIXBUF_ERROR, GDK_PIXBUF_ERROR_FAILED,
+                        "Image holds no pixels");
+    return NULL;
+  }
+
+  return g_object_ref(pixbuf);
+}
+
+static void load_image_thread(GTask *task, gpointer source_object,
+                              gpointer task_data, GCancellable *cancellable) {
+  LoadData *data = task_data;
+  g_autoptr(GFile) file = g_file_new_for_path(data->filename);
+  GError *error = NULL;
+  GdkPixbuf *pixbuf = NULL;
+
+  g_autoptr(GFileInputStream) in = g_file_read(file, cancellable, &error);
+  if (in) {
+    pixbuf = load_stream(G_INPUT_STREAM(in), cancellable, &error);
+  }
+
+  if (data->remove) {
+    g_file_delete(file, NULL, NULL);
+  }
+
+  if (!pixbuf) {
+    g_task_return_error(task, error);
+    return;
+  }
+
+  g_task_return_pointer(task, pixbuf, g_object_unref);
+}
+
+void makas_load_image_async(const gchar *filename, gboolean remove,
+                            GCancellable *cancellable,
+                            GAsyncReadyCallback callback, gpointer user_data) {
+  g_return_if_fail(filename != NULL);
+
+  LoadData *data = g_new0(LoadData, 1);
+  data->filename = g_strdup(filename);
+  data->remove = remove;
+
+  GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+  g_task_set_source_tag(task, makas_load_image_async);
+  g_task_set_task_data(task, data, (GDestroyNotify)load_data_free);
+  g_task_run_in_thread(task, load_image_thread);
+  g_object_unref(task);
+}
+
+GdkPixbuf *makas_load_image_finish(GAsyncResult *result, GError **error) {
+  g_return_val_if_fail(g_task_is_valid(result, NULL), NULL);
+
+  return g_task_propagate_pointer(G_TASK(result), error);
+}
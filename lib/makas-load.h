@@ -0,0 +1,35 @@
+#ifndef MAKAS_LOAD_H
+#define MAKAS_LOAD_H
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <gio/gio.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * makas_load_image_async:
+ * @filename: Path of the image to read.
+ * @remove: Delete @filename once it was read, whether or not it decoded.
+ * @cancellable: (nullable): A #GCancellable.
+ * @callback: (scope async): Called once the image is decoded.
+ * @user_data: (closure): Data for @callback.
+ *
+ * Reads @filename on a worker thread and feeds it to a #GdkPixbufLoader as
+ * the chunks arrive, so decoding overlaps the reads. Meant for the files the
+ * Shell and the portal hand over, @remove cleans them up off the main thread.
+ */
+void makas_load_image_async(const gchar *filename, gboolean remove, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+
+/**
+ * makas_load_image_finish:
+ * @result: The #GAsyncResult passed to the callback.
+ * @error: Return location for a #GError.
+ *
+ * Returns: (transfer full): The decoded #GdkPixbuf, or %NULL on error.
+ */
+GdkPixbuf *makas_load_image_finish(GAsyncResult *result, GError **error);
+
+G_END_DECLS
+
+#endif /* MAKAS_LOAD_H */
@@ -0,0 +1,200 @@
+#define _GNU_SOURCE
+#include "makas-memfd.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <gio/gio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MEMFD_MAGIC "MKSURF1"
+// Pixel rows start here, past the header and aligned for cairo
+#define MEMFD_DATA_OFFSET 64
+#define MEMFD_REQUIRED_SEALS (F_SEAL_SHRINK | F_SEAL_WRITE)
+
+// Both ends are the same machine, so fields are in host byte order
+typedef struct {
+  gchar magic[8];
+  guint32 width;
+  guint32 height;
+  guint32 stride;
+  guint32 format;
+} MemfdHeader;
+
+G_STATIC_ASSERT(sizeof(MemfdHeader) <= MEMFD_DATA_OFFSET);
+
+typedef struct {
+  gpointer base;
+  gsize size;
+} MemfdMapping;
+
+static const cairo_user_data_key_t mapping_key;
+
+static void set_error_from_errno(GError **error, const gchar *what) {
+  int errsv = errno;
+  g_set_error(error, G_IO_ERROR, g_io_error_from_errno(errsv), "%s: %s", what,
+              g_strerror(errsv));
+}
+
+/* Straight RGB(A) to premultiplied native endian ARGB32, the layout
+ * gdk_cairo_surface_create_from_pixbuf() produces */
+static void convert_row(const guint8 *src, guint32 *dst, gint width,
+                        gint n_channels) {
+  if (n_channels == 3) {
+    for (gint x = 0; x < width; x++, src += 3) {
+      dst[x] = 0xff000000 | src[0] << 16 | src[1] << 8 | src[2];
+    }
+    return;
+  }
+
+  for (gint x = 0; x < width; x++, src += 4) {
+    guint a = src[3];
+    if (a == 0xff) {
+      dst[x] = 0xff000000 | src[0] << 16 | src[1] << 8 | src[2];
+    } else if (a == 0) {
+      dst[x] = 0;
+    } else {
+      guint r = (src[0] * a + 127) / 255;
+      guint g = (src[1] * a + 127) / 255;
+      guint b = (src[2] * a + 127) / 255;
+      dst[x] = a << 24 | r << 16 | g << 8 | b;
+    }
+  }
+}
+
+gint makas_memfd_export_pixbuf(GdkPixbuf *pixbuf, GError **error) {
+  g_return_val_if_fail(GDK_IS_PIXBUF(pixbuf), -1);
+  g_return_val_if_fail(gdk_pixbuf_get_bits_per_sample(pixbuf) == 8, -1);
+
+  gint width = gdk_pixbuf_get_width(pixbuf);
+  gint height = gdk_pixbuf_get_height(pixbuf);
+  gint n_channels = gdk_pixbuf_get_n_channels(pixbuf);
+  gint src_stride = gdk_pixbuf_get_rowstride(pixbuf);
+  const guint8 *src = gdk_pixbuf_read_pixels(pixbuf);
+
+  gint stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, width);
+  if (stride < 0) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                "Image too wide to export: %d", width);
+    return -1;
+  }
+  gsize size = MEMFD_DATA_OFFSET + (gsize)stride * height;
+
+  int fd = memfd_create("makas-surface", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd < 0) {
+    set_error_from_errno(error, "Failed to create memfd");
+    return -1;
+  }
+
+  if (ftruncate(fd, size) < 0) {
+    set_error_from_errno(error, "Failed to size memfd");
+    close(fd);
+    return -1;
+  }
+
+  guint8 *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) {
+    set_error_from_errno(error, "Failed to map memfd");
+    close(fd);
+    return -1;
+  }
+
+  MemfdHeader header = {
+      .magic = MEMFD_MAGIC,
+      .width = width,
+      .height = height,
+      .stride = stride,
+      .format = CAIRO_FORMAT_ARGB32,
+  };
+  memcpy(base, &header, sizeof(header));
+
+  guint8 *dst = base + MEMFD_DATA_OFFSET;
+  for (gint y = 0; y < height; y++) {
+    convert_row(src + (gsize)y * src_stride, (guint32 *)(dst + (gsize)y * stride),
+                width, n_channels);
+  }
+
+  // F_SEAL_WRITE is refused while a writable shared mapping exists
+  munmap(base, size);
+
+  if (fcntl(fd, F_ADD_SEALS,
+            F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) < 0) {
+    set_error_from_errno(error, "Failed to seal memfd");
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+static void free_mapping(gpointer data) {
+  MemfdMapping *mapping = data;
+  munmap(mapping->base, mapping->size);
+  g_free(mapping);
+}
+
+cairo_surface_t *makas_memfd_import_surface(gint fd, GError **error) {
+  // Without these seals the sender could truncate the file under our
+  // mapping, and drawing would SIGBUS
+  int seals = fcntl(fd, F_GET_SEALS);
+  if (seals < 0) {
+    set_error_from_errno(error, "Failed to query memfd seals");
+    return NULL;
+  }
+  if ((seals & MEMFD_REQUIRED_SEALS) != MEMFD_REQUIRED_SEALS) {
+    g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_PERMISSION_DENIED,
+                        "memfd is not sealed against writes and shrinking");
+    return NULL;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    set_error_from_errno(error, "Failed to stat memfd");
+    return NULL;
+  }
+
+  MemfdHeader header;
+  if (st.st_size < MEMFD_DATA_OFFSET ||
+      pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+      memcmp(header.magic, MEMFD_MAGIC, sizeof(header.magic)) != 0 ||
+      header.format != CAIRO_FORMAT_ARGB32 || header.width == 0 ||
+      header.height == 0 || header.width > G_MAXINT ||
+      header.height > G_MAXINT ||
+      (gint)header.stride != cairo_format_stride_for_width(
+                                 CAIRO_FORMAT_ARGB32, header.width) ||
+      (guint64)(st.st_size - MEMFD_DATA_OFFSET) / header.stride <
+          header.height) {
+    g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                        "memfd does not hold an exported surface");
+    return NULL;
+  }
+
+  gsize size = MEMFD_DATA_OFFSET + (gsize)header.stride * header.height;
+  guint8 *base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) {
+    set_error_from_errno(error, "Failed to map memfd");
+    return NULL;
+  }
+
+  // Only ever used as a source, cairo won't write through the pointer
+  cairo_surface_t *surface = cairo_image_surface_create_for_data(
+      base + MEMFD_DATA_OFFSET, CAIRO_FORMAT_ARGB32, header.width,
+      header.height, header.stride);
+
+  MemfdMapping *mapping = g_new(MemfdMapping, 1);
+  mapping->base = base;
+  mapping->size = size;
+  if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS ||
+      cairo_surface_set_user_data(surface, &mapping_key, mapping,
+                                  free_mapping) != CAIRO_STATUS_SUCCESS) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                "Failed to wrap memfd: %s",
+                cairo_status_to_string(cairo_surface_status(surface)));
+    cairo_surface_destroy(surface);
+    free_mapping(mapping);
+    return NULL;
+  }
+
+  return surface;
+}
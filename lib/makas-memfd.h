@@ -0,0 +1,40 @@
+#ifndef MAKAS_MEMFD_H
+#define MAKAS_MEMFD_H
+
+#include <cairo.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * makas_memfd_export_pixbuf:
+ * @pixbuf: The #GdkPixbuf to export, 8 bits per sample.
+ * @error: Return location for a #GError.
+ *
+ * Copies @pixbuf into an anonymous memfd, behind a small header, as
+ * premultiplied CAIRO_FORMAT_ARGB32 rows. The memfd is sealed against writes
+ * and resizes, so a process it is handed to can map it without copying and
+ * without trusting the sender. Hand the descriptor to a child with
+ * g_subprocess_launcher_take_fd().
+ *
+ * Returns: The memfd, owned by the caller, or -1 on error.
+ */
+gint makas_memfd_export_pixbuf(GdkPixbuf *pixbuf, GError **error);
+
+/**
+ * makas_memfd_import_surface:
+ * @fd: A memfd written by makas_memfd_export_pixbuf().
+ * @error: Return location for a #GError.
+ *
+ * Maps @fd read-only and wraps the pixels in a cairo image surface, nothing
+ * is decoded or copied. The mapping is released with the surface, @fd can be
+ * closed right away. Fails if @fd is not sealed.
+ *
+ * Returns: (transfer full): The surface, or %NULL on error.
+ */
+cairo_surface_t *makas_memfd_import_surface(gint fd, GError **error);
+
+G_END_DECLS
+
+#endif /* MAKAS_MEMFD_H */
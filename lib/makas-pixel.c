@@ -0,0 +1,115 @@
+#include "makas-pixel.h"
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MAKAS_PIXEL_X86 1
+#include <immintrin.h>
+#endif
+
+typedef void (*swizzle_row_func)(const uint8_t *src, uint8_t *dst,
+	size_t n_pixels, uint32_t alpha);
+
+/* --- Portable Kernel --- */
+
+static inline uint32_t swizzle_pixel(uint32_t pixel, uint32_t alpha) {
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+	// 0xAARRGGBB -> bytes R, G, B, A == 0xAABBGGRR
+	return (pixel & 0xff00ff00) | ((pixel >> 16) & 0xff) |
+		((pixel & 0xff) << 16) | alpha;
+#else
+	// 0xAARRGGBB -> bytes R, G, B, A == 0xRRGGBBAA
+	return (pixel << 8) | (pixel >> 24) | alpha;
+#endif
+}
+
+static void swizzle_row_scalar(const uint8_t *src, uint8_t *dst,
+		size_t n_pixels, uint32_t alpha) {
+	for (size_t i = 0; i < n_pixels; i++) {
+		uint32_t pixel;
+		memcpy(&pixel, src + i * 4, sizeof(pixel));
+		pixel = swizzle_pixel(pixel, alpha);
+		memcpy(dst + i * 4, &pixel, sizeof(pixel));
+	}
+}
+
+/* --- x86 Kernels --- */
+
+#if MAKAS_PIXEL_X86 && G_BYTE_ORDER == G_LITTLE_ENDIAN
+
+__attribute__((target("sse2")))
+static void swizzle_row_sse2(const uint8_t *src, uint8_t *dst,
+		size_t n_pixels, uint32_t alpha) {
+	// SSE2 has no byte shuffle, swap R and B with shifts and masks
+	const __m128i mask_ag = _mm_set1_epi32(0xff00ff00);
+	const __m128i mask_b = _mm_set1_epi32(0x000000ff);
+	const __m128i alpha_v = _mm_set1_epi32((int)alpha);
+
+	size_t i = 0;
+	for (; i + 4 <= n_pixels; i += 4) {
+		__m128i p = _mm_loadu_si128((const __m128i *)(src + i * 4));
+		__m128i ag = _mm_and_si128(p, mask_ag);
+		__m128i r = _mm_and_si128(_mm_srli_epi32(p, 16), mask_b);
+		__m128i b = _mm_slli_epi32(_mm_and_si128(p, mask_b), 16);
+		p = _mm_or_si128(_mm_or_si128(ag, r), _mm_or_si128(b, alpha_v));
+		_mm_storeu_si128((__m128i *)(dst + i * 4), p);
+	}
+
+	swizzle_row_scalar(src + i * 4, dst + i * 4, n_pixels - i, alpha);
+}
+
+__attribute__((target("avx2")))
+static void swizzle_row_avx2(const uint8_t *src, uint8_t *dst,
+		size_t n_pixels, uint32_t alpha) {
+	const __m256i shuffle = _mm256_setr_epi8(
+		2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+		2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+	const __m256i alpha_v = _mm256_set1_epi32((int)alpha);
+
+	size_t i = 0;
+	for (; i + 8 <= n_pixels; i += 8) {
+		__m256i p = _mm256_loadu_si256((const __m256i *)(src + i * 4));
+		p = _mm256_or_si256(_mm256_shuffle_epi8(p, shuffle), alpha_v);
+		_mm256_storeu_si256((__m256i *)(dst + i * 4), p);
+	}
+
+	swizzle_row_scalar(src + i * 4, dst + i * 4, n_pixels - i, alpha);
+}
+
+#endif
+
+/* --- Kernel Selection --- */
+
+static swizzle_row_func get_swizzle_row_func(void) {
+	static gsize func = 0;
+
+	if (g_once_init_enter(&func)) {
+		swizzle_row_func selected = swizzle_row_scalar;
+#if MAKAS_PIXEL_X86 && G_BYTE_ORDER == G_LITTLE_ENDIAN
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) {
+			selected = swizzle_row_avx2;
+		} else if (__builtin_cpu_supports("sse2")) {
+			selected = swizzle_row_sse2;
+		}
+#endif
+		g_once_init_leave(&func, (gsize)selected);
+	}
+
+	return (swizzle_row_func)func;
+}
+
+void makas_pixel_xrgb_to_rgba(const guint8 *src, gsize src_stride,
+		guint8 *dst, gsize dst_stride, gint width, gint height, gboolean opaque) {
+	swizzle_row_func swizzle_row = get_swizzle_row_func();
+	// Alpha bits in the layout of the swizzled pixel
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+	uint32_t alpha = opaque ? 0xff000000 : 0;
+#else
+	uint32_t alpha = opaque ? 0x000000ff : 0;
+#endif
+
+	for (gint y = 0; y < height; y++) {
+		swizzle_row(src + y * src_stride, dst + y * dst_stride, width, alpha);
+	}
+}
@@ -0,0 +1,32 @@
+#ifndef MAKAS_PIXEL_H
+#define MAKAS_PIXEL_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Internal pixel conversion helpers shared by the Wayland and X11 capture
+ * paths. Not part of the introspected API.
+ */
+
+/**
+ * makas_pixel_xrgb_to_rgba:
+ * @src: Rows of native endian 32-bit (A|X)RGB pixels.
+ * @src_stride: Byte stride of @src.
+ * @dst: Destination rows in GdkPixbuf R, G, B, A byte order.
+ * @dst_stride: Byte stride of @dst.
+ * @width: Number of pixels per row.
+ * @height: Number of rows.
+ * @opaque: Whether to force alpha to 0xff (for XRGB sources).
+ *
+ * Swizzles @src into @dst using the fastest kernel the CPU supports.
+ * @src and @dst may point to the same memory when the strides match.
+ */
+G_GNUC_INTERNAL
+void makas_pixel_xrgb_to_rgba(const guint8 *src, gsize src_stride,
+		guint8 *dst, gsize dst_stride, gint width, gint height, gboolean opaque);
+
+G_END_DECLS
+
+#endif /* MAKAS_PIXEL_H */
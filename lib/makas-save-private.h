@@ -0,0 +1,53 @@
+#ifndef MAKAS_SAVE_PRIVATE_H
+#define MAKAS_SAVE_PRIVATE_H
+
+#include <gio/gio.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Encoder entry points for pixels that are not in a GdkPixbuf, e.g. the
+ * Wayland canvas. Not part of the introspected API.
+ */
+
+/**
+ * makas_save_write_stream:
+ * @out: The #GOutputStream to write to.
+ * @pixels: Rows of 8-bit R, G, B(, A) pixels.
+ * @stride: Byte stride of @pixels.
+ * @width: Number of pixels per row.
+ * @height: Number of rows.
+ * @n_channels: 3 or 4.
+ * @format: "png", "qoi", "pam" or "ppm".
+ * @level: zlib compression level for PNG.
+ * @cancellable: (nullable): A #GCancellable.
+ * @error: Return location for a #GError.
+ *
+ * Encodes the pixels into @out on the calling thread, PNG bands are deflated
+ * on a thread pool. @out is left open.
+ *
+ * Returns: TRUE if everything was written.
+ */
+G_GNUC_INTERNAL
+gboolean makas_save_write_stream(GOutputStream *out, const guint8 *pixels,
+		gsize stride, guint width, guint height, guint n_channels,
+		const gchar *format, gint level, GCancellable *cancellable, GError **error);
+
+/**
+ * makas_save_write_file:
+ * @filename: Path of the file to write.
+ *
+ * Like makas_save_write_stream(), but replaces @filename once the image is
+ * complete. A failed write leaves @filename untouched.
+ *
+ * Returns: TRUE if the file was written.
+ */
+G_GNUC_INTERNAL
+gboolean makas_save_write_file(const gchar *filename, const guint8 *pixels,
+		gsize stride, guint width, guint height, guint n_channels,
+		const gchar *format, gint level, GCancellable *cancellable, GError **error);
+
+G_END_DECLS
+
+#endif /* MAKAS_SAVE_PRIVATE_H */
@@ -0,0 +1,581 @@
+#include "makas-save.h"
+#include "makas-save-private.h"
+#include <string.h>
+#include <zlib.h>
+
+// Filtered row data compressed by one job, about the block size of pigz
+#define PNG_BAND_BYTES (128 * 1024)
+// Output is grown by this much while deflating a band
+#define DEFLATE_CHUNK (64 * 1024)
+
+static const guint8 png_signature[8] = {0x89, 'P', 'N', 'G',
+                                        '\r', '\n', 0x1a, '\n'};
+
+/* Tightly described 8-bit RGB or RGBA pixels, read only */
+typedef struct {
+  const guint8 *pixels;
+  gsize stride;
+  guint width;
+  guint height;
+  guint n_channels;
+} SaveImage;
+
+/* A run of rows deflated on its own. Bands end on a byte boundary with a sync
+ * flush, so their raw deflate streams concatenate into one zlib stream. */
+typedef struct {
+  guint first_row;
+  guint n_rows;
+  // Raw deflate data, NULL until the band is done
+  GByteArray *data;
+  guint32 adler;
+  gsize length;
+  gboolean failed;
+} PngBand;
+
+typedef struct {
+  const SaveImage *image;
+  gint level;
+  PngBand *bands;
+  guint n_bands;
+  GMutex mutex;
+  GCond cond;
+  gint aborted;
+} PngEncoder;
+
+static void write_be32(guint8 *out, guint32 value) {
+  out[0] = value >> 24;
+  out[1] = value >> 16;
+  out[2] = value >> 8;
+  out[3] = value;
+}
+
+/* PNG "Up" filter. Cheap, and screen content repeats a lot vertically. */
+static void filter_row(const SaveImage *image, guint row, guint8 *out) {
+  gsize row_bytes = (gsize)image->width * image->n_channels;
+  const guint8 *pixels = image->pixels + row * image->stride;
+
+  out[0] = 2;
+  if (row == 0) {
+    memcpy(out + 1, pixels, row_bytes);
+    return;
+  }
+
+  const guint8 *prev = pixels - image->stride;
+  for (gsize i = 0; i < row_bytes; i++)
+    out[i + 1] = pixels[i] - prev[i];
+}
+
+static gboolean deflate_into(z_stream *stream, GByteArray *out, int flush) {
+  int ret;
+
+  do {
+    gsize used = out->len;
+    g_byte_array_set_size(out, used + DEFLATE_CHUNK);
+    stream->next_out = out->data + used;
+    stream->avail_out = DEFLATE_CHUNK;
+
+    ret = deflate(stream, flush);
+    g_byte_array_set_size(out, used + DEFLATE_CHUNK - stream->avail_out);
+    if (ret == Z_STREAM_ERROR)
+      return FALSE;
+  } while (stream->avail_out == 0);
+
+  return flush != Z_FINISH || ret == Z_STREAM_END;
+}
+
+static void compress_band(gpointer data, gpointer user_data) {
+  PngEncoder *encoder = user_data;
+  PngBand *band = &encoder->bands[GPOINTER_TO_UINT(data) - 1];
+  const SaveImage *image = encoder->image;
+  gboolean last = band == &encoder->bands[encoder->n_bands - 1];
+  gsize filtered_bytes = (gsize)image->width * image->n_channels + 1;
+  g_autofree guint8 *filtered = NULL;
+  GByteArray *out = NULL;
+  z_stream stream = {0};
+  gboolean ok = FALSE;
+
+  if (g_atomic_int_get(&encoder->aborted))
+    goto done;
+
+  // Raw deflate, the zlib header and trailer are written once around all bands
+  if (deflateInit2(&stream, encoder->level, Z_DEFLATED, -MAX_WBITS, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK)
+    goto done;
+
+  filtered = g_malloc(filtered_bytes);
+  guint32 adler = adler32(0, NULL, 0);
+  out = g_byte_array_sized_new(DEFLATE_CHUNK);
+  ok = TRUE;
+
+  for (guint i = 0; i < band->n_rows && ok; i++) {
+    filter_row(image, band->first_row + i, filtered);
+    adler = adler32(adler, filtered, filtered_bytes);
+
+    stream.next_in = filtered;
+    stream.avail_in = filtered_bytes;
+    int flush = i + 1 < band->n_rows ? Z_NO_FLUSH
+                : last               ? Z_FINISH
+                                     : Z_SYNC_FLUSH;
+    ok = deflate_into(&stream, out, flush);
+  }
+  deflateEnd(&stream);
+
+  band->adler = adler;
+  band->length = filtered_bytes * band->n_rows;
+
+done:
+  g_mutex_lock(&encoder->mutex);
+  if (ok) {
+    band->data = out;
+  } else {
+    band->failed = TRUE;
+    if (out)
+      g_byte_array_unref(out);
+  }
+  g_cond_broadcast(&encoder->cond);
+  g_mutex_unlock(&encoder->mutex);
+}
+
+static gboolean write_chunk(GOutputStream *out, const gchar *type,
+                            const guint8 *data, gsize length,
+                            GCancellable *cancellable, GError **error) {
+  guint8 header[8], trailer[4];
+  guint32 crc = crc32(0, (const Bytef *)type, 4);
+
+  if (length > 0)
+    crc = crc32(crc, data, length);
+  write_be32(header, length);
+  memcpy(header + 4, type, 4);
+  write_be32(trailer, crc);
+
+  return g_output_stream_write_all(out, header, sizeof(header), NULL,
+                                   cancellable, error) &&
+         (length == 0 || g_output_stream_write_all(out, data, length, NULL,
+                                                   cancellable, error)) &&
+         g_output_stream_write_all(out, trailer, sizeof(trailer), NULL,
+                                   cancellable, error);
+}
+
+static guint8 zlib_level_flags(gint level) {
+  // FLEVEL of the zlib header, informational only
+  guint8 flags = level == Z_DEFAULT_COMPRESSION ? 2
+                 : level < 2                    ? 0
+                 : level < 6                    ? 1
+                 : level == 6                   ? 2
+                                                : 3;
+  flags <<= 6;
+  return flags + 31 - ((0x78 * 256 + flags) % 31);
+}
+
+/* Writes @image as a PNG. Row bands are deflated in parallel and each one goes
+ * out as an IDAT chunk as soon as the bands before it are written. */
+static gboolean write_png(GOutputStream *out, const SaveImage *image,
+                          gint level, GCancellable *cancellable,
+                          GError **error) {
+  gsize filtered_bytes = (gsize)image->width * image->n_channels + 1;
+  guint rows_per_band = MAX(1, PNG_BAND_BYTES / filtered_bytes);
+  guint8 ihdr[13];
+  gboolean ok = TRUE;
+
+  write_be32(ihdr, image->width);
+  write_be32(ihdr + 4, image->height);
+  ihdr[8] = 8;
+  ihdr[9] = image->n_channels == 4 ? 6 : 2;
+  ihdr[10] = ihdr[11] = ihdr[12] = 0;
+
+  if (!g_output_stream_write_all(out, png_signature, sizeof(png_signature),
+                                 NULL, cancellable, error) ||
+      !write_chunk(out, "IHDR", ihdr, sizeof(ihdr), cancellable, error))
+    return FALSE;
+
+  PngEncoder encoder = {
+      .image = image,
+      .level = level,
+      .n_bands = (image->height + rows_per_band - 1) / rows_per_band,
+  };
+  encoder.bands = g_new0(PngBand, encoder.n_bands);
+  g_mutex_init(&encoder.mutex);
+  g_cond_init(&encoder.cond);
+
+  GThreadPool *pool = g_thread_pool_new(compress_band, &encoder,
+                                        g_get_num_processors(), FALSE, NULL);
+  for (guint i = 0; i < encoder.n_bands; i++) {
+    encoder.bands[i].first_row = i * rows_per_band;
+    encoder.bands[i].n_rows =
+        MIN(rows_per_band, image->height - i * rows_per_band);
+    g_thread_pool_push(pool, GUINT_TO_POINTER(i + 1), NULL);
+  }
+
+  guint32 adler = adler32(0, NULL, 0);
+  for (guint i = 0; i < encoder.n_bands && ok; i++) {
+    PngBand *band = &encoder.bands[i];
+
+    g_mutex_lock(&encoder.mutex);
+    while (!band->data && !band->failed)
+      g_cond_wait(&encoder.cond, &encoder.mutex);
+    GByteArray *data = g_steal_pointer(&band->data);
+    g_mutex_unlock(&encoder.mutex);
+
+    if (!data) {
+      g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                          "Failed to compress the image");
+      ok = FALSE;
+      break;
+    }
+
+    if (i == 0) {
+      guint8 header[2] = {0x78, zlib_level_flags(level)};
+      g_byte_array_prepend(data, header, sizeof(header));
+    }
+    adler = adler32_combine(adler, band->adler, band->length);
+    if (i + 1 == encoder.n_bands) {
+      guint8 trailer[4];
+      write_be32(trailer, adler);
+      g_byte_array_append(data, trailer, sizeof(trailer));
+    }
+
+    ok = write_chunk(out, "IDAT", data->data, data->len, cancellable, error);
+    g_byte_array_unref(data);
+  }
+
+  if (!ok)
+    g_atomic_int_set(&encoder.aborted, TRUE);
+  g_thread_pool_free(pool, TRUE, TRUE);
+
+  for (guint i = 0; i < encoder.n_bands; i++)
+    g_clear_pointer(&encoder.bands[i].data, g_byte_array_unref);
+  g_free(encoder.bands);
+  g_mutex_clear(&encoder.mutex);
+  g_cond_clear(&encoder.cond);
+
+  return ok && write_chunk(out, "IEND", NULL, 0, cancellable, error);
+}
+
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF 0x40
+#define QOI_OP_LUMA 0x80
+#define QOI_OP_RUN 0xc0
+#define QOI_OP_RGB 0xfe
+#define QOI_OP_RGBA 0xff
+
+/* Output is buffered and flushed in blocks this large */
+#define STREAM_CHUNK (64 * 1024)
+
+static const guint8 qoi_end_marker[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+typedef union {
+  struct {
+    guint8 r, g, b, a;
+  };
+  guint32 v;
+} QoiPixel;
+
+static gboolean flush_buffer(GOutputStream *out, guint8 *buffer, gsize *length,
+                             GCancellable *cancellable, GError **error) {
+  gsize n = *length;
+
+  *length = 0;
+  return n == 0 || g_output_stream_write_all(out, buffer, n, NULL,
+                                             cancellable, error);
+}
+
+/* Writes @image as QOI, https://qoiformat.org/qoi-specification.pdf. A single
+ * pass with no entropy coder, several times faster than deflate on screen
+ * content. */
+static gboolean write_qoi(GOutputStream *out, const SaveImage *image,
+                          G_GNUC_UNUSED gint level, GCancellable *cancellable,
+                          GError **error) {
+  // Room for a block plus what one pixel can add, a run and the largest op
+  g_autofree guint8 *buffer = g_malloc(STREAM_CHUNK + 6);
+  QoiPixel index[64] = {{{0}}};
+  QoiPixel prev = {.a = 255};
+  gboolean alpha = image->n_channels == 4;
+  gsize n = 0;
+  guint run = 0;
+
+  memcpy(buffer, "qoif", 4);
+  write_be32(buffer + 4, image->width);
+  write_be32(buffer + 8, image->height);
+  buffer[12] = image->n_channels;
+  buffer[13] = 0;
+  n = 14;
+
+  for (guint y = 0; y < image->height; y++) {
+    const guint8 *p = image->pixels + y * image->stride;
+
+    for (guint x = 0; x < image->width; x++, p += image->n_channels) {
+      QoiPixel px = {.r = p[0], .g = p[1], .b = p[2], .a = alpha ? p[3] : 255};
+
+      // Checked before every pixel, long runs write too
+      if (n >= STREAM_CHUNK &&
+          !flush_buffer(out, buffer, &n, cancellable, error))
+        return FALSE;
+
+      if (px.v == prev.v) {
+        if (++run == 62) {
+          buffer[n++] = QOI_OP_RUN | (run - 1);
+          run = 0;
+        }
+        continue;
+      }
+
+      if (run > 0) {
+        buffer[n++] = QOI_OP_RUN | (run - 1);
+        run = 0;
+      }
+
+      guint hash = (px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) % 64;
+      if (index[hash].v == px.v) {
+        buffer[n++] = QOI_OP_INDEX | hash;
+      } else if (px.a == prev.a) {
+        gint8 vr = px.r - prev.r, vg = px.g - prev.g, vb = px.b - prev.b;
+        gint8 vg_r = vr - vg, vg_b = vb - vg;
+
+        index[hash] = px;
+        if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+          buffer[n++] = QOI_OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2);
+        } else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 &&
+                   vg_b > -9 && vg_b < 8) {
+          buffer[n++] = QOI_OP_LUMA | (vg + 32);
+          buffer[n++] = (vg_r + 8) << 4 | (vg_b + 8);
+        } else {
+          buffer[n++] = QOI_OP_RGB;
+          buffer[n++] = px.r;
+          buffer[n++] = px.g;
+          buffer[n++] = px.b;
+        }
+      } else {
+        index[hash] = px;
+        buffer[n++] = QOI_OP_RGBA;
+        buffer[n++] = px.r;
+        buffer[n++] = px.g;
+        buffer[n++] = px.b;
+        buffer[n++] = px.a;
+      }
+      prev = px;
+    }
+  }
+
+  if (run > 0)
+    buffer[n++] = QOI_OP_RUN | (run - 1);
+
+  return flush_buffer(out, buffer, &n, cancellable, error) &&
+         g_output_stream_write_all(out, qoi_end_marker, sizeof(qoi_end_marker),
+                                   NULL, cancellable, error);
+}
+
+/* Writes the rows with @channels samples per pixel, dropping alpha if the
+ * image has more */
+static gboolean write_raw_rows(GOutputStream *out, const SaveImage *image,
+                               guint channels, GCancellable *cancellable,
+                               GError **error) {
+  gsize row_bytes = (gsize)image->width * channels;
+
+  // Already packed, one write for the whole image
+  if (channels == image->n_channels && image->stride == row_bytes)
+    return g_output_stream_write_all(out, image->pixels,
+                                     row_bytes * image->height, NULL,
+                                     cancellable, error);
+
+  g_autofree guint8 *buffer = g_malloc(MAX(row_bytes, STREAM_CHUNK));
+  gsize n = 0;
+
+  for (guint y = 0; y < image->height; y++) {
+    const guint8 *p = image->pixels + y * image->stride;
+
+    if (n + row_bytes > MAX(row_bytes, STREAM_CHUNK) &&
+        !flush_buffer(out, buffer, &n, cancellable, error))
+      return FALSE;
+
+    if (channels == image->n_channels) {
+      memcpy(buffer + n, p, row_bytes);
+      n += row_bytes;
+      continue;
+    }
+
+    for (guint x = 0; x < image->width; x++, p += image->n_channels) {
+      buffer[n++] = p[0];
+      buffer[n++] = p[1];
+      buffer[n++] = p[2];
+    }
+  }
+
+  return flush_buffer(out, buffer, &n, cancellable, error);
+}
+
+/* Netpbm PAM, keeps alpha */
+static gboolean write_pam(GOutputStream *out, const SaveImage *image,
+                          G_GNUC_UNUSED gint level, GCancellable *cancellable,
+                          GError **error) {
+  gboolean alpha = image->n_channels == 4;
+  g_autofree gchar *header = g_strdup_printf(
+      "P7\nWIDTH %u\nHEIGHT %u\nDEPTH %u\nMAXVAL 255\nTUPLTYPE %s\nENDHDR\n",
+      image->width, image->height, image->n_channels,
+      alpha ? "RGB_ALPHA" : "RGB");
+
+  return g_output_stream_write_all(out, header, strlen(header), NULL,
+                                   cancellable, error) &&
+         write_raw_rows(out, image, image->n_channels, cancellable, error);
+}
+
+/* Netpbm PPM, read by about everything but drops alpha */
+static gboolean write_ppm(GOutputStream *out, const SaveImage *image,
+                          G_GNUC_UNUSED gint level, GCancellable *cancellable,
+                          GError **error) {
+  g_autofree gchar *header =
+      g_strdup_printf("P6\n%u %u\n255\n", image->width, image->height);
+
+  return g_output_stream_write_all(out, header, strlen(header), NULL,
+                                   cancellable, error) &&
+         write_raw_rows(out, image, 3, cancellable, error);
+}
+
+typedef gboolean (*SaveWriter)(GOutputStream *out, const SaveImage *image,
+                               gint level, GCancellable *cancellable,
+                               GError **error);
+
+static const struct {
+  const gchar *name;
+  SaveWriter write;
+} save_formats[] = {
+    {"png", write_png},
+    {"qoi", write_qoi},
+    {"pam", write_pam},
+    {"ppm", write_ppm},
+};
+
+static SaveWriter find_writer(const gchar *format) {
+  for (guint i = 0; i < G_N_ELEMENTS(save_formats); i++) {
+    if (g_ascii_strcasecmp(save_formats[i].name, format) == 0)
+      return save_formats[i].write;
+  }
+  return NULL;
+}
+
+gboolean makas_save_write_stream(GOutputStream *out, const guint8 *pixels,
+                                 gsize stride, guint width, guint height,
+                                 guint n_channels, const gchar *format,
+                                 gint level, GCancellable *cancellable,
+                                 GError **error) {
+  SaveWriter write = find_writer(format);
+  SaveImage image = {
+      .pixels = pixels,
+      .stride = stride,
+      .width = width,
+      .height = height,
+      .n_channels = n_channels,
+  };
+
+  if (!write) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                "Unsupported image format: %s", format);
+    return FALSE;
+  }
+
+  return write(out, &image, level, cancellable, error);
+}
+
+gboolean makas_save_write_file(const gchar *filename, const guint8 *pixels,
+                               gsize stride, guint width, guint height,
+                               guint n_channels, const gchar *format,
+                               gint level, GCancellable *cancellable,
+                               GError **error) {
+  // Written next to the destination and renamed over it once complete
+  g_autoptr(GFile) file = g_file_new_for_path(filename);
+  g_autoptr(GFileOutputStream) out = g_file_replace(
+      file, NULL, FALSE, G_FILE_CREATE_NONE, cancellable, error);
+  if (!out)
+    return FALSE;
+
+  if (!makas_save_write_stream(G_OUTPUT_STREAM(out), pixels, stride, width,
+                               height, n_channels, format, level, cancellable,
+                               error)) {
+    // Closing with a cancelled cancellable drops the temporary file
+    g_autoptr(GCancellable) discard = g_cancellable_new();
+    g_cancellable_cancel(discard);
+    g_output_stream_close(G_OUTPUT_STREAM(out), discard, NULL);
+    return FALSE;
+  }
+
+  return g_output_stream_close(G_OUTPUT_STREAM(out), cancellable, error);
+}
+
+typedef struct {
+  GdkPixbuf *pixbuf;
+  gchar *filename;
+  gchar *format;
+  gint level;
+} SaveData;
+
+static void save_data_free(SaveData *data) {
+  g_object_unref(data->pixbuf);
+  g_free(data->filename);
+  g_free(data->format);
+  g_free(data);
+}
+
+static void save_image_thread(GTask *task, gpointer source_object,
+                              gpointer task_data, GCancellable *cancellable) {
+  SaveData *data = task_data;
+  GError *error = NULL;
+
+  if (!makas_save_write_file(data->filename,
+                             gdk_pixbuf_read_pixels(data->pixbuf),
+                             gdk_pixbuf_get_rowstride(data->pixbuf),
+                             gdk_pixbuf_get_width(data->pixbuf),
+                             gdk_pixbuf_get_height(data->pixbuf),
+                             gdk_pixbuf_get_n_channels(data->pixbuf),
+                             data->format, data->level, cancellable, &error)) {
+    g_task_return_error(task, error);
+    return;
+  }
+
+  g_task_return_boolean(task, TRUE);
+}
+
+void makas_save_image_async(GdkPixbuf *pixbuf, const gchar *filename,
+                            const gchar *format, gint level,
+                            GCancellable *cancellable,
+                            GAsyncReadyCallback callback, gpointer user_data) {
+  g_return_if_fail(GDK_IS_PIXBUF(pixbuf));
+  g_return_if_fail(filename != NULL);
+  g_return_if_fail(format != NULL);
+  g_return_if_fail(level >= -1 && level <= 9);
+  g_return_if_fail(gdk_pixbuf_get_bits_per_sample(pixbuf) == 8);
+
+  if (!find_writer(format)) {
+    g_task_report_new_error(NULL, callback, user_data, makas_save_image_async,
+                            G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                            "Unsupported image format: %s", format);
+    return;
+  }
+
+  SaveData *data = g_new0(SaveData, 1);
+  data->pixbuf = g_object_ref(pixbuf);
+  data->filename = g_strdup(filename);
+  data->format = g_strdup(format);
+  data->level = level;
+
+  GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+  g_task_set_source_tag(task, makas_save_image_async);
+  g_task_set_task_data(task, data, (GDestroyNotify)save_data_free);
+  g_task_run_in_thread(task, save_image_thread);
+  g_object_unref(task);
+}
+
+gboolean makas_save_image_finish(GAsyncResult *result, GError **error) {
+  g_return_val_if_fail(g_task_is_valid(result, NULL), FALSE);
+
+  return g_task_propagate_boolean(G_TASK(result), error);
+}
+
+void makas_save_png_async(GdkPixbuf *pixbuf, const gchar *filename, gint level,
+                          GCancellable *cancellable,
+                          GAsyncReadyCallback callback, gpointer user_data) {
+  makas_save_image_async(pixbuf, filename, "png", level, cancellable, callback,
+                         user_data);
+}
+
+gboolean makas_save_png_finish(GAsyncResult *result, GError **error) {
+  return makas_save_image_finish(result, error);
+}
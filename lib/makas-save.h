@@ -0,0 +1,61 @@
+#ifndef MAKAS_SAVE_H
+#define MAKAS_SAVE_H
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <gio/gio.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * makas_save_png_async:
+ * @pixbuf: The #GdkPixbuf to save, 8 bits per sample.
+ * @filename: Path of the file to write.
+ * @level: zlib compression level from 0 to 9, -1 for the zlib default.
+ * @cancellable: (nullable): A #GCancellable.
+ * @callback: (scope async): Called once the file is written.
+ * @user_data: (closure): Data for @callback.
+ *
+ * Encodes @pixbuf as a PNG on worker threads. Bands of rows are deflated in
+ * parallel as independent blocks, the way pigz does, and written out in order
+ * as they finish. The file replaces @filename only once complete.
+ */
+void makas_save_png_async(GdkPixbuf *pixbuf, const gchar *filename, gint level, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+
+/**
+ * makas_save_png_finish:
+ * @result: The #GAsyncResult passed to the callback.
+ * @error: Return location for a #GError.
+ *
+ * Returns: TRUE if the file was written.
+ */
+gboolean makas_save_png_finish(GAsyncResult *result, GError **error);
+
+/**
+ * makas_save_image_async:
+ * @pixbuf: The #GdkPixbuf to save, 8 bits per sample.
+ * @filename: Path of the file to write.
+ * @format: "png", "qoi", "pam" or "ppm".
+ * @level: zlib compression level for PNG, ignored by the other formats.
+ * @cancellable: (nullable): A #GCancellable.
+ * @callback: (scope async): Called once the file is written.
+ * @user_data: (closure): Data for @callback.
+ *
+ * Encodes @pixbuf on a worker thread. PNG goes through the parallel encoder of
+ * makas_save_png_async(). QOI and the uncompressed Netpbm formats trade file
+ * size for encoding speed. PAM keeps the alpha channel, PPM drops it.
+ */
+void makas_save_image_async(GdkPixbuf *pixbuf, const gchar *filename, const gchar *format, gint level, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+
+/**
+ * makas_save_image_finish:
+ * @result: The #GAsyncResult passed to the callback.
+ * @error: Return location for a #GError.
+ *
+ * Returns: TRUE if the file was written.
+ */
+gboolean makas_save_image_finish(GAsyncResult *result, GError **error);
+
+G_END_DECLS
+
+#endif /* MAKAS_SAVE_H */
@@ -1,30 +1,195 @@
 #include "makas-screenshot.h"
 #include "glib.h"
+#include "makas-pixel.h"
 
+#include <X11/Xatom.h>
 #include <X11/Xlib.h>
+#include <X11/extensions/XShm.h>
 #include <X11/extensions/Xcomposite.h>
+#include <X11/extensions/Xrender.h>
 #include <X11/extensions/shape.h>
 #include <gdk/gdkx.h>
 #include <gtk/gtk.h>
+#include <pixman.h>
 #include <stdio.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+/* A MIT-SHM segment kept attached to the X server between captures. It only
+ * grows, so repeated grabs of the same size reuse it as is. X11 captures run
+ * on the main thread, no locking needed. */
+typedef struct {
+  Display *display;
+  XShmSegmentInfo info;
+  gsize size;
+  // Set once attaching failed, e.g. on a remote display
+  gboolean unusable;
+} ShmSegment;
+
+static ShmSegment shm_segment;
+
+static void release_shm_segment(void) {
+  if (shm_segment.size == 0)
+    return;
+
+  XShmDetach(shm_segment.display, &shm_segment.info);
+  shmdt(shm_segment.info.shmaddr);
+  shm_segment.size = 0;
+}
+
+static gboolean ensure_shm_segment(Display *display, gsize size) {
+  if (shm_segment.size >= size && shm_segment.display == display)
+    return TRUE;
+
+  release_shm_segment();
+
+  int shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+  if (shmid < 0) {
+    g_warning("shmget failed for %" G_GSIZE_FORMAT " bytes", size);
+    return FALSE;
+  }
+
+  char *shmaddr = shmat(shmid, NULL, 0);
+  if (shmaddr == (char *)-1) {
+    g_warning("shmat failed");
+    shmctl(shmid, IPC_RMID, NULL);
+    return FALSE;
+  }
+
+  XShmSegmentInfo info = {
+      .shmid = shmid,
+      .shmaddr = shmaddr,
+      .readOnly = False,
+  };
+
+  GdkDisplay *gdk_display = gdk_x11_lookup_xdisplay(display);
+  gdk_x11_display_error_trap_push(gdk_display);
+  Bool attached = XShmAttach(display, &info);
+  XSync(display, False);
+  gboolean failed = gdk_x11_display_error_trap_pop(gdk_display) != 0 || !attached;
+
+  // The segment goes away once both sides detached from it
+  shmctl(shmid, IPC_RMID, NULL);
+
+  if (failed) {
+    g_warning("XShmAttach failed, falling back to XGetImage");
+    shmdt(shmaddr);
+    shm_segment.unusable = TRUE;
+    return FALSE;
+  }
+
+  shm_segment.display = display;
+  shm_segment.info = info;
+  shm_segment.size = size;
+  return TRUE;
+}
+
+/* Reads a rectangle of a drawable as a ZPixmap. With MIT-SHM the server
+ * writes straight into the shared segment instead of sending the pixels over
+ * the socket. The result must be released with release_image(). */
+static XImage *get_image(Display *display, Drawable drawable, Visual *visual,
+                         int depth, int x, int y, int width, int height,
+                         gboolean *out_shm) {
+  GdkDisplay *gdk_display = gdk_x11_lookup_xdisplay(display);
+  XImage *image = NULL;
+
+  *out_shm = FALSE;
+  if (!shm_segment.unusable && XShmQueryExtension(display)) {
+    image = XShmCreateImage(display, visual, depth, ZPixmap, NULL,
+                            &shm_segment.info, width, height);
+    if (image != NULL &&
+        ensure_shm_segment(display,
+                           (gsize)image->bytes_per_line * image->height)) {
+      image->data = shm_segment.info.shmaddr;
+      image->obdata = (char *)&shm_segment.info;
+
+      gdk_x11_display_error_trap_push(gdk_display);
+      Bool ok = XShmGetImage(display, drawable, image, x, y, AllPlanes);
+      if (gdk_x11_display_error_trap_pop(gdk_display) == 0 && ok) {
+        *out_shm = TRUE;
+        return image;
+      }
+      g_warning("XShmGetImage failed");
+    }
+
+    if (image != NULL) {
+      // The data belongs to the segment, not to the image
+      image->data = NULL;
+      XDestroyImage(image);
+      image = NULL;
+    }
+  }
+
+  gdk_x11_display_error_trap_push(gdk_display);
+  image = XGetImage(display, drawable, x, y, width, height, AllPlanes, ZPixmap);
+  if (gdk_x11_display_error_trap_pop(gdk_display) != 0 && image != NULL) {
+    XDestroyImage(image);
+    image = NULL;
+  }
+  return image;
+}
+
+static void release_image(XImage *image, gboolean shm) {
+  if (shm)
+    image->data = NULL;
+  XDestroyImage(image);
+}
+
+/* Converts a ZPixmap to an RGBA GdkPixbuf. Depth 24 images just get an opaque
+ * alpha channel, which the XShape mask needs anyway. */
+static GdkPixbuf *image_to_pixbuf(XImage *image, gboolean has_alpha) {
+  int width = image->width;
+  int height = image->height;
+
+  GdkPixbuf *pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, width, height);
+  if (!pixbuf)
+    return NULL;
+
+  guchar *pixels = gdk_pixbuf_get_pixels(pixbuf);
+  int rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+  int n_channels = gdk_pixbuf_get_n_channels(pixbuf);
+
+  int native_byte_order =
+      G_BYTE_ORDER == G_LITTLE_ENDIAN ? LSBFirst : MSBFirst;
+  if (image->bits_per_pixel == 32 && image->byte_order == native_byte_order &&
+      image->red_mask == 0xff0000 && image->green_mask == 0xff00 &&
+      image->blue_mask == 0xff) {
+    /* The common (A)RGB visual can be swizzled in bulk */
+    makas_pixel_xrgb_to_rgba((const guint8 *)image->data, image->bytes_per_line,
+                             pixels, rowstride, width, height, !has_alpha);
+    return pixbuf;
+  }
+
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      unsigned long pixel = XGetPixel(image, x, y);
+      guchar *p = pixels + y * rowstride + x * n_channels;
+
+      /* Extract RGB(A) - X11 stores in BGRA for 32-bit */
+      p[0] = (pixel >> 16) & 0xFF; /* R */
+      p[1] = (pixel >> 8) & 0xFF;  /* G */
+      p[2] = pixel & 0xFF;         /* B */
+      p[3] = has_alpha ? (pixel >> 24) & 0xFF : 255; /* A */
+    }
+  }
+
+  return pixbuf;
+}
 
 // find_wm_window is just a copy-pasta from gnome-screenshot (with the same
 // name)
-static Window find_wm_window(GdkWindow *window) {
-  Window xid, root, parent, *children;
+static Window find_root_child(Window xid) {
+  Window root, parent, *children;
   unsigned int nchildren;
 
-  if (window == gdk_get_default_root_window())
-    return None;
-
-  xid = GDK_WINDOW_XID(window);
-
   do {
     if (XQueryTree(GDK_DISPLAY_XDISPLAY(gdk_display_get_default()), xid, &root,
                    &parent, &children, &nchildren) == 0) {
       g_warning("Couldn't find window manager window");
       return None;
     }
+    if (children)
+      XFree(children);
 
     if (root == parent)
       return xid;
@@ -33,143 +198,682 @@ static Window find_wm_window(GdkWindow *window) {
   } while (TRUE);
 }
 
-static GdkWindow *find_window_at_coords(gint x, gint y) {
-  GdkScreen *screen = gdk_screen_get_default();
-  GdkWindow *found = NULL;
+static Window find_wm_window(GdkWindow *window) {
+  if (window == gdk_get_default_root_window())
+    return None;
 
-  gint current_desktop = -1;
-  if (GDK_IS_X11_SCREEN(screen)) {
-    current_desktop = gdk_x11_screen_get_current_desktop(screen);
+  return find_root_child(GDK_WINDOW_XID(window));
+}
+
+/* Client windows of _NET_CLIENT_LIST_STACKING, bottom to top. The index is
+ * read once and then kept up to date from the root window events, so picking
+ * the window under the pointer never talks to the X server. Like the MIT-SHM
+ * segment it is only touched from the main thread. */
+typedef struct {
+  Window client;
+  // The child of the root window holding the client, the WM frame if any
+  Window frame;
+  // Geometry of the frame in device pixels
+  GdkRectangle rect;
+  // _GTK_FRAME_EXTENTS of client side decorations: left, right, top, bottom
+  gint shadow[4];
+  guint32 desktop;
+  gboolean viewable;
+  // Docks and desktops are never picked
+  gboolean skip;
+} StackEntry;
+
+typedef struct {
+  GdkDisplay *gdk_display;
+  Display *display;
+  Window root;
+  gint scale;
+  gint current_desktop;
+  GArray *entries;
+  /* Grid over the distinct window edges. Each cell holds the index plus one of
+   * the topmost entry covering it, 0 if none. Rebuilt on the first lookup
+   * after a change. */
+  gboolean dirty;
+  GArray *xs;
+  GArray *ys;
+  guint16 *cells;
+  // WindowPixmap by frame, see get_window_pixmap()
+  GHashTable *pixmaps;
+} WindowStack;
+
+static WindowStack window_stack;
+
+/* A composite pixmap named for a frame that stays redirected. The server keeps
+ * its content current, so hover previews and the final capture read it as is.
+ * The name goes stale when the frame is resized or remapped and is taken again
+ * on the next use. */
+typedef struct {
+  Window frame;
+  // None while stale
+  Pixmap pixmap;
+  Picture picture;
+  Visual *visual;
+  gint depth;
+  gint width;
+  gint height;
+} WindowPixmap;
+
+static void forget_window_pixmap(WindowPixmap *window_pixmap) {
+  Display *display = window_stack.display;
+
+  if (window_pixmap->picture != None)
+    XRenderFreePicture(display, window_pixmap->picture);
+  if (window_pixmap->pixmap != None)
+    XFreePixmap(display, window_pixmap->pixmap);
+  window_pixmap->picture = None;
+  window_pixmap->pixmap = None;
+}
+
+static void free_window_pixmap(gpointer data) {
+  WindowPixmap *window_pixmap = data;
+
+  // The frame may be gone already
+  gdk_x11_display_error_trap_push(window_stack.gdk_display);
+  forget_window_pixmap(window_pixmap);
+  XCompositeUnredirectWindow(window_stack.display, window_pixmap->frame,
+                             CompositeRedirectAutomatic);
+  gdk_x11_display_error_trap_pop_ignored(window_stack.gdk_display);
+  g_free(window_pixmap);
+}
+
+static WindowPixmap *lookup_window_pixmap(Window frame) {
+  return g_hash_table_lookup(window_stack.pixmaps, GSIZE_TO_POINTER(frame));
+}
+
+/* Redirects @frame on first use and names its pixmap if needed */
+static WindowPixmap *get_window_pixmap(Window frame) {
+  Display *display = window_stack.display;
+  WindowPixmap *window_pixmap = lookup_window_pixmap(frame);
+  XWindowAttributes attrs;
+
+  if (window_pixmap && window_pixmap->pixmap != None)
+    return window_pixmap;
+
+  if (!XGetWindowAttributes(display, frame, &attrs)) {
+    g_warning("Failed to get window attributes");
+    return NULL;
+  }
+
+  if (!window_pixmap) {
+    window_pixmap = g_new0(WindowPixmap, 1);
+    window_pixmap->frame = frame;
+    g_hash_table_insert(window_stack.pixmaps, GSIZE_TO_POINTER(frame),
+                        window_pixmap);
+
+    /* Redirect window to get its backing store */
+    XCompositeRedirectWindow(display, frame, CompositeRedirectAutomatic);
+  }
+
+  gdk_x11_display_error_trap_push(window_stack.gdk_display);
+  XSync(display, False);
+  /* Get the pixmap containing the window's content */
+  window_pixmap->pixmap = XCompositeNameWindowPixmap(display, frame);
+  if (gdk_x11_display_error_trap_pop(window_stack.gdk_display) != 0)
+    window_pixmap->pixmap = None;
+
+  if (window_pixmap->pixmap == None) {
+    g_warning("XCompositeNameWindowPixmap failed");
+    g_hash_table_remove(window_stack.pixmaps, GSIZE_TO_POINTER(frame));
+    return NULL;
   }
 
-  GList *windows = gdk_screen_get_window_stack(screen);
-  if (!windows)
+  window_pixmap->visual = attrs.visual;
+  window_pixmap->depth = attrs.depth;
+  window_pixmap->width = attrs.width;
+  window_pixmap->height = attrs.height;
+  return window_pixmap;
+}
+
+static Atom get_atom(const gchar *name) {
+  return gdk_x11_get_xatom_by_name_for_display(window_stack.gdk_display, name);
+}
+
+/* Reads a 32-bit property as an array of longs, the way Xlib returns them */
+static gulong *get_property_longs(Window xid, Atom property, Atom type,
+                                  gulong *n_items) {
+  Atom actual_type;
+  int actual_format;
+  unsigned long n, bytes_after;
+  guchar *data = NULL;
+
+  *n_items = 0;
+  if (XGetWindowProperty(window_stack.display, xid, property, 0, G_MAXLONG,
+                         False, type, &actual_type, &actual_format, &n,
+                         &bytes_after, &data) != Success)
     return NULL;
 
-  windows = g_list_reverse(windows);
+  if (actual_type != type || actual_format != 32 || n == 0) {
+    if (data)
+      XFree(data);
+    return NULL;
+  }
 
-  for (GList *l = windows; l != NULL; l = l->next) {
-    GdkWindow *win = l->data;
+  gulong *items = g_memdup2(data, n * sizeof(gulong));
+  XFree(data);
+  *n_items = n;
+  return items;
+}
 
-    GdkWindowTypeHint type_hint = gdk_window_get_type_hint(win);
+static gint read_current_desktop(void) {
+  gulong n;
+  g_autofree gulong *desktop = get_property_longs(
+      window_stack.root, get_atom("_NET_CURRENT_DESKTOP"), XA_CARDINAL, &n);
+  return desktop ? (gint)desktop[0] : -1;
+}
 
-    // Just ignore the dock and the desktop. Might wanto to expose the option to
-    // include them in the future.
-    if (type_hint == GDK_WINDOW_TYPE_HINT_DESKTOP ||
-        type_hint == GDK_WINDOW_TYPE_HINT_DOCK)
-      continue;
+static void read_entry_desktop(StackEntry *entry) {
+  gulong n;
+  g_autofree gulong *desktop = get_property_longs(
+      entry->client, get_atom("_NET_WM_DESKTOP"), XA_CARDINAL, &n);
+  // Windows without a desktop are treated as pinned
+  entry->desktop = desktop ? (guint32)desktop[0] : 0xFFFFFFFF;
+}
 
-    if (!gdk_window_is_viewable(win))
+static void read_entry_shadow(StackEntry *entry) {
+  gulong n;
+  g_autofree gulong *extents = get_property_longs(
+      entry->client, get_atom("_GTK_FRAME_EXTENTS"), XA_CARDINAL, &n);
+  for (guint i = 0; i < 4; i++)
+    entry->shadow[i] = extents && n == 4 ? (gint)extents[i] : 0;
+}
+
+static void read_entry_type(StackEntry *entry) {
+  gulong n;
+  g_autofree gulong *types = get_property_longs(
+      entry->client, get_atom("_NET_WM_WINDOW_TYPE"), XA_ATOM, &n);
+  Atom dock = get_atom("_NET_WM_WINDOW_TYPE_DOCK");
+  Atom desktop = get_atom("_NET_WM_WINDOW_TYPE_DESKTOP");
+
+  // Just ignore the dock and the desktop. Might want to expose the option to
+  // include them in the future.
+  entry->skip = FALSE;
+  for (gulong i = 0; i < n; i++) {
+    if (types[i] == dock || types[i] == desktop) {
+      entry->skip = TRUE;
+      break;
+    }
+  }
+}
+
+/* Queries everything about a window that just showed up in the stacking
+ * list. Returns FALSE if it is already gone. */
+static gboolean load_stack_entry(StackEntry *entry, Window client) {
+  XWindowAttributes attrs;
+
+  *entry = (StackEntry){.client = client};
+  entry->frame = find_root_child(client);
+  if (entry->frame == None ||
+      !XGetWindowAttributes(window_stack.display, entry->frame, &attrs))
+    return FALSE;
+
+  entry->rect = (GdkRectangle){attrs.x, attrs.y,
+                               attrs.width + 2 * attrs.border_width,
+                               attrs.height + 2 * attrs.border_width};
+  entry->viewable = attrs.map_state == IsViewable;
+
+  if (!XGetWindowAttributes(window_stack.display, client, &attrs))
+    return FALSE;
+  entry->viewable = entry->viewable && attrs.map_state == IsViewable;
+
+  read_entry_desktop(entry);
+  read_entry_shadow(entry);
+  read_entry_type(entry);
+
+  // Desktop and decoration changes are reported on the client itself
+  XSelectInput(window_stack.display, client,
+               attrs.your_event_mask | PropertyChangeMask);
+  return TRUE;
+}
+
+static void reload_window_stack(void) {
+  gulong n;
+  g_autofree gulong *clients =
+      get_property_longs(window_stack.root,
+                         get_atom("_NET_CLIENT_LIST_STACKING"), XA_WINDOW, &n);
+
+  g_autoptr(GHashTable) known = g_hash_table_new(NULL, NULL);
+  for (guint i = 0; i < window_stack.entries->len; i++) {
+    StackEntry *entry = &g_array_index(window_stack.entries, StackEntry, i);
+    g_hash_table_insert(known, GSIZE_TO_POINTER(entry->client), entry);
+  }
+
+  GArray *entries = g_array_sized_new(FALSE, FALSE, sizeof(StackEntry), n);
+  gdk_x11_display_error_trap_push(window_stack.gdk_display);
+  for (gulong i = 0; i < n; i++) {
+    StackEntry *old = g_hash_table_lookup(known, GSIZE_TO_POINTER(clients[i]));
+    StackEntry entry;
+
+    if (old)
+      entry = *old;
+    else if (!load_stack_entry(&entry, clients[i]))
       continue;
 
-    if (current_desktop != -1 && GDK_IS_X11_WINDOW(win)) {
-      guint32 win_desktop = gdk_x11_window_get_desktop(win);
+    g_array_append_val(entries, entry);
+  }
+  gdk_x11_display_error_trap_pop_ignored(window_stack.gdk_display);
+
+  g_array_unref(window_stack.entries);
+  window_stack.entries = entries;
+  window_stack.dirty = TRUE;
+}
 
-      // 0xFFFFFFFF is "Pinned" (Always on Visible Workspace)
-      if (win_desktop != (guint32)current_desktop &&
-          win_desktop != 0xFFFFFFFF) {
-        continue;
+static StackEntry *find_stack_entry(Window xid, gboolean by_frame) {
+  for (guint i = 0; i < window_stack.entries->len; i++) {
+    StackEntry *entry = &g_array_index(window_stack.entries, StackEntry, i);
+    if ((by_frame ? entry->frame : entry->client) == xid)
+      return entry;
+  }
+  return NULL;
+}
+
+static GdkFilterReturn window_stack_filter(GdkXEvent *gdk_xevent,
+                                           GdkEvent *event, gpointer data) {
+  XEvent *xevent = gdk_xevent;
+  WindowPixmap *window_pixmap;
+  StackEntry *entry;
+
+  switch (xevent->type) {
+  case PropertyNotify: {
+    Atom atom = xevent->xproperty.atom;
+
+    if (xevent->xproperty.window == window_stack.root) {
+      if (atom == get_atom("_NET_CLIENT_LIST_STACKING")) {
+        reload_window_stack();
+      } else if (atom == get_atom("_NET_CURRENT_DESKTOP")) {
+        window_stack.current_desktop = read_current_desktop();
+        window_stack.dirty = TRUE;
       }
+      break;
     }
 
-    GdkRectangle rect;
-    gdk_window_get_frame_extents(win, &rect);
+    entry = find_stack_entry(xevent->xproperty.window, FALSE);
+    if (!entry)
+      break;
 
-    if (x >= rect.x && x < rect.x + rect.width && y >= rect.y &&
-        y < rect.y + rect.height) {
-      // This is included here to handle a hypothetical scenario where
-      // the window doesn't exist by the time it must be captured.
-      // We actually don't try to find the window before the delay, We find it
-      // right before capturing it. So this precaution might not be necessary.
-      gdk_window_set_events(win,
-                            gdk_window_get_events(win) | GDK_STRUCTURE_MASK);
+    gdk_x11_display_error_trap_push(window_stack.gdk_display);
+    if (atom == get_atom("_NET_WM_DESKTOP"))
+      read_entry_desktop(entry);
+    else if (atom == get_atom("_GTK_FRAME_EXTENTS"))
+      read_entry_shadow(entry);
+    else if (atom == get_atom("_NET_WM_WINDOW_TYPE"))
+      read_entry_type(entry);
+    gdk_x11_display_error_trap_pop_ignored(window_stack.gdk_display);
+    window_stack.dirty = TRUE;
+    break;
+  }
+  case ConfigureNotify: {
+    XConfigureEvent *configure = &xevent->xconfigure;
+    window_pixmap = lookup_window_pixmap(configure->window);
+    if (window_pixmap && (configure->width != window_pixmap->width ||
+                          configure->height != window_pixmap->height))
+      forget_window_pixmap(window_pixmap);
+
+    entry = find_stack_entry(configure->window, TRUE);
+    if (!entry)
+      break;
 
-      found = gdk_window_get_toplevel(win);
+    entry->rect = (GdkRectangle){configure->x, configure->y,
+                                 configure->width + 2 * configure->border_width,
+                                 configure->height +
+                                     2 * configure->border_width};
+    window_stack.dirty = TRUE;
+    break;
+  }
+  case MapNotify:
+  case UnmapNotify: {
+    Window frame = xevent->type == MapNotify ? xevent->xmap.window
+                                             : xevent->xunmap.window;
+    window_pixmap = lookup_window_pixmap(frame);
+    if (window_pixmap)
+      forget_window_pixmap(window_pixmap);
+
+    entry = find_stack_entry(frame, TRUE);
+    if (!entry)
       break;
+
+    entry->viewable = xevent->type == MapNotify;
+    window_stack.dirty = TRUE;
+    break;
+  }
+  case DestroyNotify:
+    g_hash_table_remove(window_stack.pixmaps,
+                        GSIZE_TO_POINTER(xevent->xdestroywindow.window));
+
+    // The stacking list follows, until then the window is just not picked
+    entry = find_stack_entry(xevent->xdestroywindow.window, TRUE);
+    if (entry) {
+      entry->viewable = FALSE;
+      window_stack.dirty = TRUE;
     }
+    break;
   }
 
-  g_list_free(windows);
-  return found;
+  return GDK_FILTER_CONTINUE;
 }
 
-/* Capture window using XComposite to get full content (even
- * off-screen/occluded) */
-static GdkPixbuf *capture_window_pixmap(Display *display, Window wm_xid,
-                                        gint width, gint height) {
-  Pixmap pixmap;
-  GdkPixbuf *screenshot = NULL;
-  XWindowAttributes attrs;
+static gboolean ensure_window_stack(void) {
+  if (window_stack.entries)
+    return TRUE;
+
+  GdkDisplay *gdk_display = gdk_display_get_default();
+  if (!GDK_IS_X11_DISPLAY(gdk_display))
+    return FALSE;
+
+  GdkWindow *root = gdk_get_default_root_window();
+  window_stack.gdk_display = gdk_display;
+  window_stack.display = GDK_DISPLAY_XDISPLAY(gdk_display);
+  window_stack.root = GDK_WINDOW_XID(root);
+  window_stack.scale = gdk_window_get_scale_factor(root);
+  window_stack.entries = g_array_new(FALSE, FALSE, sizeof(StackEntry));
+  window_stack.xs = g_array_new(FALSE, FALSE, sizeof(gint));
+  window_stack.ys = g_array_new(FALSE, FALSE, sizeof(gint));
+  window_stack.pixmaps =
+      g_hash_table_new_full(NULL, NULL, NULL, free_window_pixmap);
+
+  // Frames are children of the root, their changes arrive as substructure
+  // events
+  gdk_window_set_events(root, gdk_window_get_events(root) |
+                                  GDK_PROPERTY_CHANGE_MASK |
+                                  GDK_SUBSTRUCTURE_MASK);
+  gdk_window_add_filter(NULL, window_stack_filter, NULL);
+
+  window_stack.current_desktop = read_current_desktop();
+  reload_window_stack();
+  return TRUE;
+}
 
-  /* Get window attributes for depth info */
-  if (!XGetWindowAttributes(display, wm_xid, &attrs)) {
-    g_warning("Failed to get window attributes");
-    return NULL;
+/* Returns the eligible part of the entry, or FALSE if it can't be picked */
+static gboolean get_pickable_rect(StackEntry *entry, GdkRectangle *rect) {
+  if (!entry->viewable || entry->skip)
+    return FALSE;
+
+  // 0xFFFFFFFF is "Pinned" (Always on Visible Workspace)
+  if (window_stack.current_desktop != -1 &&
+      entry->desktop != (guint32)window_stack.current_desktop &&
+      entry->desktop != 0xFFFFFFFF)
+    return FALSE;
+
+  *rect = (GdkRectangle){entry->rect.x + entry->shadow[0],
+                         entry->rect.y + entry->shadow[2],
+                         entry->rect.width - entry->shadow[0] -
+                             entry->shadow[1],
+                         entry->rect.height - entry->shadow[2] -
+                             entry->shadow[3]};
+  return rect->width > 0 && rect->height > 0;
+}
+
+static gint compare_ints(gconstpointer a, gconstpointer b) {
+  gint x = *(const gint *)a, y = *(const gint *)b;
+  return (x > y) - (x < y);
+}
+
+static void sort_unique_edges(GArray *edges) {
+  g_array_sort(edges, compare_ints);
+
+  guint n = 0;
+  for (guint i = 0; i < edges->len; i++) {
+    if (n == 0 ||
+        g_array_index(edges, gint, i) != g_array_index(edges, gint, n - 1))
+      g_array_index(edges, gint, n++) = g_array_index(edges, gint, i);
   }
+  g_array_set_size(edges, n);
+}
 
-  /* Redirect window to get its backing store */
-  XCompositeRedirectWindow(display, wm_xid, CompositeRedirectAutomatic);
-  XSync(display, False);
+/* Index of the first edge not below @value */
+static guint lower_edge(GArray *edges, gint value) {
+  guint low = 0, high = edges->len;
 
-  /* Get the pixmap containing the window's content */
-  pixmap = XCompositeNameWindowPixmap(display, wm_xid);
-  if (pixmap == None) {
-    g_warning("XCompositeNameWindowPixmap failed");
-    XCompositeUnredirectWindow(display, wm_xid, CompositeRedirectAutomatic);
+  while (low < high) {
+    guint mid = (low + high) / 2;
+    if (g_array_index(edges, gint, mid) < value)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+static void rebuild_stack_grid(void) {
+  GArray *xs = window_stack.xs, *ys = window_stack.ys;
+  guint n_entries = MIN(window_stack.entries->len, G_MAXUINT16);
+  GdkRectangle rect;
+
+  g_array_set_size(xs, 0);
+  g_array_set_size(ys, 0);
+  for (guint i = 0; i < n_entries; i++) {
+    StackEntry *entry = &g_array_index(window_stack.entries, StackEntry, i);
+    if (!get_pickable_rect(entry, &rect))
+      continue;
+
+    gint right = rect.x + rect.width, bottom = rect.y + rect.height;
+    g_array_append_val(xs, rect.x);
+    g_array_append_val(xs, right);
+    g_array_append_val(ys, rect.y);
+    g_array_append_val(ys, bottom);
+  }
+  sort_unique_edges(xs);
+  sort_unique_edges(ys);
+
+  guint columns = xs->len > 0 ? xs->len - 1 : 0;
+  guint rows = ys->len > 0 ? ys->len - 1 : 0;
+  g_free(window_stack.cells);
+  window_stack.cells = g_new0(guint16, (gsize)columns * rows);
+
+  // Paint bottom to top, upper windows overwrite what they cover
+  for (guint i = 0; i < n_entries; i++) {
+    StackEntry *entry = &g_array_index(window_stack.entries, StackEntry, i);
+    if (!get_pickable_rect(entry, &rect))
+      continue;
+
+    guint x0 = lower_edge(xs, rect.x), x1 = lower_edge(xs, rect.x + rect.width);
+    guint y0 = lower_edge(ys, rect.y),
+          y1 = lower_edge(ys, rect.y + rect.height);
+    for (guint row = y0; row < y1; row++) {
+      guint16 *cells = window_stack.cells + (gsize)row * columns;
+      for (guint column = x0; column < x1; column++)
+        cells[column] = i + 1;
+    }
+  }
+
+  window_stack.dirty = FALSE;
+}
+
+/* Topmost pickable entry at @x, @y in device pixels, two binary searches over
+ * the cached grid */
+static StackEntry *lookup_window_stack(gint x, gint y) {
+  if (window_stack.dirty)
+    rebuild_stack_grid();
+
+  GArray *xs = window_stack.xs, *ys = window_stack.ys;
+  guint column = lower_edge(xs, x + 1), row = lower_edge(ys, y + 1);
+  if (column == 0 || column >= xs->len || row == 0 || row >= ys->len)
+    return NULL;
+
+  guint16 index = window_stack.cells[(gsize)(row - 1) * (xs->len - 1) +
+                                     column - 1];
+  if (index == 0)
+    return NULL;
+  return &g_array_index(window_stack.entries, StackEntry, index - 1);
+}
+
+static GdkWindow *find_window_at_coords(gint x, gint y) {
+  if (!ensure_window_stack())
+    return NULL;
+
+  StackEntry *entry = lookup_window_stack(x * window_stack.scale,
+                                          y * window_stack.scale);
+  if (!entry)
+    return NULL;
+
+  GdkWindow *window = gdk_x11_window_foreign_new_for_display(
+      window_stack.gdk_display, entry->client);
+  if (!window)
+    return NULL;
+
+  // This is included here to handle a hypothetical scenario where
+  // the window doesn't exist by the time it must be captured.
+  // We actually don't try to find the window before the delay, We find it
+  // right before capturing it. So this precaution might not be necessary.
+  gdk_window_set_events(window,
+                        gdk_window_get_events(window) | GDK_STRUCTURE_MASK);
+  return window;
+}
+
+gboolean makas_find_window_x11(gint x, gint y, GdkRectangle *out_rect) {
+  if (!ensure_window_stack())
+    return FALSE;
+
+  gint scale = window_stack.scale;
+  StackEntry *entry = lookup_window_stack(x * scale, y * scale);
+  GdkRectangle rect;
+  if (!entry || !get_pickable_rect(entry, &rect))
+    return FALSE;
+
+  if (out_rect)
+    *out_rect = (GdkRectangle){rect.x / scale, rect.y / scale,
+                               rect.width / scale, rect.height / scale};
+  return TRUE;
+}
+
+static Visual *find_argb_visual(Display *display) {
+  XVisualInfo info;
+
+  if (!XMatchVisualInfo(display, DefaultScreen(display), 32, TrueColor, &info))
     return NULL;
+  return info.visual;
+}
+
+/* XRender composites premultiplied ARGB, GdkPixbuf expects straight alpha */
+static void unpremultiply_pixbuf(GdkPixbuf *pixbuf) {
+  int width = gdk_pixbuf_get_width(pixbuf);
+  int height = gdk_pixbuf_get_height(pixbuf);
+  int rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+  guchar *pixels = gdk_pixbuf_get_pixels(pixbuf);
+
+  for (int y = 0; y < height; y++) {
+    guchar *p = pixels + y * rowstride;
+    for (int x = 0; x < width; x++, p += 4) {
+      guint a = p[3];
+      if (a == 0 || a == 255)
+        continue;
+      for (int c = 0; c < 3; c++)
+        p[c] = MIN(255, (p[c] * 255 + a / 2) / a);
+    }
   }
+}
 
-  /* Create XImage from the pixmap */
-  XImage *image =
-      XGetImage(display, pixmap, 0, 0, width, height, AllPlanes, ZPixmap);
-  if (!image) {
-    g_warning("XGetImage failed");
-    XFreePixmap(display, pixmap);
-    XCompositeUnredirectWindow(display, wm_xid, CompositeRedirectAutomatic);
+GdkPixbuf *makas_window_thumbnail_x11(gint x, gint y, gint max_size) {
+  g_return_val_if_fail(max_size > 0, NULL);
+
+  if (!ensure_window_stack())
+    return NULL;
+
+  Display *display = window_stack.display;
+  gint scale = window_stack.scale;
+  StackEntry *entry = lookup_window_stack(x * scale, y * scale);
+  if (!entry)
+    return NULL;
+
+  WindowPixmap *window_pixmap = get_window_pixmap(entry->frame);
+  Visual *argb_visual = find_argb_visual(display);
+  if (!window_pixmap || !argb_visual)
     return NULL;
+
+  gdouble factor = MIN(1.0, (gdouble)max_size * scale /
+                                MAX(window_pixmap->width,
+                                    window_pixmap->height));
+  gint width = MAX(1, (gint)(window_pixmap->width * factor + 0.5));
+  gint height = MAX(1, (gint)(window_pixmap->height * factor + 0.5));
+
+  gdk_x11_display_error_trap_push(window_stack.gdk_display);
+
+  if (window_pixmap->picture == None) {
+    XRenderPictFormat *format =
+        XRenderFindVisualFormat(display, window_pixmap->visual);
+    window_pixmap->picture =
+        XRenderCreatePicture(display, window_pixmap->pixmap, format, 0, NULL);
   }
 
-  /* Determine if we have alpha channel */
-  gboolean has_alpha = (image->depth == 32);
+  /* Let the server do the downscaling, only the thumbnail leaves it */
+  XTransform transform = {{
+      {XDoubleToFixed(1 / factor), 0, 0},
+      {0, XDoubleToFixed(1 / factor), 0},
+      {0, 0, XDoubleToFixed(1)},
+  }};
+  XRenderSetPictureTransform(display, window_pixmap->picture, &transform);
+  XRenderSetPictureFilter(display, window_pixmap->picture,
+                          factor < 1.0 ? FilterBilinear : FilterNearest, NULL,
+                          0);
+
+  Pixmap thumbnail =
+      XCreatePixmap(display, window_stack.root, width, height, 32);
+  Picture picture = XRenderCreatePicture(
+      display, thumbnail,
+      XRenderFindStandardFormat(display, PictStandardARGB32), 0, NULL);
+  XRenderComposite(display, PictOpSrc, window_pixmap->picture, None, picture,
+                   0, 0, 0, 0, 0, 0, width, height);
+  XRenderFreePicture(display, picture);
+
+  gboolean shm;
+  XImage *image =
+      get_image(display, thumbnail, argb_visual, 32, 0, 0, width, height, &shm);
+  XFreePixmap(display, thumbnail);
 
-  /* Create GdkPixbuf from XImage data */
-  screenshot = gdk_pixbuf_new(GDK_COLORSPACE_RGB, has_alpha, 8, width, height);
-  if (!screenshot) {
-    XDestroyImage(image);
-    XFreePixmap(display, pixmap);
-    XCompositeUnredirectWindow(display, wm_xid, CompositeRedirectAutomatic);
+  if (gdk_x11_display_error_trap_pop(window_stack.gdk_display) != 0 &&
+      image) {
+    release_image(image, shm);
     return NULL;
   }
+  if (!image)
+    return NULL;
 
-  guchar *pixels = gdk_pixbuf_get_pixels(screenshot);
-  int rowstride = gdk_pixbuf_get_rowstride(screenshot);
-  int n_channels = gdk_pixbuf_get_n_channels(screenshot);
+  GdkPixbuf *pixbuf = image_to_pixbuf(image, TRUE);
+  release_image(image, shm);
+  if (pixbuf)
+    unpremultiply_pixbuf(pixbuf);
+  return pixbuf;
+}
 
-  /* Copy pixels from XImage to GdkPixbuf */
-  for (int y = 0; y < height; y++) {
-    for (int x = 0; x < width; x++) {
-      unsigned long pixel = XGetPixel(image, x, y);
-      guchar *p = pixels + y * rowstride + x * n_channels;
+void makas_release_window_pixmaps_x11(void) {
+  if (window_stack.pixmaps)
+    g_hash_table_remove_all(window_stack.pixmaps);
+}
 
-      /* Extract RGB(A) - X11 stores in BGRA for 32-bit */
-      if (image->depth == 32) {
-        p[0] = (pixel >> 16) & 0xFF; /* R */
-        p[1] = (pixel >> 8) & 0xFF;  /* G */
-        p[2] = pixel & 0xFF;         /* B */
-        p[3] = (pixel >> 24) & 0xFF; /* A */
-      } else {
-        p[0] = (pixel >> 16) & 0xFF; /* R */
-        p[1] = (pixel >> 8) & 0xFF;  /* G */
-        p[2] = pixel & 0xFF;         /* B */
-        if (has_alpha)
-          p[3] = 255;
-      }
-    }
+/* Capture window using XComposite to get full content (even
+ * off-screen/occluded) */
+static GdkPixbuf *capture_window_pixmap(Display *display, Window wm_xid,
+                                        gint width, gint height) {
+  GdkPixbuf *screenshot = NULL;
+
+  if (!ensure_window_stack())
+    return NULL;
+
+  /* A window shown in a preview is still redirected, reuse its pixmap */
+  gboolean previewed = lookup_window_pixmap(wm_xid) != NULL;
+  WindowPixmap *window_pixmap = get_window_pixmap(wm_xid);
+  if (!window_pixmap)
+    return NULL;
+
+  /* Read the pixmap through the shared segment when possible */
+  gboolean shm;
+  XImage *image = get_image(
+      display, window_pixmap->pixmap, window_pixmap->visual,
+      window_pixmap->depth, 0, 0, MIN(width, window_pixmap->width),
+      MIN(height, window_pixmap->height), &shm);
+  if (!image) {
+    g_warning("XGetImage failed");
+  } else {
+    screenshot = image_to_pixbuf(image, window_pixmap->depth == 32);
+    release_image(image, shm);
   }
 
-  XDestroyImage(image);
-  XFreePixmap(display, pixmap);
-  XCompositeUnredirectWindow(display, wm_xid, CompositeRedirectAutomatic);
+  if (!previewed)
+    g_hash_table_remove(window_stack.pixmaps, GSIZE_TO_POINTER(wm_xid));
 
   return screenshot;
 }
@@ -198,39 +902,44 @@ static void apply_xshape_mask(GdkPixbuf *pixbuf, Display *display,
     return;
   }
 
-  /* Create a visibility map */
-  gboolean *visible = g_new0(gboolean, width * height);
-
-  /* Mark visible pixels based on XShape rectangles */
+  /* Union of the visible rectangles */
+  pixman_box32_t *boxes = g_new(pixman_box32_t, rectangle_count);
   for (int i = 0; i < rectangle_count; i++) {
     int rx = rectangles[i].x / scale_factor;
     int ry = rectangles[i].y / scale_factor;
-    int rw = rectangles[i].width / scale_factor;
-    int rh = rectangles[i].height / scale_factor;
-
-    for (int y = ry; y < ry + rh && y < height; y++) {
-      for (int x = rx; x < rx + rw && x < width; x++) {
-        if (x >= 0 && y >= 0)
-          visible[y * width + x] = TRUE;
-      }
-    }
+    boxes[i] = (pixman_box32_t){
+        .x1 = rx,
+        .y1 = ry,
+        .x2 = rx + rectangles[i].width / scale_factor,
+        .y2 = ry + rectangles[i].height / scale_factor,
+    };
   }
+  XFree(rectangles);
+
+  pixman_region32_t visible, hidden;
+  pixman_region32_init_rects(&visible, boxes, rectangle_count);
+  g_free(boxes);
+
+  /* Only the pixels outside the shape are touched, span by span */
+  pixman_box32_t bounds = {0, 0, width, height};
+  pixman_region32_init(&hidden);
+  pixman_region32_inverse(&hidden, &visible, &bounds);
 
-  /* Set alpha to 0 for non-visible pixels */
   guchar *pixels = gdk_pixbuf_get_pixels(pixbuf);
   int rowstride = gdk_pixbuf_get_rowstride(pixbuf);
 
-  for (int y = 0; y < height; y++) {
-    for (int x = 0; x < width; x++) {
-      if (!visible[y * width + x]) {
-        guchar *p = pixels + y * rowstride + x * 4;
-        p[3] = 0; /* Set alpha to transparent */
-      }
+  int n_spans;
+  pixman_box32_t *spans = pixman_region32_rectangles(&hidden, &n_spans);
+  for (int i = 0; i < n_spans; i++) {
+    for (int y = spans[i].y1; y < spans[i].y2; y++) {
+      guchar *p = pixels + y * rowstride + spans[i].x1 * 4 + 3;
+      for (int x = spans[i].x1; x < spans[i].x2; x++, p += 4)
+        *p = 0; /* Set alpha to transparent */
     }
   }
 
-  g_free(visible);
-  XFree(rectangles);
+  pixman_region32_fini(&hidden);
+  pixman_region32_fini(&visible);
 }
 
 /* Capture window logic implemented below */
@@ -259,12 +968,14 @@ GdkPixbuf *makas_capture_window_x11(gint x, gint y, gint *out_x_offset,
   wm_xid = find_wm_window(window);
   if (wm_xid == None) {
     g_warning("Could not find WM window");
+    g_object_unref(window);
     return NULL;
   }
 
   /* Get GdkWindow for the WM frame */
   wm_window = gdk_x11_window_foreign_new_for_display(
       gdk_window_get_display(window), wm_xid);
+  g_object_unref(window);
 
   GdkRectangle frame_rect;
   gdk_window_get_frame_extents(wm_window, &frame_rect);
@@ -337,3 +1048,50 @@ GdkPixbuf *makas_capture_window_x11(gint x, gint y, gint *out_x_offset,
 
   return screenshot;
 }
+
+GdkPixbuf *makas_capture_region_x11(gint x, gint y, gint width, gint height) {
+  g_return_val_if_fail(width > 0 && height > 0, NULL);
+
+  GdkDisplay *gdk_display = gdk_display_get_default();
+  if (!GDK_IS_X11_DISPLAY(gdk_display))
+    return NULL;
+
+  Display *display = GDK_DISPLAY_XDISPLAY(gdk_display);
+  Window root = DefaultRootWindow(display);
+  XWindowAttributes attrs;
+  if (!XGetWindowAttributes(display, root, &attrs)) {
+    g_warning("Failed to get root window attributes");
+    return NULL;
+  }
+
+  /* XGetImage fails on anything outside the root window */
+  GdkRectangle root_rect = {0, 0, attrs.width, attrs.height};
+  GdkRectangle rect = {x, y, width, height};
+  if (!gdk_rectangle_intersect(&root_rect, &rect, &rect)) {
+    g_warning("Region is outside of the screen");
+    return NULL;
+  }
+
+  gboolean shm;
+  XImage *image = get_image(display, root, attrs.visual, attrs.depth, rect.x,
+                            rect.y, rect.width, rect.height, &shm);
+  if (!image) {
+    g_warning("Failed to read the root window");
+    return NULL;
+  }
+
+  GdkPixbuf *pixbuf = image_to_pixbuf(image, FALSE);
+  release_image(image, shm);
+  return pixbuf;
+}
+
+GdkPixbuf *makas_capture_screen_x11(void) {
+  GdkDisplay *gdk_display = gdk_display_get_default();
+  if (!GDK_IS_X11_DISPLAY(gdk_display))
+    return NULL;
+
+  Display *display = GDK_DISPLAY_XDISPLAY(gdk_display);
+  Screen *screen = DefaultScreenOfDisplay(display);
+  return makas_capture_region_x11(0, 0, WidthOfScreen(screen),
+                                  HeightOfScreen(screen));
+}
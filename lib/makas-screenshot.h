@@ -22,6 +22,71 @@ G_BEGIN_DECLS
 GdkPixbuf *makas_capture_window_x11(gint x, gint y, gint *out_x_offset,
                                     gint *out_y_offset);
 
+/**
+ * makas_find_window_x11:
+ * @x: X coordinate to look at
+ * @y: Y coordinate to look at
+ * @out_rect: (out caller-allocates) (optional): Return location for the frame
+ * of the window
+ *
+ * Finds the window makas_capture_window_x11() would capture at @x, @y. The
+ * window stack is cached and kept up to date from X events, so this is cheap
+ * enough to call on every pointer motion.
+ *
+ * Returns: TRUE if there is a window at @x, @y
+ */
+gboolean makas_find_window_x11(gint x, gint y, GdkRectangle *out_rect);
+
+/**
+ * makas_window_thumbnail_x11:
+ * @x: X coordinate of the window
+ * @y: Y coordinate of the window
+ * @max_size: Largest side of the thumbnail
+ *
+ * Scales the window makas_find_window_x11() finds at @x, @y down on the X
+ * server with XRender and reads back only the thumbnail. The window stays
+ * redirected with its composite pixmap named, so further thumbnails are live
+ * and a following makas_capture_window_x11() reuses the pixmap. Call
+ * makas_release_window_pixmaps_x11() once done.
+ *
+ * Returns: (transfer full) (nullable): The thumbnail, or NULL on failure
+ */
+GdkPixbuf *makas_window_thumbnail_x11(gint x, gint y, gint max_size);
+
+/**
+ * makas_release_window_pixmaps_x11:
+ *
+ * Frees the pixmaps kept by makas_window_thumbnail_x11() and unredirects
+ * their windows.
+ */
+void makas_release_window_pixmaps_x11(void);
+
+/**
+ * makas_capture_screen_x11:
+ *
+ * Captures the whole X11 screen. Uses MIT-SHM when the server supports it,
+ * so the pixels don't travel over the X socket.
+ *
+ * Returns: (transfer full) (nullable): A GdkPixbuf with the screenshot, or NULL
+ * on failure
+ */
+GdkPixbuf *makas_capture_screen_x11(void);
+
+/**
+ * makas_capture_region_x11:
+ * @x: X coordinate of the region, in root window pixels
+ * @y: Y coordinate of the region, in root window pixels
+ * @width: Width of the region
+ * @height: Height of the region
+ *
+ * Captures a region of the X11 screen, clipped to the root window. Uses
+ * MIT-SHM like makas_capture_screen_x11().
+ *
+ * Returns: (transfer full) (nullable): A GdkPixbuf with the screenshot, or NULL
+ * on failure
+ */
+GdkPixbuf *makas_capture_region_x11(gint x, gint y, gint width, gint height);
+
 G_END_DECLS
 
 #endif /* MAKAS_SCREENSHOT_H */
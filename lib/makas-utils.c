@@ -1,229 +1,576 @@
 #include "makas-utils.h"
-#include <dlfcn.h>
-#include <stdint.h>
-#include <stdio.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
 #include <string.h>
+#include <wayland-client.h>
+#ifdef GDK_WINDOWING_WAYLAND
+#include <gdk/gdkwayland.h>
+#endif
+
+// Upper bound for the probe, some compositors never answer the sync request
+// of a client they don't expect (Budgie used to hang here)
+#define PROBE_TIMEOUT_MS 2000
+
+struct _MakasWaylandCapabilities {
+  GObject parent_instance;
+
+  gboolean connected;
+  guint n_outputs;
+  // Interface name -> highest advertised version
+  GHashTable *globals;
+};
 
-// Minimal Wayland opaque types and function signatures
-typedef void (*wl_registry_global_func_t)(void *, void *, uint32_t,
-                                          const char *, uint32_t);
-struct wl_registry_listener {
-  wl_registry_global_func_t global;
-  void (*global_remove)(void *, void *, uint32_t);
+G_DEFINE_TYPE(MakasWaylandCapabilities, makas_wayland_capabilities,
+              G_TYPE_OBJECT)
+
+enum {
+  PROP_0,
+  PROP_CONNECTED,
+  PROP_N_OUTPUTS,
+  PROP_CAN_CAPTURE,
+  PROP_CAN_CAPTURE_TOPLEVELS,
+  PROP_HAS_LAYER_SHELL,
+  N_PROPS
 };
 
-// Struct to track which globals are advertised by the compositor
-typedef struct {
-  gboolean has_shm;
-  gboolean has_zxdg_output_manager;
-  gboolean has_ext_output_image_capture_source_manager;
-  gboolean has_ext_foreign_toplevel_image_capture_source_manager;
-  gboolean has_ext_image_copy_capture_manager;
-  gboolean has_screencopy_manager;
-  gboolean has_outputs;
-  gboolean has_layer_shell;
-} MakasGrimSupportState;
-
-// Registry listener to populate state
-static void grim_support_registry_handler(void *data,
-                                          G_GNUC_UNUSED void *registry,
-                                          G_GNUC_UNUSED uint32_t name,
-                                          const char *interface,
-                                          G_GNUC_UNUSED uint32_t version) {
-  MakasGrimSupportState *state = (MakasGrimSupportState *)data;
-
-  if (strcmp(interface, "wl_shm") == 0) {
-    state->has_shm = TRUE;
-  } else if (strcmp(interface, "zxdg_output_manager_v1") == 0) {
-    state->has_zxdg_output_manager = TRUE;
-  } else if (strcmp(interface, "wl_output") == 0) {
-    state->has_outputs = TRUE;
-  } else if (strcmp(interface, "ext_output_image_capture_source_manager_v1") ==
-             0) {
-    state->has_ext_output_image_capture_source_manager = TRUE;
-  } else if (strcmp(interface,
-                    "ext_foreign_toplevel_image_capture_source_manager_v1") ==
-             0) {
-    state->has_ext_foreign_toplevel_image_capture_source_manager = TRUE;
-  } else if (strcmp(interface, "ext_image_copy_capture_manager_v1") == 0) {
-    state->has_ext_image_copy_capture_manager = TRUE;
-  } else if (strcmp(interface, "zwlr_screencopy_manager_v1") == 0) {
-    state->has_screencopy_manager = TRUE;
-  } else if (strcmp(interface, "zwlr_layer_shell_v1") == 0) {
-    state->has_layer_shell = TRUE;
+static GParamSpec *properties[N_PROPS];
+
+static void makas_wayland_capabilities_get_property(GObject *object,
+                                                    guint prop_id,
+                                                    GValue *value,
+                                                    GParamSpec *pspec) {
+  MakasWaylandCapabilities *self = MAKAS_WAYLAND_CAPABILITIES(object);
+
+  switch (prop_id) {
+  case PROP_CONNECTED:
+    g_value_set_boolean(value, self->connected);
+    break;
+  case PROP_N_OUTPUTS:
+    g_value_set_uint(value, self->n_outputs);
+    break;
+  case PROP_CAN_CAPTURE:
+    g_value_set_boolean(value,
+                        makas_wayland_capabilities_get_can_capture(self));
+    break;
+  case PROP_CAN_CAPTURE_TOPLEVELS:
+    g_value_set_boolean(
+        value, makas_wayland_capabilities_get_can_capture_toplevels(self));
+    break;
+  case PROP_HAS_LAYER_SHELL:
+    g_value_set_boolean(value,
+                        makas_wayland_capabilities_get_has_layer_shell(self));
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
   }
 }
 
-gboolean makas_utils_is_grim_supported(void) {
-  void *handle = dlopen("libwayland-client.so.0", RTLD_LAZY);
-  if (!handle) {
-    fprintf(stderr, "DEBUG: Failed to dlopen libwayland-client.so.0: %s\n",
-            dlerror());
-    return FALSE;
+static void makas_wayland_capabilities_finalize(GObject *object) {
+  MakasWaylandCapabilities *self = MAKAS_WAYLAND_CAPABILITIES(object);
+
+  g_hash_table_unref(self->globals);
+
+  G_OBJECT_CLASS(makas_wayland_capabilities_parent_class)->finalize(object);
+}
+
+static void
+makas_wayland_capabilities_class_init(MakasWaylandCapabilitiesClass *klass) {
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+  object_class->finalize = makas_wayland_capabilities_finalize;
+  object_class->get_property = makas_wayland_capabilities_get_property;
+
+  properties[PROP_CONNECTED] = g_param_spec_boolean(
+      "connected", NULL, NULL, FALSE,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  properties[PROP_N_OUTPUTS] =
+      g_param_spec_uint("n-outputs", NULL, NULL, 0, G_MAXUINT, 0,
+                        G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  properties[PROP_CAN_CAPTURE] = g_param_spec_boolean(
+      "can-capture", NULL, NULL, FALSE,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  properties[PROP_CAN_CAPTURE_TOPLEVELS] = g_param_spec_boolean(
+      "can-capture-toplevels", NULL, NULL, FALSE,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  properties[PROP_HAS_LAYER_SHELL] = g_param_spec_boolean(
+      "has-layer-shell", NULL, NULL, FALSE,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_properties(object_class, N_PROPS, properties);
+}
+
+static void makas_wayland_capabilities_init(MakasWaylandCapabilities *self) {
+  self->globals = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+}
+
+// Registry listener to populate the capabilities
+static void probe_registry_handle_global(void *data,
+                                         G_GNUC_UNUSED struct wl_registry *registry,
+                                         G_GNUC_UNUSED uint32_t name,
+                                         const char *interface,
+                                         uint32_t version) {
+  MakasWaylandCapabilities *self = data;
+
+  guint known = GPOINTER_TO_UINT(g_hash_table_lookup(self->globals, interface));
+  if (version > known) {
+    g_hash_table_insert(self->globals, g_strdup(interface),
+                        GUINT_TO_POINTER(version));
   }
 
-  // Symbol loading
-  void *(*wl_display_connect)(const char *) =
-      dlsym(handle, "wl_display_connect");
-  // wl_display_get_registry is often inline, so we use the underlying marshal
-  // function
-  void *(*wl_proxy_marshal_constructor)(void *, uint32_t, void *, ...) =
-      dlsym(handle, "wl_proxy_marshal_constructor");
-  void *wl_registry_interface = dlsym(handle, "wl_registry_interface");
-
-  int (*wl_proxy_add_listener)(void *, void (**)(void), void *) =
-      dlsym(handle, "wl_proxy_add_listener");
-  int (*wl_display_roundtrip)(void *) = dlsym(handle, "wl_display_roundtrip");
-  void (*wl_display_disconnect)(void *) =
-      dlsym(handle, "wl_display_disconnect");
-
-  if (!wl_display_connect || !wl_proxy_marshal_constructor ||
-      !wl_registry_interface || !wl_proxy_add_listener ||
-      !wl_display_roundtrip || !wl_display_disconnect) {
-    if (!wl_display_connect)
-      fprintf(stderr, "DEBUG: Missing wl_display_connect\n");
-    if (!wl_proxy_marshal_constructor)
-      fprintf(stderr, "DEBUG: Missing wl_proxy_marshal_constructor\n");
-    if (!wl_registry_interface)
-      fprintf(stderr, "DEBUG: Missing wl_registry_interface\n");
-    if (!wl_proxy_add_listener)
-      fprintf(stderr, "DEBUG: Missing wl_proxy_add_listener\n");
-    if (!wl_display_roundtrip)
-      fprintf(stderr, "DEBUG: Missing wl_display_roundtrip\n");
-    if (!wl_display_disconnect)
-      fprintf(stderr, "DEBUG: Missing wl_display_disconnect\n");
-
-    fprintf(stderr, "DEBUG: Failed to load symbols from libwayland-client\n");
-    dlclose(handle);
-    return FALSE;
+  if (strcmp(interface, "wl_output") == 0) {
+    self->n_outputs++;
   }
+}
 
-  void *display = wl_display_connect(NULL);
-  if (!display) {
-    fprintf(stderr, "DEBUG: Failed to connect to Wayland display\n");
-    dlclose(handle);
-    return FALSE;
+static void probe_registry_handle_global_remove(
+    G_GNUC_UNUSED void *data, G_GNUC_UNUSED struct wl_registry *registry,
+    G_GNUC_UNUSED uint32_t name) {
+  // No-op
+}
+
+static const struct wl_registry_listener probe_registry_listener = {
+    .global = probe_registry_handle_global,
+    .global_remove = probe_registry_handle_global_remove,
+};
+
+static void probe_sync_handle_done(void *data,
+                                   G_GNUC_UNUSED struct wl_callback *callback,
+                                   G_GNUC_UNUSED uint32_t serial) {
+  gboolean *done = data;
+  *done = TRUE;
+}
+
+static const struct wl_callback_listener probe_sync_listener = {
+    .done = probe_sync_handle_done,
+};
+
+/* Connects once and records every global the compositor advertises. Unlike
+ * wl_display_roundtrip() the wait is bounded and can be cancelled. Returns
+ * NULL only if cancelled. @complete is cleared when the probe timed out or the
+ * connection broke, so the answer may change on a later try. */
+static MakasWaylandCapabilities *probe_wayland(GCancellable *cancellable,
+                                               gboolean *complete) {
+  MakasWaylandCapabilities *self =
+      g_object_new(MAKAS_TYPE_WAYLAND_CAPABILITIES, NULL);
+
+  struct wl_display *display = wl_display_connect(NULL);
+  if (display == NULL) {
+    // No compositor to talk to, that won't change
+    g_debug("Failed to connect to Wayland display");
+    *complete = TRUE;
+    return self;
   }
 
-  // Initialize checks
-  MakasGrimSupportState state = {0};
-  // WL_DISPLAY_GET_REGISTRY = 1
-  void *registry =
-      wl_proxy_marshal_constructor(display, 1, wl_registry_interface, NULL);
+  gboolean done = FALSE;
+  struct wl_registry *registry = wl_display_get_registry(display);
+  wl_registry_add_listener(registry, &probe_registry_listener, self);
+  struct wl_callback *callback = wl_display_sync(display);
+  wl_callback_add_listener(callback, &probe_sync_listener, &done);
+
+  gint64 deadline = g_get_monotonic_time() + PROBE_TIMEOUT_MS * 1000;
+  int cancel_fd = g_cancellable_get_fd(cancellable);
+  while (!done && !g_cancellable_is_cancelled(cancellable)) {
+    int timeout = (deadline - g_get_monotonic_time()) / 1000;
+    if (timeout <= 0) {
+      g_warning("Wayland capability probe timed out after %d ms",
+                PROBE_TIMEOUT_MS);
+      break;
+    }
+
+    while (wl_display_prepare_read(display) != 0) {
+      wl_display_dispatch_pending(display);
+    }
+    wl_display_flush(display);
+
+    struct pollfd pfds[2] = {
+        {.fd = wl_display_get_fd(display), .events = POLLIN},
+        {.fd = cancel_fd, .events = POLLIN},
+    };
+    int ret = poll(pfds, cancel_fd != -1 ? 2 : 1, timeout);
+    if (ret > 0 && (pfds[0].revents & (POLLIN | POLLERR | POLLHUP))) {
+      if (wl_display_read_events(display) < 0) {
+        break;
+      }
+    } else {
+      wl_display_cancel_read(display);
+      if (ret < 0 && errno != EINTR) {
+        break;
+      }
+    }
+
+    if (wl_display_dispatch_pending(display) < 0) {
+      break;
+    }
+  }
+  g_cancellable_release_fd(cancellable);
 
-  if (!registry) {
-    fprintf(stderr, "DEBUG: Failed to get registry\n");
-    wl_display_disconnect(display);
-    dlclose(handle);
-    return FALSE;
+  wl_callback_destroy(callback);
+  wl_registry_destroy(registry);
+  wl_display_disconnect(display);
+
+  if (g_cancellable_is_cancelled(cancellable)) {
+    g_object_unref(self);
+    return NULL;
   }
 
-  struct wl_registry_listener listener = {
-      .global = grim_support_registry_handler, .global_remove = NULL};
+  self->connected = done;
+  *complete = done;
+  return self;
+}
 
-  wl_proxy_add_listener(registry, (void (**)(void))&listener, &state);
+// Guards the fields below, never held across the probe itself
+static GMutex probe_lock;
+static GCond probe_cond;
+static gboolean probe_running = FALSE;
+// Bumped whenever a probe ends, waiters compare it to spot their probe
+static guint probe_generation = 0;
+// Set by the first probe that got an answer, kept for the process lifetime
+static MakasWaylandCapabilities *cached_capabilities = NULL;
+// Last timed out probe, handed to the callers that waited on it
+static MakasWaylandCapabilities *last_capabilities = NULL;
+
+/* Probes until one probe completes. Concurrent callers wait for the probe in
+ * flight instead of opening their own connection. */
+static MakasWaylandCapabilities *get_capabilities(GCancellable *cancellable) {
+  MakasWaylandCapabilities *capabilities;
+
+  g_mutex_lock(&probe_lock);
+  while (cached_capabilities == NULL && probe_running) {
+    guint generation = probe_generation;
+    while (probe_generation == generation) {
+      g_cond_wait(&probe_cond, &probe_lock);
+    }
+
+    if (cached_capabilities == NULL && last_capabilities != NULL) {
+      capabilities = g_object_ref(last_capabilities);
+      g_mutex_unlock(&probe_lock);
+      return capabilities;
+    }
+  }
 
-  if (wl_display_roundtrip(display) < 0) {
-    fprintf(stderr, "DEBUG: wl_display_roundtrip failed\n");
-    wl_display_disconnect(display);
-    dlclose(handle);
-    return FALSE;
+  if (cached_capabilities != NULL) {
+    capabilities = g_object_ref(cached_capabilities);
+    g_mutex_unlock(&probe_lock);
+    return capabilities;
+  }
+  probe_running = TRUE;
+  g_mutex_unlock(&probe_lock);
+
+  gboolean complete = FALSE;
+  capabilities = probe_wayland(cancellable, &complete);
+
+  g_mutex_lock(&probe_lock);
+  probe_running = FALSE;
+  probe_generation++;
+  g_clear_object(&last_capabilities);
+  if (capabilities != NULL && complete) {
+    cached_capabilities = g_object_ref(capabilities);
+  } else if (capabilities != NULL) {
+    last_capabilities = g_object_ref(capabilities);
   }
+  g_cond_broadcast(&probe_cond);
+  g_mutex_unlock(&probe_lock);
 
-  wl_display_disconnect(display);
-  dlclose(handle);
+  return capabilities;
+}
 
-  // Logic copied from grim/main.c
+static void probe_wayland_thread(GTask *task,
+                                 G_GNUC_UNUSED gpointer source_object,
+                                 G_GNUC_UNUSED gpointer task_data,
+                                 GCancellable *cancellable) {
+  MakasWaylandCapabilities *capabilities = get_capabilities(cancellable);
+  if (capabilities == NULL) {
+    g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                            "Wayland capability probe was cancelled");
+    return;
+  }
 
-  // 1. Check for SHM
-  if (!state.has_shm) {
-    fprintf(stderr, "DEBUG: Missing wl_shm\n");
-    return FALSE;
+  g_task_return_pointer(task, capabilities, g_object_unref);
+}
+
+void makas_utils_probe_wayland_async(GCancellable *cancellable,
+                                     GAsyncReadyCallback callback,
+                                     gpointer user_data) {
+  GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+  g_task_set_source_tag(task, makas_utils_probe_wayland_async);
+
+  g_mutex_lock(&probe_lock);
+  MakasWaylandCapabilities *capabilities =
+      cached_capabilities != NULL ? g_object_ref(cached_capabilities) : NULL;
+  g_mutex_unlock(&probe_lock);
+
+  if (capabilities != NULL) {
+    g_task_return_pointer(task, capabilities, g_object_unref);
+  } else {
+    g_task_run_in_thread(task, probe_wayland_thread);
   }
+  g_object_unref(task);
+}
 
-  // 2. Check for capture capability
-  gboolean can_capture = state.has_screencopy_manager ||
-                         (state.has_ext_output_image_capture_source_manager &&
-                          state.has_ext_image_copy_capture_manager);
+MakasWaylandCapabilities *makas_utils_probe_wayland_finish(GAsyncResult *result,
+                                                           GError **error) {
+  g_return_val_if_fail(g_task_is_valid(result, NULL), NULL);
 
-  if (!can_capture) {
-    fprintf(stderr,
-            "DEBUG: Missing capture managers. Screencopy: %d, ExtSrc: %d, "
-            "ExtCopy: %d\n",
-            state.has_screencopy_manager,
-            state.has_ext_output_image_capture_source_manager,
-            state.has_ext_image_copy_capture_manager);
-    return FALSE;
+  return g_task_propagate_pointer(G_TASK(result), error);
+}
+
+MakasWaylandCapabilities *makas_utils_get_wayland_capabilities(void) {
+  return get_capabilities(NULL);
+}
+
+gboolean
+makas_wayland_capabilities_get_connected(MakasWaylandCapabilities *self) {
+  g_return_val_if_fail(MAKAS_IS_WAYLAND_CAPABILITIES(self), FALSE);
+
+  return self->connected;
+}
+
+guint makas_wayland_capabilities_get_n_outputs(MakasWaylandCapabilities *self) {
+  g_return_val_if_fail(MAKAS_IS_WAYLAND_CAPABILITIES(self), 0);
+
+  return self->n_outputs;
+}
+
+guint makas_wayland_capabilities_get_version(MakasWaylandCapabilities *self,
+                                             const gchar *interface) {
+  g_return_val_if_fail(MAKAS_IS_WAYLAND_CAPABILITIES(self), 0);
+  g_return_val_if_fail(interface != NULL, 0);
+
+  return GPOINTER_TO_UINT(g_hash_table_lookup(self->globals, interface));
+}
+
+gboolean makas_wayland_capabilities_has_global(MakasWaylandCapabilities *self,
+                                               const gchar *interface) {
+  return makas_wayland_capabilities_get_version(self, interface) > 0;
+}
+
+static int compare_interfaces(const void *a, const void *b) {
+  return strcmp(*(const gchar *const *)a, *(const gchar *const *)b);
+}
+
+gchar **makas_wayland_capabilities_list_globals(MakasWaylandCapabilities *self) {
+  g_return_val_if_fail(MAKAS_IS_WAYLAND_CAPABILITIES(self), NULL);
+
+  guint n_globals = 0;
+  gchar **globals = (gchar **)g_hash_table_get_keys_as_array(self->globals,
+                                                             &n_globals);
+  gchar **sorted = g_new0(gchar *, n_globals + 1);
+  for (guint i = 0; i < n_globals; i++) {
+    sorted[i] = g_strdup(globals[i]);
   }
+  g_free(globals);
+
+  qsort(sorted, n_globals, sizeof(gchar *), compare_interfaces);
+  return sorted;
+}
 
-  // 3. Check for outputs (grim requires at least one output if not capturing a
-  // specific toplevel)
-  if (!state.has_outputs) {
-    fprintf(stderr, "DEBUG: No wl_output found\n");
+gboolean
+makas_wayland_capabilities_get_can_capture(MakasWaylandCapabilities *self) {
+  g_return_val_if_fail(MAKAS_IS_WAYLAND_CAPABILITIES(self), FALSE);
+
+  // Logic copied from grim/main.c
+  if (!self->connected ||
+      !makas_wayland_capabilities_has_global(self, "wl_shm")) {
     return FALSE;
   }
 
-  // printf("DEBUG: Grim support check passed\n");
-  return TRUE;
+  gboolean has_screencopy = makas_wayland_capabilities_has_global(
+      self, "zwlr_screencopy_manager_v1");
+  gboolean has_ext_image_copy =
+      makas_wayland_capabilities_has_global(
+          self, "ext_output_image_capture_source_manager_v1") &&
+      makas_wayland_capabilities_has_global(
+          self, "ext_image_copy_capture_manager_v1");
+
+  // grim requires at least one output if not capturing a specific toplevel
+  return (has_screencopy || has_ext_image_copy) && self->n_outputs > 0;
+}
+
+gboolean makas_wayland_capabilities_get_can_capture_toplevels(
+    MakasWaylandCapabilities *self) {
+  g_return_val_if_fail(MAKAS_IS_WAYLAND_CAPABILITIES(self), FALSE);
+
+  return self->connected &&
+         makas_wayland_capabilities_has_global(self, "wl_shm") &&
+         makas_wayland_capabilities_has_global(
+             self, "ext_foreign_toplevel_list_v1") &&
+         makas_wayland_capabilities_has_global(
+             self, "ext_foreign_toplevel_image_capture_source_manager_v1") &&
+         makas_wayland_capabilities_has_global(
+             self, "ext_image_copy_capture_manager_v1");
+}
+
+gboolean
+makas_wayland_capabilities_get_has_layer_shell(MakasWaylandCapabilities *self) {
+  g_return_val_if_fail(MAKAS_IS_WAYLAND_CAPABILITIES(self), FALSE);
+
+  return self->connected &&
+         makas_wayland_capabilities_has_global(self, "zwlr_layer_shell_v1");
+}
+
+gboolean makas_utils_is_grim_supported(void) {
+  MakasWaylandCapabilities *capabilities =
+      makas_utils_get_wayland_capabilities();
+  gboolean supported = makas_wayland_capabilities_get_can_capture(capabilities);
+  g_object_unref(capabilities);
+
+  return supported;
 }
 
 gboolean makas_utils_is_layer_shell_supported(void) {
-  void *handle = dlopen("libwayland-client.so.0", RTLD_LAZY);
-  if (!handle) {
-    fprintf(stderr, "DEBUG: Failed to dlopen libwayland-client.so.0: %s\n",
-            dlerror());
-    return FALSE;
-  }
+  MakasWaylandCapabilities *capabilities =
+      makas_utils_get_wayland_capabilities();
+  gboolean supported =
+      makas_wayland_capabilities_get_has_layer_shell(capabilities);
+  g_object_unref(capabilities);
 
-  // Symbol loading
-  void *(*wl_display_connect)(const char *) =
-      dlsym(handle, "wl_display_connect");
-  void *(*wl_proxy_marshal_constructor)(void *, uint32_t, void *, ...) =
-      dlsym(handle, "wl_proxy_marshal_constructor");
-  void *wl_registry_interface = dlsym(handle, "wl_registry_interface");
+  return supported;
+}
 
-  int (*wl_proxy_add_listener)(void *, void (**)(void), void *) =
-      dlsym(handle, "wl_proxy_add_listener");
-  int (*wl_display_roundtrip)(void *) = dlsym(handle, "wl_display_roundtrip");
-  void (*wl_display_disconnect)(void *) =
-      dlsym(handle, "wl_display_disconnect");
+typedef struct {
+  GtkWidget *window;
+  gboolean done;
+  gulong unmap_handler;
+  GSource *timeout_source;
+  GSource *cancel_source;
+#ifdef GDK_WINDOWING_WAYLAND
+  struct wl_callback *sync_callback;
+#endif
+} HideWindowData;
+
+static void free_hide_window_data(HideWindowData *data) {
+  g_object_unref(data->window);
+  g_free(data);
+}
 
-  if (!wl_display_connect || !wl_proxy_marshal_constructor ||
-      !wl_registry_interface || !wl_proxy_add_listener ||
-      !wl_display_roundtrip || !wl_display_disconnect) {
-    dlclose(handle);
-    return FALSE;
+static void drop_source(GSource **source) {
+  if (*source != NULL) {
+    g_source_destroy(*source);
+    g_source_unref(*source);
+    *source = NULL;
   }
+}
 
-  void *display = wl_display_connect(NULL);
-  if (!display) {
-    dlclose(handle);
-    return FALSE;
+// Finishes the task on the first of confirmation, timeout or cancellation
+static void complete_hide_window(GTask *task, gboolean confirmed) {
+  HideWindowData *data = g_task_get_task_data(task);
+  if (data->done) {
+    return;
   }
+  data->done = TRUE;
 
-  MakasGrimSupportState state = {0};
-  void *registry =
-      wl_proxy_marshal_constructor(display, 1, wl_registry_interface, NULL);
+  if (data->unmap_handler != 0) {
+    g_signal_handler_disconnect(data->window, data->unmap_handler);
+    data->unmap_handler = 0;
+  }
+  drop_source(&data->timeout_source);
+  drop_source(&data->cancel_source);
+#ifdef GDK_WINDOWING_WAYLAND
+  if (data->sync_callback != NULL) {
+    wl_callback_destroy(data->sync_callback);
+    data->sync_callback = NULL;
+  }
+#endif
 
-  if (!registry) {
-    wl_display_disconnect(display);
-    dlclose(handle);
-    return FALSE;
+  if (!g_task_return_error_if_cancelled(task)) {
+    g_task_return_boolean(task, confirmed);
   }
+  g_object_unref(task);
+}
 
-  struct wl_registry_listener listener = {
-      .global = grim_support_registry_handler, .global_remove = NULL};
+static gboolean on_hide_window_unmap_event(GtkWidget *widget, GdkEvent *event,
+                                           gpointer user_data) {
+  complete_hide_window(G_TASK(user_data), TRUE);
+  return GDK_EVENT_PROPAGATE;
+}
 
-  wl_proxy_add_listener(registry, (void (**)(void))&listener, &state);
+static gboolean on_hide_window_timeout(gpointer user_data) {
+  complete_hide_window(G_TASK(user_data), FALSE);
+  return G_SOURCE_REMOVE;
+}
 
-  if (wl_display_roundtrip(display) < 0) {
-    wl_display_disconnect(display);
-    dlclose(handle);
-    return FALSE;
+static gboolean on_hide_window_cancelled(GCancellable *cancellable,
+                                         gpointer user_data) {
+  complete_hide_window(G_TASK(user_data), FALSE);
+  return G_SOURCE_REMOVE;
+}
+
+#ifdef GDK_WINDOWING_WAYLAND
+static void hide_window_sync_done(void *data, struct wl_callback *callback,
+                                  uint32_t callback_data) {
+  GTask *task = data;
+  HideWindowData *hide_data = g_task_get_task_data(task);
+
+  wl_callback_destroy(callback);
+  hide_data->sync_callback = NULL;
+  complete_hide_window(task, TRUE);
+}
+
+static const struct wl_callback_listener hide_window_sync_listener = {
+    .done = hide_window_sync_done,
+};
+#endif
+
+void makas_utils_hide_window_async(GtkWidget *window, guint timeout,
+                                   GCancellable *cancellable,
+                                   GAsyncReadyCallback callback,
+                                   gpointer user_data) {
+  g_return_if_fail(GTK_IS_WIDGET(window));
+
+  GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+  g_task_set_source_tag(task, makas_utils_hide_window_async);
+
+  // Not on screen, nothing to wait for
+  if (!gtk_widget_get_mapped(window)) {
+    gtk_widget_hide(window);
+    g_task_return_boolean(task, TRUE);
+    g_object_unref(task);
+    return;
   }
 
-  wl_display_disconnect(display);
-  dlclose(handle);
+  HideWindowData *data = g_new0(HideWindowData, 1);
+  data->window = g_object_ref(window);
+  g_task_set_task_data(task, data, (GDestroyNotify)free_hide_window_data);
+
+  // The task keeps its reference until complete_hide_window()
+  data->timeout_source = g_timeout_source_new(timeout);
+  g_source_set_callback(data->timeout_source, on_hide_window_timeout, task,
+                        NULL);
+  g_source_attach(data->timeout_source, g_main_context_get_thread_default());
+
+  if (cancellable != NULL) {
+    data->cancel_source = g_cancellable_source_new(cancellable);
+    g_source_set_callback(data->cancel_source,
+                          G_SOURCE_FUNC(on_hide_window_cancelled), task, NULL);
+    g_source_attach(data->cancel_source, g_main_context_get_thread_default());
+  }
+
+#ifdef GDK_WINDOWING_WAYLAND
+  GdkDisplay *display = gtk_widget_get_display(window);
+  if (GDK_IS_WAYLAND_DISPLAY(display)) {
+    gtk_widget_hide(window);
+
+    // Requests are handled in order, so once the compositor answers the sync
+    // it has also processed the unmapped surface
+    struct wl_display *wl_display =
+        gdk_wayland_display_get_wl_display(display);
+    data->sync_callback = wl_display_sync(wl_display);
+    wl_callback_add_listener(data->sync_callback, &hide_window_sync_listener,
+                             task);
+    wl_display_flush(wl_display);
+    return;
+  }
+#endif
+
+  // The X server sends UnmapNotify once the window is off screen
+  data->unmap_handler =
+      g_signal_connect(window, "unmap-event",
+                       G_CALLBACK(on_hide_window_unmap_event), task);
+  gtk_widget_hide(window);
+}
+
+gboolean makas_utils_hide_window_finish(GAsyncResult *result, GError **error) {
+  g_return_val_if_fail(g_task_is_valid(result, NULL), FALSE);
 
-  return state.has_layer_shell;
+  return g_task_propagate_boolean(G_TASK(result), error);
 }
@@ -1,15 +1,121 @@
 #ifndef MAKAS_UTILS_H
 #define MAKAS_UTILS_H
 
+#include <gio/gio.h>
+#include <glib-object.h>
 #include <glib.h>
+#include <gtk/gtk.h>
 
 G_BEGIN_DECLS
 
+#define MAKAS_TYPE_WAYLAND_CAPABILITIES (makas_wayland_capabilities_get_type())
+G_DECLARE_FINAL_TYPE(MakasWaylandCapabilities, makas_wayland_capabilities, MAKAS, WAYLAND_CAPABILITIES, GObject)
+
+/**
+ * makas_utils_probe_wayland_async:
+ * @cancellable: (nullable): A #GCancellable.
+ * @callback: (scope async): Called when the probe is done.
+ * @user_data: (closure): Data for @callback.
+ *
+ * Connects to the compositor once on a worker thread and records every
+ * advertised global with its version. The result is cached for the lifetime
+ * of the process, later calls complete right away. A probe that timed out is
+ * not cached, the next call tries again.
+ */
+void makas_utils_probe_wayland_async(GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+
+/**
+ * makas_utils_probe_wayland_finish:
+ * @result: The #GAsyncResult passed to the callback.
+ * @error: Return location for a #GError.
+ *
+ * Returns: (transfer full): The #MakasWaylandCapabilities of the session.
+ */
+MakasWaylandCapabilities *makas_utils_probe_wayland_finish(GAsyncResult *result, GError **error);
+
+/**
+ * makas_utils_get_wayland_capabilities:
+ *
+ * Returns the cached capabilities. Otherwise probes synchronously, or waits for
+ * the probe already in flight. Either can block for the probe timeout, so UI
+ * code should use makas_utils_probe_wayland_async() instead.
+ *
+ * Returns: (transfer full): The #MakasWaylandCapabilities of the session.
+ */
+MakasWaylandCapabilities *makas_utils_get_wayland_capabilities(void);
+
+/**
+ * makas_wayland_capabilities_get_connected:
+ * @self: A #MakasWaylandCapabilities.
+ *
+ * Returns: TRUE if the compositor answered the probe.
+ */
+gboolean makas_wayland_capabilities_get_connected(MakasWaylandCapabilities *self);
+
+/**
+ * makas_wayland_capabilities_get_n_outputs:
+ * @self: A #MakasWaylandCapabilities.
+ *
+ * Returns: The number of wl_output globals.
+ */
+guint makas_wayland_capabilities_get_n_outputs(MakasWaylandCapabilities *self);
+
+/**
+ * makas_wayland_capabilities_get_version:
+ * @self: A #MakasWaylandCapabilities.
+ * @interface: Interface name, e.g. "zwlr_screencopy_manager_v1".
+ *
+ * Returns: The highest advertised version of @interface, 0 if missing.
+ */
+guint makas_wayland_capabilities_get_version(MakasWaylandCapabilities *self, const gchar *interface);
+
+/**
+ * makas_wayland_capabilities_has_global:
+ * @self: A #MakasWaylandCapabilities.
+ * @interface: Interface name, e.g. "zwlr_layer_shell_v1".
+ *
+ * Returns: TRUE if the compositor advertises @interface.
+ */
+gboolean makas_wayland_capabilities_has_global(MakasWaylandCapabilities *self, const gchar *interface);
+
+/**
+ * makas_wayland_capabilities_list_globals:
+ * @self: A #MakasWaylandCapabilities.
+ *
+ * Returns: (transfer full) (array zero-terminated=1): The sorted interface names.
+ */
+gchar **makas_wayland_capabilities_list_globals(MakasWaylandCapabilities *self);
+
+/**
+ * makas_wayland_capabilities_get_can_capture:
+ * @self: A #MakasWaylandCapabilities.
+ *
+ * Returns: TRUE if outputs can be captured with screencopy or ext-image-copy-capture.
+ */
+gboolean makas_wayland_capabilities_get_can_capture(MakasWaylandCapabilities *self);
+
+/**
+ * makas_wayland_capabilities_get_can_capture_toplevels:
+ * @self: A #MakasWaylandCapabilities.
+ *
+ * Returns: TRUE if single windows can be captured with ext-image-copy-capture.
+ */
+gboolean makas_wayland_capabilities_get_can_capture_toplevels(MakasWaylandCapabilities *self);
+
+/**
+ * makas_wayland_capabilities_get_has_layer_shell:
+ * @self: A #MakasWaylandCapabilities.
+ *
+ * Returns: TRUE if the compositor advertises zwlr_layer_shell_v1.
+ */
+gboolean makas_wayland_capabilities_get_has_layer_shell(MakasWaylandCapabilities *self);
+
 /**
  * makas_utils_is_grim_supported:
  *
  * Checks if the current session supports the necessary protocols for
- * grim to capture screenshots (e.g. wl_shm, screencopy, etc.).
+ * grim to capture screenshots (e.g. wl_shm, screencopy, etc.). Uses the
+ * cached capabilities.
  *
  * Returns: TRUE if supported, FALSE otherwise.
  */
@@ -19,11 +125,36 @@ gboolean makas_utils_is_grim_supported(void);
  * makas_utils_is_layer_shell_supported:
  *
  * Checks if the current session supports the zwlr_layer_shell_v1 protocol.
+ * Uses the cached capabilities.
  *
  * Returns: TRUE if supported, FALSE otherwise.
  */
 gboolean makas_utils_is_layer_shell_supported(void);
 
+/**
+ * makas_utils_hide_window_async:
+ * @window: The #GtkWidget of a toplevel window to hide.
+ * @timeout: Milliseconds to wait at most for the confirmation.
+ * @cancellable: (nullable): A #GCancellable.
+ * @callback: (scope async): Called once the window is off screen.
+ * @user_data: (closure): Data for @callback.
+ *
+ * Hides @window and waits until the display server confirms it is gone: the
+ * UnmapNotify on X11, or the compositor answering a sync request sent after
+ * the unmapped surface on Wayland. Must be called from the main thread.
+ */
+void makas_utils_hide_window_async(GtkWidget *window, guint timeout, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+
+/**
+ * makas_utils_hide_window_finish:
+ * @result: The #GAsyncResult passed to the callback.
+ * @error: Return location for a #GError.
+ *
+ * Returns: TRUE if the display server confirmed the window is gone, FALSE if
+ * the timeout ran out first.
+ */
+gboolean makas_utils_hide_window_finish(GAsyncResult *result, GError **error);
+
 G_END_DECLS
 
 #endif /* MAKAS_UTILS_H */
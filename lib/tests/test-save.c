@@ -0,0 +1,272 @@
+#include "makas-save.h"
+#include <glib/gstdio.h>
+#include <string.h>
+
+// Matches PNG_BAND_BYTES in makas-save.c
+#define PNG_BAND_BYTES (128 * 1024)
+
+static void save_done(GObject *source, GAsyncResult *result,
+                      gpointer user_data) {
+  GAsyncResult **out = user_data;
+  *out = g_object_ref(result);
+}
+
+/* Saves @pixbuf through makas_save_image_async() and waits for it */
+static void save_image(GdkPixbuf *pixbuf, const gchar *filename,
+                       const gchar *format, gint level) {
+  g_autoptr(GAsyncResult) result = NULL;
+  g_autoptr(GError) error = NULL;
+
+  makas_save_image_async(pixbuf, filename, format, level, NULL, save_done,
+                         &result);
+  while (!result)
+    g_main_context_iteration(NULL, TRUE);
+  g_assert_true(makas_save_image_finish(result, &error));
+  g_assert_no_error(error);
+}
+
+static GdkPixbuf *new_test_pixbuf(guint width, guint height,
+                                  gboolean has_alpha) {
+  GdkPixbuf *pixbuf =
+      gdk_pixbuf_new(GDK_COLORSPACE_RGB, has_alpha, 8, width, height);
+  guint n_channels = gdk_pixbuf_get_n_channels(pixbuf);
+  gint stride = gdk_pixbuf_get_rowstride(pixbuf);
+  guint8 *pixels = gdk_pixbuf_get_pixels(pixbuf);
+
+  for (guint y = 0; y < height; y++) {
+    for (guint x = 0; x < width; x++) {
+      guint8 *px = pixels + (gsize)y * stride + x * n_channels;
+
+      if (x < width / 2) {
+        // Gradient, the filters and the matcher have something to find
+        px[0] = x, px[1] = x + y, px[2] = y;
+      } else {
+        // Noise, barely compresses
+        guint32 r = g_test_rand_int();
+        px[0] = r, px[1] = r >> 8, px[2] = r >> 16;
+      }
+      if (has_alpha)
+        px[3] = (x + y) % 5 ? 255 : x;
+    }
+  }
+
+  return pixbuf;
+}
+
+static void assert_png_round_trip(guint width, guint height,
+                                  gboolean has_alpha) {
+  static const gint levels[] = {0, 6, 9};
+  g_autoptr(GdkPixbuf) pixbuf = new_test_pixbuf(width, height, has_alpha);
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *dir = g_dir_make_tmp("makas-test-XXXXXX", &error);
+  g_assert_no_error(error);
+  g_autofree gchar *filename = g_build_filename(dir, "test.png", NULL);
+
+  for (guint i = 0; i < G_N_ELEMENTS(levels); i++) {
+    save_image(pixbuf, filename, "png", levels[i]);
+
+    g_autoptr(GdkPixbuf) decoded = gdk_pixbuf_new_from_file(filename, &error);
+    g_assert_no_error(error);
+    g_assert_cmpint(gdk_pixbuf_get_width(decoded), ==, width);
+    g_assert_cmpint(gdk_pixbuf_get_height(decoded), ==, height);
+    g_assert_cmpint(gdk_pixbuf_get_has_alpha(decoded), ==, has_alpha);
+
+    gsize row_bytes = (gsize)width * gdk_pixbuf_get_n_channels(pixbuf);
+    for (guint y = 0; y < height; y++) {
+      g_assert_cmpmem(gdk_pixbuf_read_pixels(decoded) +
+                          (gsize)y * gdk_pixbuf_get_rowstride(decoded),
+                      row_bytes,
+                      gdk_pixbuf_read_pixels(pixbuf) +
+                          (gsize)y * gdk_pixbuf_get_rowstride(pixbuf),
+                      row_bytes);
+    }
+  }
+
+  g_unlink(filename);
+  g_rmdir(dir);
+}
+
+/* Rows per deflate band of an image @width pixels wide */
+static guint rows_per_band(guint width, gboolean has_alpha) {
+  return PNG_BAND_BYTES / (width * (has_alpha ? 4 : 3) + 1);
+}
+
+static void test_png_one_row(void) {
+  assert_png_round_trip(1920, 1, TRUE);
+  assert_png_round_trip(1920, 1, FALSE);
+}
+
+static void test_png_one_band(void) {
+  assert_png_round_trip(256, rows_per_band(256, TRUE), TRUE);
+  assert_png_round_trip(256, rows_per_band(256, FALSE), FALSE);
+}
+
+/* Full bands plus a short last one */
+static void test_png_many_bands(void) {
+  assert_png_round_trip(1920, 20 * rows_per_band(1920, TRUE) + 3, TRUE);
+  assert_png_round_trip(1920, 20 * rows_per_band(1920, FALSE) + 3, FALSE);
+}
+
+/* Reference QOI decoder, written from the specification rather than from the
+ * encoder. Always produces @channels samples per pixel. */
+static guint8 *decode_qoi(const guint8 *data, gsize size, guint *width,
+                          guint *height, guint *channels) {
+  static const guint8 end_marker[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+  guint8 index[64][4] = {{0}};
+  guint8 px[4] = {0, 0, 0, 255};
+  gsize pos = 14;
+  guint run = 0;
+
+  g_assert_cmpuint(size, >=, 14 + sizeof(end_marker));
+  g_assert_cmpmem(data, 4, "qoif", 4);
+  *width = GUINT32_FROM_BE(*(guint32 *)(data + 4));
+  *height = GUINT32_FROM_BE(*(guint32 *)(data + 8));
+  *channels = data[12];
+
+  gsize n_pixels = (gsize)*width * *height;
+  guint8 *pixels = g_malloc(n_pixels * *channels);
+
+  for (gsize i = 0; i < n_pixels; i++) {
+    if (run > 0) {
+      run--;
+    } else {
+      g_assert_cmpuint(pos, <, size - sizeof(end_marker));
+      guint8 op = data[pos++];
+
+      if (op == 0xfe) {
+        memcpy(px, data + pos, 3);
+        pos += 3;
+      } else if (op == 0xff) {
+        memcpy(px, data + pos, 4);
+        pos += 4;
+      } else if ((op & 0xc0) == 0x00) {
+        memcpy(px, index[op], 4);
+      } else if ((op & 0xc0) == 0x40) {
+        px[0] += ((op >> 4) & 3) - 2;
+        px[1] += ((op >> 2) & 3) - 2;
+        px[2] += (op & 3) - 2;
+      } else if ((op & 0xc0) == 0x80) {
+        gint vg = (op & 0x3f) - 32;
+        guint8 next = data[pos++];
+        px[0] += vg - 8 + (next >> 4);
+        px[1] += vg;
+        px[2] += vg - 8 + (next & 0xf);
+      } else {
+        run = op & 0x3f;
+      }
+
+      memcpy(index[(px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64], px,
+             4);
+    }
+
+    memcpy(pixels + i * *channels, px, *channels);
+  }
+
+  g_assert_cmpuint(run, ==, 0);
+  g_assert_cmpuint(pos, ==, size - sizeof(end_marker));
+  g_assert_cmpmem(data + pos, sizeof(end_marker), end_marker,
+                  sizeof(end_marker));
+  return pixels;
+}
+
+static void assert_qoi_round_trip(guint8 *pixels, guint width,
+                                  guint height, guint n_channels) {
+  g_autoptr(GdkPixbuf) pixbuf = gdk_pixbuf_new_from_data(
+      pixels, GDK_COLORSPACE_RGB, n_channels == 4, 8, width, height,
+      width * n_channels, NULL, NULL);
+  g_autoptr(GError) error = NULL;
+  g_autofree gchar *dir = g_dir_make_tmp("makas-test-XXXXXX", &error);
+  g_assert_no_error(error);
+  g_autofree gchar *filename = g_build_filename(dir, "test.qoi", NULL);
+
+  save_image(pixbuf, filename, "qoi", -1);
+
+  g_autofree gchar *data = NULL;
+  gsize size;
+  g_assert_true(g_file_get_contents(filename, &data, &size, &error));
+  g_assert_no_error(error);
+  g_unlink(filename);
+  g_rmdir(dir);
+
+  guint decoded_width, decoded_height, decoded_channels;
+  g_autofree guint8 *decoded =
+      decode_qoi((const guint8 *)data, size, &decoded_width, &decoded_height,
+                 &decoded_channels);
+
+  g_assert_cmpuint(decoded_width, ==, width);
+  g_assert_cmpuint(decoded_height, ==, height);
+  g_assert_cmpuint(decoded_channels, ==, n_channels);
+  g_assert_cmpmem(decoded, (gsize)width * height * n_channels, pixels,
+                  (gsize)width * height * n_channels);
+}
+
+/* A solid 4K screen is one long run, far more ops than one output block */
+static void test_qoi_solid(void) {
+  const guint width = 3840, height = 2160;
+  gsize size = (gsize)width * height * 4;
+  g_autofree guint8 *pixels = g_malloc(size);
+
+  // Black matches the encoder's initial pixel, everything is a run
+  for (gsize i = 0; i < size; i += 4) {
+    pixels[i] = pixels[i + 1] = pixels[i + 2] = 0;
+    pixels[i + 3] = 255;
+  }
+  assert_qoi_round_trip(pixels, width, height, 4);
+
+  for (gsize i = 0; i < size; i += 4) {
+    pixels[i] = 0x30;
+    pixels[i + 1] = 0x60;
+    pixels[i + 2] = 0x90;
+  }
+  assert_qoi_round_trip(pixels, width, height, 4);
+}
+
+/* Runs, small and large differences, repeats and alpha changes */
+static void test_qoi_mixed(void) {
+  const guint width = 1920, height = 1080;
+  g_autofree guint8 *rgba = g_malloc((gsize)width * height * 4);
+  g_autofree guint8 *rgb = g_malloc((gsize)width * height * 3);
+
+  for (guint y = 0; y < height; y++) {
+    for (guint x = 0; x < width; x++) {
+      guint8 *px = rgba + ((gsize)y * width + x) * 4;
+
+      if (y % 7 == 0) {
+        // Solid band
+        px[0] = 0x20, px[1] = 0x40, px[2] = 0x60, px[3] = 255;
+      } else if (x < width / 3) {
+        // Gradient, small steps
+        px[0] = x, px[1] = x + y, px[2] = y, px[3] = 255;
+      } else if (x < 2 * width / 3) {
+        // Noise with a varying alpha
+        guint32 r = g_test_rand_int();
+        px[0] = r, px[1] = r >> 8, px[2] = r >> 16;
+        px[3] = (r >> 24) % 3 ? 255 : r >> 24;
+      } else {
+        // A few colours repeating, hits the index
+        static const guint8 palette[4][4] = {{255, 0, 0, 255},
+                                             {0, 255, 0, 255},
+                                             {0, 0, 255, 128},
+                                             {255, 255, 255, 255}};
+        memcpy(px, palette[(x / 3 + y) % 4], 4);
+      }
+
+      memcpy(rgb + ((gsize)y * width + x) * 3, px, 3);
+    }
+  }
+
+  assert_qoi_round_trip(rgba, width, height, 4);
+  assert_qoi_round_trip(rgb, width, height, 3);
+}
+
+int main(int argc, char *argv[]) {
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add_func("/save/png/one-row", test_png_one_row);
+  g_test_add_func("/save/png/one-band", test_png_one_band);
+  g_test_add_func("/save/png/many-bands", test_png_many_bands);
+  g_test_add_func("/save/qoi/solid", test_qoi_solid);
+  g_test_add_func("/save/qoi/mixed", test_qoi_mixed);
+
+  return g_test_run();
+}
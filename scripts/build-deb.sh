@@ -37,7 +37,7 @@ Section: utils
 Priority: optional
 Architecture: amd64
 Maintainer: Murat Karakaya
-Depends: gjs, libgtk-3-0, gir1.2-gtk-3.0, gir1.2-wnck-3.0, gir1.2-gdkpixbuf-2.0, libx11-6, libxext6, libxcomposite1
+Depends: gjs, libgtk-3-0, gir1.2-gtk-3.0, gir1.2-wnck-3.0, gir1.2-gdkpixbuf-2.0, libx11-6, libxext6, libxcomposite1, libxrender1, zlib1g
 Description: A simple screen recorder and screenshot tool.
 EOF
 
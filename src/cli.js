@@ -1,8 +1,9 @@
 import Gio from 'gi://Gio';
 import Gtk from 'gi://Gtk?version=3.0';
 import Gdk from 'gi://Gdk?version=3.0';
-import { settings, showScreenshotNotification, wait } from './screenshot/utils.js';
-import { CaptureMode } from './screenshot/constants.js';
+import { formatForFile, hideWindow, saveImage, settings, showScreenshotNotification, wait } from './screenshot/utils.js';
+import { CaptureBackend, CaptureMode } from './screenshot/constants.js';
+import { captureWaylandToFile } from './screenshot/captureMethods/captureGrim.js';
 import { performCapture } from './screenshot/captureMethods/performCapture.js';
 import { selectArea } from './screenshot/areaSelectionMethods/selectArea.js';
 import { flashRect } from './screenshot/popupWindows/flash.js';
@@ -55,11 +56,26 @@ export async function executeCLIAction(app, window, options) {
              await wait(delay * 1000);
         }
 
-        if (settings.get_boolean("hide-window")) {
-             topLevel.hide();
-             await wait(windowWait);
+        const windowHidden = settings.get_boolean("hide-window");
+        if (windowHidden) {
+             await hideWindow(topLevel, windowWait);
         }
         
+        // Headless screen grabs on Wayland go from the composited canvas
+        // straight into the encoder on a worker thread
+        if (options.file && captureMode === CaptureMode.SCREEN &&
+            captureBackendValue === CaptureBackend.WAYLAND &&
+            await captureWaylandToFile(options.file, options.format ?? formatForFile(options.file), includePointer)) {
+            print(`[Makas] Saved to ${options.file}`);
+            const screen = Gdk.Screen.get_default();
+            flashRect(0, 0, screen.get_width(), screen.get_height(), topLevel);
+
+            // Only a notification needs the process to stay around a bit
+            if (sendSavedNotification(app, options.file)) await wait(200);
+            app.quit();
+            return;
+        }
+
         let pixbuf;
         
         if (captureMode === CaptureMode.AREA) {
@@ -67,6 +83,7 @@ export async function executeCLIAction(app, window, options) {
                  captureMode: CaptureMode.SCREEN, 
                  includePointer: false, 
                  topLevel,
+                 windowHidden,
                  disableFallback
              });
              
@@ -93,6 +110,7 @@ export async function executeCLIAction(app, window, options) {
                  captureMode, 
                  includePointer, 
                  topLevel,
+                 windowHidden,
                  disableFallback
              });
              pixbuf = result.pixbuf;
@@ -107,18 +125,11 @@ export async function executeCLIAction(app, window, options) {
         if (options.file) {
             try {
                 let filepath = options.file;
-                pixbuf.savev(filepath, "png", [], []);
+                await saveImage(pixbuf, filepath, options.format ?? undefined);
                 print(`[Makas] Saved to ${filepath}`);
                 
-                if (settings.get_boolean("show-notification")) {
-                     const notif = new Gio.Notification();
-                     notif.set_title("Screenshot Saved");
-                     notif.set_body(`Saved to ${filepath}`);
-                     app.send_notification("screenshot-saved", notif);
-                }
-                
                 // Small delay to ensure notification is sent
-                await wait(200);
+                if (sendSavedNotification(app, filepath)) await wait(200);
                 app.quit();
 
             } catch (e) {
@@ -162,3 +173,17 @@ export async function executeCLIAction(app, window, options) {
         window.present();
     }
 }
+
+/**
+ * Tell the user where the file went, if they want notifications.
+ * @returns {boolean} Whether a notification was sent
+ */
+function sendSavedNotification(app, filepath) {
+    if (!settings.get_boolean("show-notification")) return false;
+
+    const notif = new Gio.Notification();
+    notif.set_title("Screenshot Saved");
+    notif.set_body(`Saved to ${filepath}`);
+    app.send_notification("screenshot-saved", notif);
+    return true;
+}
@@ -8,11 +8,14 @@ import GObject from 'gi://GObject';
 
 import { ScreenshotWindow } from './window.js';
 import { CaptureBackend } from './screenshot/constants.js';
-import { settings, backends } from './screenshot/utils.js';
+import { settings, backends, probeWayland } from './screenshot/utils.js';
 import { executeCLIAction } from './cli.js';
 import { parseCLI } from './parseCli.js';
 
-(() => {
+async function detectCaptureBackend() {
+    // Fill the capability cache without blocking, isAvailable() reads it
+    await probeWayland();
+
     const preferred = settings.get_string("capture-backend");
 
     // Try preferred first
@@ -32,7 +35,7 @@ import { parseCLI } from './parseCli.js';
     }
     print(`[Makas] WARNING: No working capture backend found! Falling back to X11.`);
     settings.set_string("capture-backend-auto", CaptureBackend.X11); // Hope xWayland is available
-})();
+}
 
 export const ScreenRecorderApp = GObject.registerClass(
     class ScreenRecorderApp extends Gtk.Application {
@@ -92,7 +95,8 @@ export const ScreenRecorderApp = GObject.registerClass(
             }
 
             if (this.cliOptions && this.cliOptions.action === 'capture') {
-                executeCLIAction(this, win, this.cliOptions);
+                // A capture needs the backend, the window can show without it
+                this.backendReady.then(() => executeCLIAction(this, win, this.cliOptions));
             } else {
                 win.present();
             }
@@ -100,7 +104,12 @@ export const ScreenRecorderApp = GObject.registerClass(
     }
 );
 
-export function main(argv) {
+export async function main(argv) {
+    // The probe can take up to its timeout on a stuck compositor. The UI
+    // starts right away and picks the backend up through the
+    // capture-backend-auto setting once it is known.
+    const backendReady = detectCaptureBackend();
+
     const cliResult = parseCLI(argv);
     if (cliResult.exit) {
         return 0;
@@ -108,5 +117,6 @@ export function main(argv) {
 
     const app = new ScreenRecorderApp();
     app.cliOptions = cliResult;
+    app.backendReady = backendReady;
     return app.runAsync(cliResult.gjsArgv);
 }
@@ -1,4 +1,4 @@
-import { backends } from './screenshot/utils.js';
+import { backends, SAVE_FORMATS } from './screenshot/utils.js';
 import { CaptureMode } from './screenshot/constants.js';
 
 export function parseCLI(argv) {
@@ -12,6 +12,7 @@ export function parseCLI(argv) {
         delay: null,
         clipboard: false,
         file: null,
+        format: null,
         interactive: false,
         exit: false,
         settingsToSet: [],
@@ -85,8 +86,12 @@ export function parseCLI(argv) {
         case ('--interactive'):case('-i'):
           options.interactive = true;
           break;
-        case('-f'):
+        case('--file'):case('-f'):
           options.action = 'capture';
+          if (val) {
+            options.file = val;
+            break;
+          }
           if (i + 1 < args.length && !isFlag(args[i+1])) {
             options.file = args[++i];
             break;
@@ -94,6 +99,17 @@ export function parseCLI(argv) {
           print(`[Makas] Error: Argument '${arg}' requires a filename.`);
           options.exit = true;
           break;
+        case('--format'):
+          if (!val && i + 1 < args.length && !isFlag(args[i+1])) {
+            val = args[++i];
+          }
+          if (val && SAVE_FORMATS.includes(val.toLowerCase())) {
+            options.format = val.toLowerCase();
+            break;
+          }
+          print(`[Makas] Error: Argument '${arg}' requires one of: ${SAVE_FORMATS.join(', ')}.`);
+          options.exit = true;
+          break;
         case ('--backend'):case ('-b'):
           if (val) {
             options.backend = resolveBackend(val);
@@ -138,6 +154,7 @@ function printHelp() {
     -d, --delay=seconds            Take screenshot after specified delay [in seconds]
     -i, --interactive              Interactively set options
     -f, --file=filename            Save screenshot directly to this file
+    --format=format                File format for --file (png, qoi, pam, ppm), from the extension by default
     --version                      Print version information and exit
     -b, --backend=backend          Select backend temporarily (x11, shell, wayland, portal)
   `);
@@ -1,6 +1,5 @@
 import { selectAreaX11 } from "./selectAreaX11.js";
-import { isWayland } from "../utils.js";
-import MakasScreenshot from "gi://MakasScreenshot?version=1.0";
+import { isWayland, probeWayland } from "../utils.js";
 
 /**
  * Select screen area using the appropriate backend for the current environment.
@@ -14,7 +13,7 @@ export async function selectArea(bgPixbuf) {
     let hasLayerShell = false;
     if (wayland) {
         try {
-            hasLayerShell = MakasScreenshot.utils_is_layer_shell_supported();
+            hasLayerShell = !!(await probeWayland())?.has_layer_shell;
         } catch (e) {
             console.error("Failed to check Layer Shell availability:", e);
         }
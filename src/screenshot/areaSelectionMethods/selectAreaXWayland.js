@@ -1,5 +1,20 @@
 import GLib from "gi://GLib";
 import Gio from "gi://Gio";
+import MakasScreenshot from "gi://MakasScreenshot?version=1.0";
+
+// The helper finds the background memfd at this descriptor
+const BACKGROUND_FD = 3;
+
+/**
+ * Prepend a directory to a colon separated search path variable
+ * @param {Gio.SubprocessLauncher} launcher
+ * @param {string} variable
+ * @param {string} dir
+ */
+function prependPath(launcher, variable, dir) {
+    const current = launcher.getenv(variable);
+    launcher.setenv(variable, current ? `${dir}:${current}` : dir, true);
+}
 
 /**
  * XWayland area selection for GNOME Wayland.
@@ -14,18 +29,18 @@ export async function selectAreaXWayland(bgPixbuf) {
         return selectAreaX11(bgPixbuf);
     }
 
-    print("Selection: selectAreaXWayland - saving pixbuf for subprocess");
+    print("Selection: selectAreaXWayland - exporting pixbuf for subprocess");
 
     const tempDir = GLib.get_tmp_dir();
     const timestamp = Date.now();
-    const tempImagePath = GLib.build_filenamev([tempDir, `makas_area_select_bg_${timestamp}.png`]);
     const tempResultPath = GLib.build_filenamev([tempDir, `makas_area_select_result_${timestamp}.json`]);
     const tempScriptPath = GLib.build_filenamev([tempDir, `makas_xwayland_helper_${timestamp}.mjs`]);
     const tempDrawerPath = GLib.build_filenamev([tempDir, "selectionDrawer.js"]);
 
+    let bgFd = -1;
     try {
-        // Save pixbuf to temp file
-        bgPixbuf.savev(tempImagePath, "png", [], []);
+        // Raw pixels in a sealed memfd, the helper maps them as they are
+        bgFd = MakasScreenshot.memfd_export_pixbuf(bgPixbuf);
 
         // Get the path to our helper script.
         // We use Gio.File to handle both file:// and resource:// URIs correctly.
@@ -59,12 +74,19 @@ export async function selectAreaXWayland(bgPixbuf) {
             flags: Gio.SubprocessFlags.NONE,
         });
         launcher.setenv("GDK_BACKEND", "x11", true);
+        // The helper imports the library too, and may not find it on the
+        // default search paths
+        prependPath(launcher, "GI_TYPELIB_PATH", GLib.build_filenamev([pkg.libdir, "girepository-1.0"]));
+        prependPath(launcher, "LD_LIBRARY_PATH", pkg.libdir);
+        // The launcher owns the descriptor from here on
+        launcher.take_fd(bgFd, BACKGROUND_FD);
+        bgFd = -1;
 
         const proc = launcher.spawnv([
             "gjs",
             "-m",
             tempScriptPath,
-            tempImagePath,
+            `${BACKGROUND_FD}`,
             tempResultPath,
         ]);
 
@@ -117,13 +139,16 @@ export async function selectAreaXWayland(bgPixbuf) {
         print(`Error in selectAreaXWayland: ${e.message}`);
         return null;
     } finally {
+        if (bgFd >= 0) {
+            GLib.close(bgFd);
+        }
+
         // Cleanup temp files
         const cleanup = (path) => {
             try {
                 if (path) GLib.unlink(path);
             } catch (e) { /* ignore */ }
         };
-        cleanup(tempImagePath);
         cleanup(tempResultPath);
         cleanup(tempScriptPath);
         cleanup(tempDrawerPath);
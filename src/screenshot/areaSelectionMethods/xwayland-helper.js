@@ -5,42 +5,49 @@
  * This script is spawned as a subprocess with GDK_BACKEND=x11 to force XWayland.
  * It performs the area selection and writes the result to a JSON file.
  * 
- * Usage: gjs -m xwayland-helper.js <background-image-path> <result-json-path>
+ * Usage: gjs -m xwayland-helper.js <background-fd> <result-json-path>
+ *
+ * The background is a sealed memfd from MakasScreenshot.memfd_export_pixbuf(),
+ * inherited at <background-fd>.
  */
 
 import Gtk from "gi://Gtk?version=3.0";
 import Gdk from "gi://Gdk?version=3.0";
-import GdkPixbuf from "gi://GdkPixbuf";
 import Gio from "gi://Gio";
+import GLib from "gi://GLib";
+import MakasScreenshot from "gi://MakasScreenshot?version=1.0";
 import system from "system";
 import { SelectionDrawer } from "./selectionDrawer.js";
 
 const args = system.programArgs;
-let bgImagePath, resultPath;
+let bgFdArg, resultPath;
 
 // Simple heuristic to find args
 const cleanArgs = args.filter(a => !a.endsWith(".js") && !a.endsWith(".mjs") && a !== "-m");
 if (cleanArgs.length >= 2) {
-    bgImagePath = cleanArgs[0];
+    bgFdArg = cleanArgs[0];
     resultPath = cleanArgs[1];
 } else {
     // Fallback if filtering failed (e.g. if script name is not in args)
     if (args.length >= 2) {
-        bgImagePath = args[0];
+        bgFdArg = args[0];
         resultPath = args[1];
     }
 }
 
-if (!bgImagePath || !resultPath) {
-    print(`Usage: gjs -m xwayland-helper.js <background-image-path> <result-json-path>`);
+const bgFd = parseInt(bgFdArg, 10);
+if (Number.isNaN(bgFd) || !resultPath) {
+    print(`Usage: gjs -m xwayland-helper.js <background-fd> <result-json-path>`);
     print(`Received args: ${JSON.stringify(args)}`);
     system.exit(1);
 }
 
 Gtk.init(null);
 
-const bgPixbuf = GdkPixbuf.Pixbuf.new_from_file(bgImagePath);
-let bgSurface = null;
+// Maps the parent's pixels read-only, nothing to decode
+const bgSurface = MakasScreenshot.memfd_import_surface(bgFd);
+GLib.close(bgFd);
+let bgScaled = false;
 const drawer = new SelectionDrawer();
 
 const data = {
@@ -90,8 +97,11 @@ window.add_events(
 );
 
 window.connect("draw", (widget, cr) => {
-    if (!bgSurface && bgPixbuf) {
-        bgSurface = Gdk.cairo_surface_create_from_pixbuf(bgPixbuf, 0, widget.get_window());
+    if (!bgScaled) {
+        // Same as the window scale Gdk.cairo_surface_create_from_pixbuf() applies
+        const scale = widget.get_scale_factor();
+        bgSurface.setDeviceScale(scale, scale);
+        bgScaled = true;
     }
 
     drawer.draw(cr, widget, bgSurface, data.rect, { x: 0, y: 0 }, data.buttonPressed);
@@ -1,28 +1,88 @@
 import GLib from "gi://GLib";
 import MakasScreenshot from "gi://MakasScreenshot?version=1.0";
 import { CaptureMode } from "../constants.js";
+import { getWaylandCapabilities, probeWayland, settings } from "../utils.js";
+import { selectToplevel } from "../popupWindows/selectToplevel.js";
 
 let isAvailable = null;
 
 /**
  * Capture the screen using the native Wayland capture implementation.
- * Tries ext-image-copy-capture first, then falls back to wlr-screencopy.
+ * The library picks ext-image-copy-capture or wlr-screencopy on a single
+ * connection and falls back between them itself.
  */
-export async function captureWithWayland({ includePointer, captureMode }) {
+export async function captureWithWayland({ includePointer, captureMode, windowHidden }) {
+    const context = MakasScreenshot.CaptureContext.get_default();
+    context.render_threads = Math.max(0, settings.get_int("render-threads"));
+
     if (captureMode === CaptureMode.WINDOW) {
-        throw new Error("Window capture isn't supported in Wayland Backend. Please use a different backend for window capture.");
+        return captureToplevel(context, includePointer);
     }
 
-    // Try ext-image-copy-capture first (newer, standard protocol)
-    let pixbuf = MakasScreenshot.capture_ext_image_copy(includePointer);
-
-    // Fall back to wlr-screencopy (older, wlroots-specific protocol)
+    // Only a window we just hid can still be animating out. Wait for the
+    // screen to settle then, but never longer than the fixed window wait.
+    const settleTime = windowHidden ? settings.get_int("settle-time") : 0;
+    const pixbuf = settleTime > 0
+        ? await captureAsync(context, "capture_stable", [settleTime, settings.get_int("window-wait"), includePointer])
+        : await captureAsync(context, "capture_screen", [includePointer]);
     if (!pixbuf) {
-        pixbuf = MakasScreenshot.capture_screencopy(includePointer);
+        throw new Error("Wayland capture failed: no supported capture protocol available");
     }
 
+    return {
+        x: 0,
+        y: 0,
+        pixbuf,
+    };
+}
+
+/**
+ * Capture the whole screen straight into a file. Capture and encoding both run
+ * on the context's worker thread, no pixbuf is created or handed to JS.
+ * @param {string} filepath
+ * @param {string} format - One of SAVE_FORMATS
+ * @param {boolean} includePointer
+ * @returns {Promise<boolean>} Whether the file was written
+ */
+export async function captureWaylandToFile(filepath, format, includePointer) {
+    if (!hasWaylandScreenshot()) return false;
+
+    const context = MakasScreenshot.CaptureContext.get_default();
+    context.render_threads = Math.max(0, settings.get_int("render-threads"));
+    const level = settings.get_int("png-compression");
+    return !!(await captureAsync(context, "capture_to_file", [filepath, format, level, includePointer]));
+}
+
+/**
+ * Capture a single window through ext-foreign-toplevel image capture sources.
+ * Only the chosen window's buffer is transferred.
+ */
+async function captureToplevel(context, includePointer) {
+    if (!(await probeWayland())?.can_capture_toplevels) {
+        throw new Error("Window capture isn't supported by this compositor in Wayland Backend. Please use a different backend for window capture.");
+    }
+
+    const toplevels = context.list_toplevels().deepUnpack();
+    if (toplevels.length === 0) {
+        throw new Error("Wayland capture failed: no windows to capture");
+    }
+
+    const identifier = await selectToplevel(toplevels);
+    if (!identifier) return null;
+
+    const pixbuf = await new Promise((resolve) => {
+        context.capture_toplevel_async(identifier, includePointer, null, (source, result) => {
+            try {
+                resolve(context.capture_toplevel_finish(result));
+            } catch (e) {
+                console.error("Wayland capture_toplevel failed:", e.message);
+                resolve(null);
+            }
+        });
+    });
+
     if (!pixbuf) {
-        throw new Error("Wayland capture failed: no supported capture protocol available");
+        throw new Error("Wayland capture failed: the window could not be copied");
     }
 
     return {
@@ -32,6 +92,24 @@ export async function captureWithWayland({ includePointer, captureMode }) {
     };
 }
 
+/**
+ * Run one of the context's `*_async` capture methods on its worker thread so
+ * the main loop keeps running. `args` are the method's own arguments, before
+ * the cancellable. Resolves to null when the capture fails.
+ */
+function captureAsync(context, method, args, cancellable = null) {
+    return new Promise((resolve) => {
+        context[`${method}_async`](...args, cancellable, (source, result) => {
+            try {
+                resolve(context[`${method}_finish`](result));
+            } catch (e) {
+                console.error(`Wayland ${method} failed:`, e.message);
+                resolve(null);
+            }
+        });
+    });
+}
+
 /**
  * Check if the native Wayland capture is available.
  * No external binary is required — we use the native C implementation.
@@ -42,10 +120,9 @@ export function hasWaylandScreenshot() {
     const waylandDisplay = GLib.getenv("WAYLAND_DISPLAY");
     if (!waylandDisplay) return isAvailable = false;
 
-    try {
-        return isAvailable = MakasScreenshot.utils_is_grim_supported();
-    } catch (e) {
-        console.error("Failed to check Wayland capture availability:", e);
-        return isAvailable = false;
-    }
+    // Filled in by the startup probe. Unknown until it finishes, and a timed
+    // out probe may still succeed later.
+    const capabilities = getWaylandCapabilities();
+    if (!capabilities?.connected) return false;
+    return isAvailable = capabilities.can_capture;
 }
@@ -1,7 +1,7 @@
 import GLib from "gi://GLib";
 import Gio from "gi://Gio";
-import GdkPixbuf from "gi://GdkPixbuf?version=2.0";
 import { CaptureMode } from "../constants.js";
+import { loadImage } from "../utils.js";
 
 const PORTAL_BUS_NAME = "org.freedesktop.portal.Desktop";
 const PORTAL_OBJECT_PATH = "/org/freedesktop/portal/desktop";
@@ -54,19 +54,14 @@ export async function captureWithPortal({ captureMode }) {
                     const file = Gio.File.new_for_uri(uriString);
                     const path = file.get_path();
 
-                    let pixbuf = GdkPixbuf.Pixbuf.new_from_file(path);
-
-                    try {
-                        GLib.unlink(path);
-                    } catch (e) {
-                        // Ignore cleanup errors
-                    }
-
-                    resolve({
-                        x: 0,
-                        y: 0,
-                        pixbuf,
-                    });
+                    // Decoded on a worker thread, which also removes the file
+                    loadImage(path, true).then((pixbuf) => {
+                        resolve({
+                            x: 0,
+                            y: 0,
+                            pixbuf,
+                        });
+                    }, reject);
                 } catch (e) {
                     reject(e);
                 }
@@ -1,8 +1,7 @@
-import GdkPixbuf from "gi://GdkPixbuf?version=2.0";
 import GLib from "gi://GLib";
 import Gio from "gi://Gio";
 import { CaptureMode } from "../constants.js";
-import { getCurrentDate, settings, wait } from "../utils.js";
+import { getCurrentDate, hideWindow, loadImage, settings } from "../utils.js";
 
 let isAvailable = null;
 
@@ -11,12 +10,13 @@ export async function captureWithShell({ includePointer, captureMode, topLevel }
     const interfaceName = serviceName;
     const objectPath = "/org/gnome/Shell/Screenshot";
 
-    const cacheDir = GLib.get_user_cache_dir();
-    const makasCache = GLib.build_filenamev([cacheDir, "makas"]);
-    GLib.mkdir_with_parents(makasCache, 0o700);
+    // XDG_RUNTIME_DIR is a tmpfs, the PNG never reaches the disk
+    const runtimeDir = GLib.get_user_runtime_dir();
+    const makasRuntime = GLib.build_filenamev([runtimeDir, "makas"]);
+    GLib.mkdir_with_parents(makasRuntime, 0o700);
 
     const tmpFilename = GLib.build_filenamev([
-        makasCache,
+        makasRuntime,
         `scr-${getCurrentDate()}.png`,
     ]);
 
@@ -34,8 +34,8 @@ export async function captureWithShell({ includePointer, captureMode, topLevel }
             break;
         case CaptureMode.WINDOW:
             if (topLevel.get_visible()) {
-                topLevel.hide(); // Top level will always be shown after capture is finished @prescreenshot.js
-                await wait(settings.get_int("window-wait") * 10); // Wait for window to hide
+                // Top level will always be shown after capture is finished @prescreenshot.js
+                await hideWindow(topLevel, settings.get_int("window-wait") * 10);
             }
             method = "ScreenshotWindow";
             dbusParams = new GLib.Variant("(bbbs)", [
@@ -49,20 +49,29 @@ export async function captureWithShell({ includePointer, captureMode, topLevel }
             throw new Error("Invalid screenshot mode. Please report this issue to the developer.");
     }
 
-    connection.call_sync(
-        serviceName,
-        objectPath,
-        interfaceName,
-        method,
-        dbusParams,
-        null,
-        Gio.DBusCallFlags.NONE,
-        -1,
-        null
-    );
+    await new Promise((resolve, reject) => {
+        connection.call(
+            serviceName,
+            objectPath,
+            interfaceName,
+            method,
+            dbusParams,
+            null,
+            Gio.DBusCallFlags.NONE,
+            -1,
+            null,
+            (conn, res) => {
+                try {
+                    resolve(conn.call_finish(res));
+                } catch (e) {
+                    reject(e);
+                }
+            }
+        );
+    });
 
-    const pixbuf = GdkPixbuf.Pixbuf.new_from_file(tmpFilename);
-    GLib.unlink(tmpFilename);
+    // Decoded on a worker thread, which also removes the file
+    const pixbuf = await loadImage(tmpFilename, true);
 
     if (!pixbuf) throw new Error("Pixbuf is null");
     return {
@@ -12,14 +12,18 @@ export async function captureWithX11({ includePointer, captureMode }) {
     let result;
     switch (captureMode) {
         case CaptureMode.SCREEN: {
-            const rootWindow = Gdk.get_default_root_window();
-            const pixbuf = Gdk.pixbuf_get_from_window(
-                rootWindow,
-                0,
-                0,
-                rootWindow.get_width(),
-                rootWindow.get_height(),
-            );
+            // MIT-SHM grab, the Gdk round trip is only a fallback
+            let pixbuf = MakasScreenshot.capture_screen_x11();
+            if (!pixbuf) {
+                const rootWindow = Gdk.get_default_root_window();
+                pixbuf = Gdk.pixbuf_get_from_window(
+                    rootWindow,
+                    0,
+                    0,
+                    rootWindow.get_width(),
+                    rootWindow.get_height(),
+                );
+            }
             if (includePointer) compositeCursor(pixbuf, 0, 0);
             
             result = {
@@ -31,14 +35,19 @@ export async function captureWithX11({ includePointer, captureMode }) {
             break;
         }
         case CaptureMode.WINDOW: {
-            const selectionResult = await selectWindow();
-
-            if (!selectionResult) return null;
-
-            result = captureWindowWithXShape(
-                selectionResult.clickX,
-                selectionResult.clickY
-            );
+            let selectionResult;
+            try {
+                selectionResult = await selectWindow();
+                if (!selectionResult) return null;
+
+                // Reuses the pixmap of the window if it was previewed
+                result = captureWindowWithXShape(
+                    selectionResult.clickX,
+                    selectionResult.clickY
+                );
+            } finally {
+                MakasScreenshot.release_window_pixmaps_x11();
+            }
             if (!result) break;
             
             if(includePointer) compositeCursor(result.pixbuf, result.x, result.y);
@@ -0,0 +1,67 @@
+import Gtk from "gi://Gtk?version=3.0";
+import Gdk from "gi://Gdk?version=3.0";
+import Pango from "gi://Pango";
+
+/**
+ * Let the user pick one of the listed Wayland windows. Wayland clients can't
+ * hit-test other windows, so the choice is made from their titles.
+ * @param {Array<[string, string, string]>} toplevels - [identifier, appId, title] tuples
+ * @returns {Promise<string|null>} The identifier of the chosen window
+ */
+export function selectToplevel(toplevels) {
+    return new Promise((resolve) => {
+        let result = null;
+        const window = new Gtk.Window({
+            title: "Select Window",
+            modal: true,
+            resizable: false,
+            window_position: Gtk.WindowPosition.CENTER,
+            default_width: 420,
+        });
+
+        const listBox = new Gtk.ListBox({
+            selection_mode: Gtk.SelectionMode.BROWSE,
+            activate_on_single_click: true,
+        });
+
+        for (const [identifier, appId, title] of toplevels) {
+            const label = new Gtk.Label({
+                label: title || appId || identifier,
+                tooltip_text: appId,
+                xalign: 0,
+                ellipsize: Pango.EllipsizeMode.END,
+                margin: 8,
+            });
+            const row = new Gtk.ListBoxRow();
+            row.add(label);
+            row.identifier = identifier;
+            listBox.add(row);
+        }
+
+        listBox.connect("row-activated", (box, row) => {
+            result = row.identifier;
+            window.destroy();
+        });
+
+        window.connect("key-press-event", (widget, event) => {
+            if (event.get_keyval()[1] === Gdk.KEY_Escape) {
+                window.destroy();
+                return true;
+            }
+            return false;
+        });
+
+        // Only the chosen window's own buffer is copied, the picker can't
+        // show up in the capture, so there is nothing to wait for
+        window.connect("destroy", () => resolve(result));
+
+        const scrolled = new Gtk.ScrolledWindow({
+            hscrollbar_policy: Gtk.PolicyType.NEVER,
+            propagate_natural_height: true,
+            max_content_height: 480,
+        });
+        scrolled.add(listBox);
+        window.add(scrolled);
+        window.show_all();
+    });
+}
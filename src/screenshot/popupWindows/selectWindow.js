@@ -2,6 +2,12 @@ import Gtk from "gi://Gtk?version=3.0";
 import Gdk from "gi://Gdk?version=3.0";
 import GLib from "gi://GLib";
 import Cairo from "cairo";
+import MakasScreenshot from "gi://MakasScreenshot?version=1.0";
+
+// Largest side of the hover preview, in logical pixels
+const PREVIEW_SIZE = 240;
+const PREVIEW_MARGIN = 24;
+const PREVIEW_REFRESH_MS = 250;
 
 /**
  * Show window selection cursor and return click position.
@@ -10,6 +16,10 @@ import Cairo from "cairo";
 export function selectWindow() {
     return new Promise((resolve) => {
         let aborted = false;
+        let hovered = null;
+        let pointer = null;
+        let preview = null;
+        let refreshId = 0;
         const screen = Gdk.Screen.get_default();
         const visual = screen.get_rgba_visual();
         const window = new Gtk.Window({
@@ -38,7 +48,9 @@ export function selectWindow() {
         }
 
         window.add_events(
-            Gdk.EventMask.BUTTON_PRESS_MASK | Gdk.EventMask.KEY_PRESS_MASK,
+            Gdk.EventMask.BUTTON_PRESS_MASK |
+                Gdk.EventMask.KEY_PRESS_MASK |
+                Gdk.EventMask.POINTER_MOTION_MASK,
         );
 
         window.connect("draw", (widget, cr) => {
@@ -57,6 +69,27 @@ export function selectWindow() {
                 cr.setLineWidth(2);
                 cr.rectangle(1, 1, width - 2, height - 2);
                 cr.stroke();
+
+                // Uncover the window that would be captured
+                if (hovered) {
+                    cr.setOperator(Cairo.Operator.SOURCE);
+                    cr.setSourceRGBA(0, 0, 0, 0);
+                    cr.rectangle(hovered.x, hovered.y, hovered.width, hovered.height);
+                    cr.fill();
+
+                    cr.setOperator(Cairo.Operator.OVER);
+                    cr.setSourceRGBA(1, 0, 0, 0.8);
+                    cr.rectangle(hovered.x + 1, hovered.y + 1, hovered.width - 2, hovered.height - 2);
+                    cr.stroke();
+                }
+
+                if (preview) {
+                    cr.setSourceSurface(preview.surface, preview.x, preview.y);
+                    cr.paint();
+                    cr.setSourceRGBA(1, 0, 0, 0.8);
+                    cr.rectangle(preview.x, preview.y, preview.width, preview.height);
+                    cr.stroke();
+                }
             } else {
                 // Clear to fully transparent
                 cr.setOperator(Cairo.Operator.SOURCE);
@@ -76,6 +109,50 @@ export function selectWindow() {
 
         const seat = display.get_default_seat();
 
+        // Scaled down on the X server, the window pixmap stays named in between
+        const updatePreview = () => {
+            const pixbuf = hovered
+                ? MakasScreenshot.window_thumbnail_x11(pointer.x, pointer.y, PREVIEW_SIZE * window.get_scale_factor())
+                : null;
+            if (!pixbuf) {
+                preview = null;
+                return;
+            }
+
+            const scale = window.get_scale_factor();
+            const width = pixbuf.get_width() / scale;
+            const height = pixbuf.get_height() / scale;
+            const geom = display.get_monitor_at_point(pointer.x, pointer.y).get_geometry();
+            preview = {
+                surface: Gdk.cairo_surface_create_from_pixbuf(pixbuf, scale, window.get_window()),
+                x: geom.x + geom.width - width - PREVIEW_MARGIN,
+                y: geom.y + geom.height - height - PREVIEW_MARGIN,
+                width,
+                height,
+            };
+        };
+
+        window.connect("motion-notify-event", (widget, event) => {
+            if (!(screen.is_composited() && visual)) return false;
+
+            // The window stack is cached natively, no X round trip per motion
+            const [, x, y] = event.get_root_coords();
+            const [found, rect] = MakasScreenshot.find_window_x11(Math.round(x), Math.round(y));
+            const next = found ? rect : null;
+            if (
+                next?.x !== hovered?.x ||
+                next?.y !== hovered?.y ||
+                next?.width !== hovered?.width ||
+                next?.height !== hovered?.height
+            ) {
+                hovered = next;
+                pointer = { x: Math.round(x), y: Math.round(y) };
+                updatePreview();
+                widget.queue_draw();
+            }
+            return true;
+        });
+
         window.connect("button-press-event", (widget, event) => {
             const [, x, y] = event.get_root_coords();
             seat.ungrab();
@@ -108,7 +185,22 @@ export function selectWindow() {
             return false;
         });
 
+        window.connect("destroy", () => {
+            if (refreshId) GLib.source_remove(refreshId);
+            refreshId = 0;
+        });
+
         window.show();
+
+        // Keep the preview live while the pointer rests on a window
+        refreshId = GLib.timeout_add(GLib.PRIORITY_DEFAULT, PREVIEW_REFRESH_MS, () => {
+            if (hovered) {
+                updatePreview();
+                window.queue_draw();
+            }
+            return GLib.SOURCE_CONTINUE;
+        });
+
         const gdkWindow = window.get_window();
 
         if (!(screen.is_composited() && visual)) {
@@ -4,7 +4,7 @@ import GObject from "gi://GObject";
 import GLib from "gi://GLib";
 import Gio from "gi://Gio";
 import GdkPixbuf from "gi://GdkPixbuf";
-import { getBackupFolder, getCurrentDate, getDestinationPath, settings } from "../utils.js";
+import { getBackupFolder, getCurrentDate, getDestinationPath, saveImage, settings } from "../utils.js";
 import { SOURCE_PATH } from "../constants.js";
 
 export const PostScreenshot = GObject.registerClass(
@@ -108,24 +108,27 @@ export const PostScreenshot = GObject.registerClass(
       return false;
     }
 
-    onSave() {
+    async onSave() {
       if (!this.pixbuf) return;
 
       const folder = settings.get_string("screenshot-save-folder");
 
       console.log("folder", folder);
-      const filename = `Screenshot-${getCurrentDate()}.png`;
+      const format = settings.get_string("save-format");
+      const filename = `Screenshot-${getCurrentDate()}.${format}`;
       const filepath = getDestinationPath({ folder, filename });
 
       if (filepath) {
+        const pixbuf = this.pixbuf;
+        this.statusLabel.set_text("Saving...");
         try {
-          this.pixbuf.savev(filepath, "png", [], []);
+          await saveImage(pixbuf, filepath, format);
           this.statusLabel.set_text(`Saved as: ${GLib.path_get_basename(filepath)}`);
         } catch {
           try {
             const folder = getBackupFolder()
             const filepath = getDestinationPath({ folder, filename });
-            this.pixbuf.savev(filepath, "png", [], []);
+            await saveImage(pixbuf, filepath, format);
             this.statusLabel.set_text(`Saved as: ${GLib.path_get_basename(filepath)}`);
           } catch (e) {
             this.statusLabel.set_text(`Save failed: ${e.message}`);
@@ -147,31 +150,32 @@ export const PostScreenshot = GObject.registerClass(
       dialog.add_button("_Cancel", Gtk.ResponseType.CANCEL);
       dialog.add_button("_Save", Gtk.ResponseType.ACCEPT);
       dialog.set_do_overwrite_confirmation(true);
-      dialog.set_current_name(`Screenshot-${getCurrentDate()}.png`);
+      dialog.set_current_name(`Screenshot-${getCurrentDate()}.${settings.get_string("save-format")}`);
       dialog.set_current_folder(settings.get_string("screenshot-save-folder"));
 
-      dialog.connect("response", (d, response) => {
-        if (response === Gtk.ResponseType.ACCEPT) {
-          const filepath = d.get_filename();
-          if (filepath) {
-            try {
-              this.pixbuf.savev(filepath, "png", [], []);
-              this.statusLabel.set_text(`Saved as: ${GLib.path_get_basename(filepath)}`);
-              if (settings.get_boolean("last-screenshot-save-folder")) {
-                settings.set_string("screenshot-save-folder", GLib.path_get_dirname(filepath));
-              }
-            } catch (e) {
-              this.statusLabel.set_text(`Save failed: ${e.message}`);
+      dialog.connect("response", async (d, response) => {
+        const filepath = response === Gtk.ResponseType.ACCEPT ? d.get_filename() : null;
+        dialog.destroy();
+
+        if (filepath) {
+          this.statusLabel.set_text("Saving...");
+          try {
+            // The extension picks the format
+            await saveImage(this.pixbuf, filepath);
+            this.statusLabel.set_text(`Saved as: ${GLib.path_get_basename(filepath)}`);
+            if (settings.get_boolean("last-screenshot-save-folder")) {
+              settings.set_string("screenshot-save-folder", GLib.path_get_dirname(filepath));
             }
+          } catch (e) {
+            this.statusLabel.set_text(`Save failed: ${e.message}`);
           }
         }
-        dialog.destroy();
       });
 
       dialog.show();
     }
 
-    ensureFile() {
+    async ensureFile() {
       if (this.currentFilepath) return this.currentFilepath;
 
       const tmpDir = GLib.get_tmp_dir();
@@ -179,7 +183,8 @@ export const PostScreenshot = GObject.registerClass(
       const filepath = getDestinationPath({ folder: tmpDir, filename });
 
       try {
-        this.pixbuf.savev(filepath, "png", [], []);
+        // Other applications open it, keep it PNG
+        await saveImage(this.pixbuf, filepath, "png");
         this.currentFilepath = filepath;
         this.setupFileMonitor();
         return filepath;
@@ -215,8 +220,8 @@ export const PostScreenshot = GObject.registerClass(
       });
     }
 
-    onOpenWith() {
-      const filepath = this.ensureFile();
+    async onOpenWith() {
+      const filepath = await this.ensureFile();
       if (!filepath) return;
 
       const file = Gio.File.new_for_path(filepath);
@@ -248,8 +253,8 @@ export const PostScreenshot = GObject.registerClass(
       dialog.show_all();
     }
 
-    onOpenApp() {
-      const filepath = this.ensureFile();
+    async onOpenApp() {
+      const filepath = await this.ensureFile();
       if (!filepath) return;
 
       try {
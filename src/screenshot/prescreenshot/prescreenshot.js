@@ -4,7 +4,7 @@ import Gio from "gi://Gio";
 import GObject from "gi://GObject";
 import { CaptureMode, CaptureBackend, SOURCE_PATH } from "../constants.js";
 import { selectArea } from "../areaSelectionMethods/selectArea.js";
-import { settings, wait, showScreenshotNotification } from "../utils.js";
+import { settings, wait, hideWindow, showScreenshotNotification } from "../utils.js";
 import { performCapture } from "../captureMethods/performCapture.js";
 import { flashRect } from "../popupWindows/flash.js";
 
@@ -81,11 +81,10 @@ export const PreScreenshot = GObject.registerClass(
         if (delay * 1000 > windowWait) await this.startDelay(delay * 1000 - windowWait, windowWait);
 
         if (isHideWindow) {
-          topLevel.hide();
-          await wait(windowWait); // Wait for window to hide
+          await hideWindow(topLevel, windowWait);
         }
 
-        if (delay * 1000 > windowWait) await wait(windowWait); // Wait for window to hide
+        if (delay * 1000 > windowWait) await wait(windowWait); // Rest of the delay
 
         let selectionResult = { clickX: 0, clickY: 0 };
         print(`Selection phase, mode=${captureMode}`);
@@ -93,7 +92,7 @@ export const PreScreenshot = GObject.registerClass(
 
         let pixbuf;
         if (captureMode === CaptureMode.AREA) {
-          const screenCaptureResult = await performCapture(captureBackendValue, { captureMode: CaptureMode.SCREEN, includePointer, topLevel });
+          const screenCaptureResult = await performCapture(captureBackendValue, { captureMode: CaptureMode.SCREEN, includePointer, topLevel, windowHidden: isHideWindow });
 
           if (!screenCaptureResult || !screenCaptureResult.pixbuf) {
             throw new Error("Area capture failed");
@@ -117,7 +116,7 @@ export const PreScreenshot = GObject.registerClass(
 
           flashRect(selectionResult.x, selectionResult.y, selectionResult.width, selectionResult.height, topLevel);
         } else {
-          const captureResult = await performCapture(captureBackendValue, { captureMode, includePointer, topLevel });
+          const captureResult = await performCapture(captureBackendValue, { captureMode, includePointer, topLevel, windowHidden: isHideWindow });
           pixbuf = captureResult.pixbuf;
           
           flashRect(captureResult.x, captureResult.y, pixbuf.get_width(), pixbuf.get_height(), topLevel);
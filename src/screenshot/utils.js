@@ -1,5 +1,6 @@
 import GLib from "gi://GLib";
 import Gio from "gi://Gio";
+import MakasScreenshot from "gi://MakasScreenshot?version=1.0";
 import { CaptureBackend } from "./constants.js";
 import { captureWithShell, hasShellScreenshot } from "./captureMethods/captureShell.js";
 import { captureWithX11, hasX11Screenshot } from "./captureMethods/captureX11.js";
@@ -96,6 +97,114 @@ export function showScreenshotNotification(app) {
   app.send_notification("screenshot-captured", notification);
 }
 
+let waylandCapabilities = null;
+
+/**
+ * Probe the compositor's globals off the main thread. The library caches a
+ * completed probe, later calls resolve right away. Synchronous code reads the
+ * result with `getWaylandCapabilities()`.
+ * @returns {Promise<MakasScreenshot.WaylandCapabilities|null>}
+ */
+export function probeWayland() {
+  if (!GLib.getenv("WAYLAND_DISPLAY")) {
+    return Promise.resolve(null);
+  }
+
+  return new Promise((resolve) => {
+    MakasScreenshot.utils_probe_wayland_async(null, (source, result) => {
+      try {
+        waylandCapabilities = MakasScreenshot.utils_probe_wayland_finish(result);
+        resolve(waylandCapabilities);
+      } catch (e) {
+        console.error("Failed to probe Wayland capabilities:", e.message);
+        resolve(null);
+      }
+    });
+  });
+}
+
+/**
+ * The capabilities from the last probe that finished. Never blocks.
+ * @returns {MakasScreenshot.WaylandCapabilities|null} null before any probe finished
+ */
+export function getWaylandCapabilities() {
+  return waylandCapabilities;
+}
+
+/**
+ * Hide a window and resolve once the display server confirms it is off
+ * screen, or after `timeout` ms at the latest.
+ * @param {Gtk.Widget} window
+ * @param {number} timeout - Upper bound in milliseconds
+ * @returns {Promise<boolean>} Whether the hide was confirmed in time
+ */
+export function hideWindow(window, timeout) {
+  return new Promise((resolve) => {
+    MakasScreenshot.utils_hide_window_async(window, timeout, null, (source, result) => {
+      try {
+        resolve(MakasScreenshot.utils_hide_window_finish(result));
+      } catch (e) {
+        console.error("Failed to hide window:", e.message);
+        resolve(false);
+      }
+    });
+  });
+}
+
+// Formats the native encoders write, by file extension
+export const SAVE_FORMATS = ["png", "qoi", "pam", "ppm"];
+
+/**
+ * Pick the save format from the file extension, PNG if it is unknown.
+ * @param {string} filepath
+ * @returns {string}
+ */
+export function formatForFile(filepath) {
+  const basename = GLib.path_get_basename(filepath);
+  const dot = basename.lastIndexOf(".");
+  const extension = dot > 0 ? basename.slice(dot + 1).toLowerCase() : "";
+  return SAVE_FORMATS.includes(extension) ? extension : "png";
+}
+
+/**
+ * Encode a pixbuf on worker threads, the main loop keeps running.
+ * @param {GdkPixbuf.Pixbuf} pixbuf
+ * @param {string} filepath
+ * @param {string} [format] - One of SAVE_FORMATS, guessed from filepath by default
+ * @returns {Promise<void>} Rejects if the file could not be written
+ */
+export function saveImage(pixbuf, filepath, format = formatForFile(filepath)) {
+  const level = settings.get_int("png-compression");
+  return new Promise((resolve, reject) => {
+    MakasScreenshot.save_image_async(pixbuf, filepath, format, level, null, (source, result) => {
+      try {
+        MakasScreenshot.save_image_finish(result);
+        resolve();
+      } catch (e) {
+        reject(e);
+      }
+    });
+  });
+}
+
+/**
+ * Decode an image file on a worker thread
+ * @param {string} filepath
+ * @param {boolean} remove - Delete the file once it was read
+ * @returns {Promise<GdkPixbuf.Pixbuf>}
+ */
+export function loadImage(filepath, remove = false) {
+  return new Promise((resolve, reject) => {
+    MakasScreenshot.load_image_async(filepath, remove, null, (source, result) => {
+      try {
+        resolve(MakasScreenshot.load_image_finish(result));
+      } catch (e) {
+        reject(e);
+      }
+    });
+  });
+}
+
 export function isWayland() {
   const sessionType = GLib.getenv("XDG_SESSION_TYPE");
   const waylandDisplay = GLib.getenv("WAYLAND_DISPLAY");